@@ -0,0 +1,170 @@
+#include "arena.h"
+
+#include <algorithm>
+#include <new>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
+
+const char *arena_pages_name(ArenaPages pages)
+{
+    switch (pages)
+    {
+    case ARENA_PAGES_NORMAL:
+        return "normal";
+    case ARENA_PAGES_TRANSPARENT:
+        return "transparent huge";
+    case ARENA_PAGES_EXPLICIT:
+        return "explicit huge";
+    }
+
+    return "unknown";
+}
+
+Arena::Arena(ArenaPages pages) : requested(pages), backing(pages), cursor(nullptr), end(nullptr), allocated(0) {}
+
+static size_t round_up(size_t value, size_t alignment)
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+#ifndef _WIN32
+
+Arena::~Arena()
+{
+    for (auto &[base, size] : chunks)
+    {
+        munmap(base, size);
+    }
+}
+
+bool Arena::map_chunk(size_t min_size)
+{
+    size_t size = round_up(std::max(min_size, ARENA_CHUNK_SIZE), ARENA_HUGE_PAGE_SIZE);
+    void *base = MAP_FAILED;
+    backing = requested;
+
+#ifdef MAP_HUGETLB
+    if (requested == ARENA_PAGES_EXPLICIT)
+    {
+        // fails unless enough pages are reserved in /proc/sys/vm/nr_hugepages
+        base = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    }
+#endif
+
+    if (base == MAP_FAILED && requested != ARENA_PAGES_NORMAL)
+    {
+        backing = ARENA_PAGES_TRANSPARENT;
+
+        // over-map by a huge page, so the chunk can start on a 2MB boundary.
+        // transparent huge pages only back aligned 2MB ranges
+        size_t mapped = size + ARENA_HUGE_PAGE_SIZE;
+        void *raw = mmap(nullptr, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+        if (raw != MAP_FAILED)
+        {
+            uintptr_t start = round_up(reinterpret_cast<uintptr_t>(raw), ARENA_HUGE_PAGE_SIZE);
+            size_t head = start - reinterpret_cast<uintptr_t>(raw);
+
+            if (head)
+            {
+                munmap(raw, head);
+            }
+
+            munmap(reinterpret_cast<uint8_t *>(start) + size, ARENA_HUGE_PAGE_SIZE - head);
+            base = reinterpret_cast<void *>(start);
+
+#ifdef MADV_HUGEPAGE
+            if (madvise(base, size, MADV_HUGEPAGE) != 0)
+            {
+                backing = ARENA_PAGES_NORMAL; // THP disabled or unsupported
+            }
+#else
+            backing = ARENA_PAGES_NORMAL;
+#endif
+        }
+    }
+
+    if (base == MAP_FAILED)
+    {
+        backing = ARENA_PAGES_NORMAL;
+        base = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    }
+
+    if (base == MAP_FAILED)
+    {
+        return false;
+    }
+
+    chunks.emplace_back(static_cast<uint8_t *>(base), size);
+    cursor = static_cast<uint8_t *>(base);
+    end = cursor + size;
+    return true;
+}
+
+#else
+
+// plain heap chunks, huge pages would need SeLockMemoryPrivilege
+
+Arena::~Arena()
+{
+    for (auto &[base, size] : chunks)
+    {
+        ::operator delete(base, std::align_val_t(ARENA_HUGE_PAGE_SIZE));
+    }
+}
+
+bool Arena::map_chunk(size_t min_size)
+{
+    size_t size = round_up(std::max(min_size, ARENA_CHUNK_SIZE), ARENA_HUGE_PAGE_SIZE);
+    void *base = ::operator new(size, std::align_val_t(ARENA_HUGE_PAGE_SIZE), std::nothrow);
+    backing = ARENA_PAGES_NORMAL;
+
+    if (!base)
+    {
+        return false;
+    }
+
+    chunks.emplace_back(static_cast<uint8_t *>(base), size);
+    cursor = static_cast<uint8_t *>(base);
+    end = cursor + size;
+    return true;
+}
+
+#endif
+
+void Arena::keep_together(size_t size)
+{
+    if (size > ARENA_HUGE_PAGE_SIZE || !cursor)
+    {
+        return; // can't be kept in one page, or the next chunk starts on a boundary anyway
+    }
+
+    uintptr_t position = reinterpret_cast<uintptr_t>(cursor);
+    uintptr_t page_end = round_up(position + 1, ARENA_HUGE_PAGE_SIZE);
+
+    if (position + size > page_end)
+    {
+        cursor = reinterpret_cast<uint8_t *>(page_end); // may equal end, the next allocation maps a chunk
+    }
+}
+
+void *Arena::do_allocate(size_t bytes, size_t alignment)
+{
+    uintptr_t aligned = round_up(reinterpret_cast<uintptr_t>(cursor), alignment);
+
+    if (!cursor || aligned + bytes > reinterpret_cast<uintptr_t>(end))
+    {
+        if (!map_chunk(bytes + alignment))
+        {
+            throw std::bad_alloc();
+        }
+
+        aligned = round_up(reinterpret_cast<uintptr_t>(cursor), alignment);
+    }
+
+    cursor = reinterpret_cast<uint8_t *>(aligned + bytes);
+    allocated += bytes;
+    return reinterpret_cast<void *>(aligned);
+}
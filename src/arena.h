@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <utility>
+#include <vector>
+
+// memory for many long-lived instances, optionally on 2MB pages
+//
+// with thousands of instances and game code touching their memory at
+// random, 4KB pages cost a TLB miss on most instance switches. the arena
+// bump-allocates from large mmap'd chunks that can be backed by huge pages,
+// so a whole instance (Gameboy object with framebuffers and tile cache, and
+// its 64KB address space) sits behind one TLB entry. nothing is freed
+// before the arena is destroyed. on Windows chunks come from the heap and
+// always have normal pages
+
+constexpr size_t ARENA_HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+constexpr size_t ARENA_CHUNK_SIZE = 16 * ARENA_HUGE_PAGE_SIZE; // mapped at a time, address space only until touched
+
+enum ArenaPages : uint8_t
+{
+    ARENA_PAGES_NORMAL,      // 4KB pages
+    ARENA_PAGES_TRANSPARENT, // madvise(MADV_HUGEPAGE), the kernel backs what it can with 2MB pages
+    ARENA_PAGES_EXPLICIT,    // MAP_HUGETLB from the reserved pool, transparent if the pool runs out
+};
+
+const char *arena_pages_name(ArenaPages pages);
+
+struct Arena : std::pmr::memory_resource
+{
+    ArenaPages requested; // what the constructor asked for
+    ArenaPages backing;   // what the last chunk actually got, after fallbacks
+
+    std::vector<std::pair<uint8_t *, size_t>> chunks; // mappings, unmapped by the destructor
+    uint8_t *cursor;                                  // next free byte of the current chunk
+    uint8_t *end;                                     // end of the current chunk
+    size_t allocated;                                 // bytes handed out, for statistics
+
+    explicit Arena(ArenaPages pages);
+    ~Arena() override;
+
+    Arena(const Arena &) = delete;
+    Arena &operator=(const Arena &) = delete;
+
+    // the next size bytes of allocations won't straddle a 2MB boundary if
+    // they fit into one huge page, so they share a TLB entry
+    void keep_together(size_t size);
+
+    void *do_allocate(size_t bytes, size_t alignment) override;
+    void do_deallocate(void *, size_t, size_t) override {} // reclaimed with the arena
+    bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override { return this == &other; }
+
+    bool map_chunk(size_t min_size); // start a new chunk, false if mmap fails
+};
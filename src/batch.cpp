@@ -0,0 +1,305 @@
+#include "batch.h"
+
+#include <algorithm>
+
+#include "topology.h"
+
+GameboyBatch::GameboyBatch(const std::string &game_rom_filename, size_t num_lanes, size_t num_threads,
+                           bool pin_threads, ArenaPages pages)
+    : GameboyBatch(cartridge_load_image(game_rom_filename), num_lanes, num_threads, pin_threads, pages) {}
+
+GameboyBatch::GameboyBatch(RomImage game_rom_image, size_t num_lanes, size_t num_threads, bool pin_threads,
+                           ArenaPages pages)
+    : game_rom(std::move(game_rom_image)), lanes(num_lanes), quarantined(num_lanes, false), pinned(pin_threads),
+      shares(std::max<size_t>(num_threads, 1)), generation(0), workers_busy(0), stopping(false)
+{
+    // lanes pad a short image themselves, each into its own copy. padding
+    // it once keeps the ROM shared, which lockstep relies on
+    if (game_rom && game_rom->size() < CARTRIDGE_MAX_ROM_SIZE)
+    {
+        game_rom = cartridge_make_image(*game_rom);
+    }
+
+    for (size_t worker = 0; worker < shares.size(); worker++)
+    {
+        arenas.push_back(std::make_unique<Arena>(pages));
+    }
+
+    if (pinned)
+    {
+        std::vector<std::pair<int, int>> placement = CpuTopology::detect().place(shares.size());
+
+        for (size_t worker = 0; worker < shares.size(); worker++)
+        {
+            shares[worker].node = placement[worker].first;
+            shares[worker].cpu = placement[worker].second;
+        }
+    }
+
+    for (size_t worker = 0; worker < shares.size(); worker++)
+    {
+        shares[worker].first = num_lanes * worker / shares.size();
+        shares[worker].last = num_lanes * (worker + 1) / shares.size();
+    }
+
+    size_t first_thread = pinned ? 0 : 1;
+
+    if (!pinned)
+    {
+        build_lanes(0);
+    }
+
+    // the workers construct their own lanes before waiting for the first frame
+    workers_busy = shares.size() - first_thread;
+    workers.reserve(workers_busy);
+
+    for (size_t worker = first_thread; worker < shares.size(); worker++)
+    {
+        workers.emplace_back(&GameboyBatch::worker_loop, this, worker);
+    }
+
+    std::unique_lock<std::mutex> lock(mutex);
+    done_cv.wait(lock, [this] { return workers_busy == 0; });
+}
+
+GameboyBatch::~GameboyBatch()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+
+    start_cv.notify_all();
+
+    for (auto &worker : workers)
+    {
+        worker.join();
+    }
+}
+
+void GameboyBatch::build_lanes(size_t worker)
+{
+    // all lanes share one copy of the ROM. if it couldn't be loaded, every
+    // lane carries GB_FAULT_ROM_LOAD and is quarantined on the first frame
+    Arena &arena = *arenas[worker];
+
+    for (size_t i = shares[worker].first; i < shares[worker].last; i++)
+    {
+        // the object (framebuffers, tile cache) followed by its address space,
+        // kept within one huge page where they fit
+        arena.keep_together(sizeof(Gameboy) + MMU_ADDRESSABLE_MEM + 2 * alignof(std::max_align_t));
+        void *slot = arena.allocate(sizeof(Gameboy), alignof(Gameboy));
+        lanes[i].reset(new (slot) Gameboy(game_rom, "", &arena));
+    }
+}
+
+void GameboyBatch::run_frame()
+{
+    frame_count++;
+
+    // the mutex below publishes the reset cursors to the workers
+    for (BatchShare &share : shares)
+    {
+        share.next.store(share.first, std::memory_order_relaxed);
+    }
+
+    if (workers.empty())
+    {
+        run_lanes(0);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        generation++;
+        workers_busy = workers.size();
+    }
+
+    start_cv.notify_all();
+
+    if (!pinned)
+    {
+        run_lanes(0);
+    }
+
+    std::unique_lock<std::mutex> lock(mutex);
+    done_cv.wait(lock, [this] { return workers_busy == 0; });
+}
+
+void GameboyBatch::run_lanes(size_t worker)
+{
+    run_share(worker);
+
+    // lanes that idle-skip or quarantine finish early, help out the workers
+    // whose lanes don't. only on this node, lanes on other nodes would be
+    // run from remote memory
+    for (size_t offset = 1; offset < shares.size(); offset++)
+    {
+        size_t other = (worker + offset) % shares.size();
+
+        if (shares[other].node == shares[worker].node)
+        {
+            run_share(other);
+        }
+    }
+}
+
+void GameboyBatch::run_share(size_t share)
+{
+    BatchShare &work = shares[share];
+    size_t claim = lockstep ? LOCKSTEP_LANES : 1;
+    size_t first;
+
+    // lanes are stepped one whole frame at a time instead of interleaving them
+    // per instruction, so each lane's memory stays in cache while it runs.
+    // in lockstep a group of lanes interleaves, they share the instruction
+    // stream instead
+    while ((first = work.next.fetch_add(claim, std::memory_order_relaxed)) < work.last)
+    {
+        size_t last = std::min(first + claim, work.last);
+
+        if (lockstep)
+        {
+            run_group(first, last);
+            continue;
+        }
+
+        if (quarantined[first])
+        {
+            continue;
+        }
+
+        finish_lane(first, lanes[first]->run_frame());
+    }
+}
+
+void GameboyBatch::run_group(size_t first, size_t last)
+{
+    Gameboy *group[LOCKSTEP_LANES]{};
+    size_t count = 0;
+
+    for (size_t i = first; i < last; i++)
+    {
+        if (!quarantined[i])
+        {
+            group[count++] = lanes[i].get();
+        }
+    }
+
+    LockstepGroup(group, count).run_frame();
+
+    for (size_t i = first; i < last; i++)
+    {
+        if (!quarantined[i])
+        {
+            finish_lane(i, lanes[i]->fault);
+        }
+    }
+}
+
+void GameboyBatch::finish_lane(size_t i, GameboyFault fault)
+{
+    if (gb_fault_fatal(fault))
+    {
+        quarantined[i] = true;
+    }
+
+    if (ram_plan)
+    {
+        ram_plan->evaluate(lanes[i]->mmu, ram_values + i, lanes.size());
+    }
+
+    if (capture)
+    {
+        capture->submit(lanes[i]->ppu, frame_count, static_cast<uint32_t>(i));
+    }
+}
+
+size_t GameboyBatch::num_quarantined() const
+{
+    return std::count(quarantined.begin(), quarantined.end(), true);
+}
+
+ArenaPages GameboyBatch::page_backing() const
+{
+    ArenaPages weakest = ARENA_PAGES_EXPLICIT;
+
+    for (const auto &arena : arenas)
+    {
+        if (!arena->chunks.empty())
+        {
+            weakest = std::min(weakest, arena->backing);
+        }
+    }
+
+    return weakest;
+}
+
+void GameboyBatch::release(size_t lane)
+{
+    quarantined[lane] = false;
+}
+
+void GameboyBatch::set_ram_plan(const RamPlan *plan, float *values)
+{
+    ram_plan = plan;
+    ram_values = values;
+
+    for (size_t i = 0; plan && i < lanes.size(); i++)
+    {
+        plan->evaluate(lanes[i]->mmu, values + i, lanes.size());
+    }
+}
+
+void GameboyBatch::finish_work()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    if (--workers_busy == 0)
+    {
+        done_cv.notify_one();
+    }
+}
+
+void GameboyBatch::worker_loop(size_t worker)
+{
+    // pinned before constructing, so the lanes are allocated on this node
+    if (shares[worker].cpu >= 0)
+    {
+        pin_current_thread(shares[worker].cpu);
+    }
+
+    build_lanes(worker);
+    finish_work();
+
+    uint64_t seen_generation = 0;
+
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            start_cv.wait(lock, [&] { return stopping || generation != seen_generation; });
+
+            if (stopping)
+            {
+                return;
+            }
+
+            seen_generation = generation;
+        }
+
+        run_lanes(worker);
+        finish_work();
+    }
+}
+
+void GameboyBatch::link_pairs()
+{
+    cables.clear();
+
+    for (size_t i = 0; i + 1 < lanes.size(); i += 2)
+    {
+        cables.push_back(std::make_unique<LinkCable>());
+        cables.back()->connect(lanes[i]->mmu.serial, lanes[i + 1]->mmu.serial);
+    }
+}
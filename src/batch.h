@@ -0,0 +1,111 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "arena.h"
+#include "framepipe.h"
+#include "gameboy.h"
+#include "lockstep.h"
+#include "ramspec.h"
+
+// runs many instances of the same ROM in lockstep, one frame at a time
+
+// a worker's contiguous share of the lanes. the worker constructs them, so
+// their memory is first touched on its NUMA node, and runs them every frame.
+// a worker that finishes early steals lanes from other shares on its own
+// node only. aligned so the cursors of different workers don't share a line
+struct alignas(64) BatchShare
+{
+    std::atomic<size_t> next{0}; // first lane of the share not yet claimed this frame
+    size_t first = 0;            // lanes [first, last)
+    size_t last = 0;
+    int node = 0;                // NUMA node of the worker
+    int cpu = -1;                // CPU the worker is pinned to, -1 if it isn't
+};
+
+// lanes are constructed in their worker's arena, which frees the memory
+struct LaneDelete
+{
+    void operator()(Gameboy *gb) const { gb->~Gameboy(); }
+};
+
+struct GameboyBatch
+{
+    RomImage game_rom;                                       // shared by all lanes
+    std::vector<std::unique_ptr<Arena>> arenas;              // one per worker, outlive the lanes
+    std::vector<std::unique_ptr<Gameboy, LaneDelete>> lanes; // one emulator instance per lane
+    std::vector<std::unique_ptr<LinkCable>> cables; // set up by link_pairs()
+
+    // lanes that hit a fatal fault (gb_fault_fatal()) are skipped until
+    // release() is called, the reason stays in the lane's Gameboy::fault.
+    // written by the worker that ran the lane this frame
+    std::vector<uint8_t> quarantined;
+
+    // RAM fields gathered by each worker right after its lane's frame, while
+    // the lane is still in cache. ram_values is (fields, lanes), owned by the caller
+    const RamPlan *ram_plan = nullptr;
+    float *ram_values = nullptr;
+
+    // finished frames of every lane are submitted here by the workers, with
+    // the lane as source and frame_count as the frame number. null: no capture
+    FramePipeline *capture = nullptr;
+    uint64_t frame_count = 0; // frames run so far, counts the current one while it runs
+
+    // workers claim LOCKSTEP_LANES lanes at a time and run them as a
+    // LockstepGroup, which vectorises the instructions they have in common.
+    // off by default, it's slower than the scalar core (see src/lockstep.h)
+    bool lockstep = false;
+
+    // worker threads. unpinned, the calling thread acts as worker 0. pinned,
+    // every worker has its own thread, so the caller's affinity is left alone
+    bool pinned;
+    std::vector<BatchShare> shares; // one per worker
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable start_cv; // signals workers that a new frame started
+    std::condition_variable done_cv;  // signals run_frame() that all workers finished
+    uint64_t generation;              // incremented for every frame run on the workers
+    size_t workers_busy;              // workers that haven't finished the current frame or construction
+    bool stopping;                    // set by the destructor to shut down the workers
+
+    // pin_threads places workers on the CPUs of each NUMA node in proportion
+    // to their count (see CpuTopology) and pins them there. pages selects
+    // the backing of the arenas the lanes are allocated in
+    GameboyBatch(const std::string &game_rom_filename, size_t num_lanes, size_t num_threads = 1,
+                 bool pin_threads = false, ArenaPages pages = ARENA_PAGES_TRANSPARENT);
+    GameboyBatch(RomImage game_rom, size_t num_lanes, size_t num_threads = 1, bool pin_threads = false,
+                 ArenaPages pages = ARENA_PAGES_TRANSPARENT);
+    ~GameboyBatch();
+
+    GameboyBatch(const GameboyBatch &) = delete;
+    GameboyBatch &operator=(const GameboyBatch &) = delete;
+
+    void run_frame(); // advance every lane by one frame
+    size_t num_quarantined() const;
+    ArenaPages page_backing() const; // the weakest backing any arena got
+    void release(size_t lane); // let a lane run again, after loading a state into it
+
+    // evaluate plan into values after every frame, null stops it. also fills
+    // values right away, so they describe the current state of every lane
+    void set_ram_plan(const RamPlan *plan, float *values);
+
+    // connect lanes 0-1, 2-3, ... with link cables for two-player runs. a
+    // pair falls into the same worker's share when the lanes per worker are even
+    void link_pairs();
+
+    void build_lanes(size_t worker); // construct the lanes of this worker's share, on its thread
+    void run_lanes(size_t worker);   // run this worker's share, then help others on its node
+    void run_share(size_t share);    // claim and run lanes of a share until none are left
+    void run_group(size_t first, size_t last); // lanes [first, last) as one LockstepGroup
+    // quarantine, gather RAM and capture after a lane's frame
+    void finish_lane(size_t i, GameboyFault fault);
+    void finish_work();              // a worker thread is done with the current frame or construction
+    void worker_loop(size_t worker); // body of the worker threads
+};
@@ -0,0 +1,259 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "gameboy.h"
+#include "lockstep.h"
+
+// runs the benchmark workload from a manifest and reports the speed per ROM,
+// also the training run of the PGO build (make pgo)
+//
+//   gameboy_bench <manifest> [lanes]
+//
+// every manifest line is "<rom_file> <frames> <hash>", # starts a comment.
+// hash pins the exact ROM image (cartridge_hash, as printed in the output).
+// the run fails on a mismatch, and on "-" after printing the hash to pin,
+// so results can't silently come from a different ROM. inputs come from a
+// fixed schedule and each run ends by
+// printing a hash of the final state, so two builds ran the same workload iff
+// their state hashes agree
+//
+// output, one line per ROM and a total:
+//   <rom_file> <frames> <seconds> <fps> <rom_hash> <state_hash>
+//   total <frames> <seconds> <fps>
+//
+// with lanes, each ROM runs as that many instances for frames / lanes
+// frames, once one instance after the other and once in LockstepGroups (see
+// src/lockstep.h). lane i gets the input schedule i frames ahead, so the
+// lanes drift apart like independent environments do. both runs have to end
+// with every lane in the same state, then they executed the same
+// instructions and their aggregate speed compares directly:
+//   <rom_file> <lanes> <scalar_mips> <lockstep_mips> <vectorised_percent>
+//   total <lanes> <scalar_mips> <lockstep_mips>
+
+struct BenchEntry
+{
+    std::string rom_filename;
+    uint64_t frames;
+    std::string hash; // hex, "-" until it's pinned
+};
+
+static bool load_manifest(const std::string &filename, std::vector<BenchEntry> &entries)
+{
+    std::ifstream file(filename);
+
+    if (!file)
+    {
+        std::cerr << "Failed to open benchmark manifest: " << filename << std::endl;
+        return false;
+    }
+
+    std::string line;
+
+    while (std::getline(file, line))
+    {
+        line = line.substr(0, line.find('#'));
+        std::istringstream fields(line);
+        BenchEntry entry;
+
+        if (!(fields >> entry.rom_filename))
+        {
+            continue; // blank or comment
+        }
+
+        if (!(fields >> entry.frames >> entry.hash))
+        {
+            std::cerr << "Malformed benchmark manifest line: " << line << std::endl;
+            return false;
+        }
+
+        entries.push_back(entry);
+    }
+
+    return true;
+}
+
+// buttons for a frame: every 32 frames one of the 8 buttons is held for 8 frames
+static uint8_t scheduled_buttons(uint64_t frame)
+{
+    return (frame % 32) < 8 ? 1 << ((frame / 32) % 8) : 0;
+}
+
+struct LaneRun
+{
+    double seconds;
+    uint64_t vector_instructions; // lockstep only
+    uint64_t scalar_instructions; // lockstep only
+    std::vector<uint64_t> state_hashes; // of every lane at the end
+};
+
+static LaneRun run_lanes(const RomImage &image, size_t num_lanes, uint64_t frames, bool lockstep)
+{
+    std::vector<std::unique_ptr<Gameboy>> lanes;
+    std::vector<Gameboy *> pointers;
+
+    for (size_t i = 0; i < num_lanes; i++)
+    {
+        lanes.push_back(std::make_unique<Gameboy>(image));
+        pointers.push_back(lanes.back().get());
+    }
+
+    LaneRun run{};
+    auto start = std::chrono::steady_clock::now();
+
+    for (uint64_t frame = 0; frame < frames; frame++)
+    {
+        for (size_t i = 0; i < num_lanes; i++)
+        {
+            lanes[i]->mmu.set_buttons(scheduled_buttons(frame + i));
+        }
+
+        if (!lockstep)
+        {
+            for (auto &lane : lanes)
+            {
+                lane->run_frame();
+            }
+
+            continue;
+        }
+
+        for (size_t first = 0; first < num_lanes; first += LOCKSTEP_LANES)
+        {
+            LockstepGroup group(&pointers[first], std::min(LOCKSTEP_LANES, num_lanes - first));
+            group.run_frame();
+            run.vector_instructions += group.vector_instructions;
+            run.scalar_instructions += group.scalar_instructions;
+        }
+    }
+
+    run.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    for (auto &lane : lanes)
+    {
+        std::vector<uint8_t> state = lane->save_state();
+        run.state_hashes.push_back(cartridge_hash(state.data(), state.size()));
+    }
+
+    return run;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2 || argc > 3)
+    {
+        std::cerr << "Usage: " << argv[0] << " <manifest> [lanes]" << std::endl;
+        return 1;
+    }
+
+    size_t num_lanes = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 0;
+
+    std::vector<BenchEntry> entries;
+
+    if (!load_manifest(argv[1], entries))
+    {
+        return 1;
+    }
+
+    uint64_t total_frames = 0;
+    double total_seconds = 0;
+    uint64_t total_instructions = 0;
+    double total_scalar_seconds = 0;
+
+    for (const BenchEntry &entry : entries)
+    {
+        RomImage image = cartridge_load_image(entry.rom_filename);
+
+        if (!image)
+        {
+            std::cerr << "Failed to open game ROM file: " << entry.rom_filename << std::endl;
+            return 1;
+        }
+
+        char rom_hash[17];
+        std::snprintf(rom_hash, sizeof(rom_hash), "%016llx",
+                      static_cast<unsigned long long>(cartridge_hash(image->data(), image->size())));
+
+        if (entry.hash == "-")
+        {
+            std::cerr << entry.rom_filename << ": not pinned, put its hash " << rom_hash << " in the manifest"
+                      << std::endl;
+            return 1;
+        }
+
+        if (entry.hash != rom_hash)
+        {
+            std::cerr << entry.rom_filename << ": hash " << rom_hash << " doesn't match the manifest" << std::endl;
+            return 1;
+        }
+
+        if (num_lanes)
+        {
+            uint64_t frames = std::max<uint64_t>(entry.frames / num_lanes, 1);
+            LaneRun scalar = run_lanes(image, num_lanes, frames, false);
+            LaneRun lockstep = run_lanes(image, num_lanes, frames, true);
+
+            if (scalar.state_hashes != lockstep.state_hashes)
+            {
+                std::cerr << entry.rom_filename << ": lockstep lanes ended in different states" << std::endl;
+                return 1;
+            }
+
+            uint64_t instructions = lockstep.vector_instructions + lockstep.scalar_instructions;
+
+            std::printf("%s %zu %.2f %.2f %.1f\n", entry.rom_filename.c_str(), num_lanes,
+                        instructions / scalar.seconds / 1e6, instructions / lockstep.seconds / 1e6,
+                        100.0 * lockstep.vector_instructions / std::max<uint64_t>(instructions, 1));
+
+            total_instructions += instructions;
+            total_scalar_seconds += scalar.seconds;
+            total_seconds += lockstep.seconds;
+            continue;
+        }
+
+        Gameboy gb(image);
+
+        if (gb.fault == GB_FAULT_ROM_LOAD)
+        {
+            std::cerr << entry.rom_filename << ": " << gb.load_error << std::endl;
+            return 1;
+        }
+
+        auto start = std::chrono::steady_clock::now();
+
+        for (uint64_t frame = 0; frame < entry.frames; frame++)
+        {
+            gb.mmu.set_buttons(scheduled_buttons(frame));
+            gb.run_frame();
+        }
+
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::vector<uint8_t> state = gb.save_state();
+
+        std::printf("%s %llu %.3f %.1f %s %016llx\n", entry.rom_filename.c_str(),
+                    static_cast<unsigned long long>(entry.frames), seconds, entry.frames / seconds, rom_hash,
+                    static_cast<unsigned long long>(cartridge_hash(state.data(), state.size())));
+
+        total_frames += entry.frames;
+        total_seconds += seconds;
+    }
+
+    if (num_lanes)
+    {
+        std::printf("total %zu %.2f %.2f\n", num_lanes, total_instructions / total_scalar_seconds / 1e6,
+                    total_instructions / total_seconds / 1e6);
+        return 0;
+    }
+
+    std::printf("total %llu %.3f %.1f\n", static_cast<unsigned long long>(total_frames), total_seconds,
+                total_frames / total_seconds);
+
+    return 0;
+}
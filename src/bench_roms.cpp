@@ -0,0 +1,177 @@
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <initializer_list>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "cartridge.h"
+
+// writes the ROMs of the default benchmark workload (bench/roms.txt)
+//
+//   gameboy_bench_roms <directory>
+//
+// they're generated rather than checked in, and byte for byte the same on
+// every run, so the manifest pins their hashes like any other ROM. each one
+// loops forever on the fast paths real games spend their time in, using
+// only opcodes the core implements:
+//   alu.gb   register arithmetic, logic and rotates with lazy flags
+//   lcd.gb   LY polling, and rewriting half the tile data every frame so
+//            the PPU renders, repacks and marks changed lines
+//   mem.gb   WRAM copies through (DE) and (HL+), with CALL/RET and PUSH/POP
+
+constexpr uint16_t BENCH_ROM_CODE = CARTRIDGE_HEADER_END; // 0x100 jumps here
+
+// a tiny assembler, just enough to place code and resolve backward jumps
+struct BenchRomCode
+{
+    std::vector<uint8_t> bytes;
+
+    uint16_t here() const { return BENCH_ROM_CODE + bytes.size(); }
+
+    void emit(std::initializer_list<uint8_t> code) { bytes.insert(bytes.end(), code); }
+
+    void emit16(uint8_t opcode, uint16_t value) { emit({opcode, uint8_t(value & 0xFF), uint8_t(value >> 8)}); }
+
+    void jr(uint8_t opcode, uint16_t target) { emit({opcode, uint8_t(target - (here() + 2))}); }
+};
+
+static std::vector<uint8_t> bench_rom(const char *title, const BenchRomCode &code)
+{
+    std::vector<uint8_t> rom(CARTRIDGE_MAX_ROM_SIZE, 0);
+
+    rom[0x101] = 0xC3; // JP BENCH_ROM_CODE
+    rom[0x102] = BENCH_ROM_CODE & 0xFF;
+    rom[0x103] = BENCH_ROM_CODE >> 8;
+
+    for (size_t i = 0; title[i] && i < 16; i++)
+    {
+        rom[0x134 + i] = title[i];
+    }
+
+    std::copy(code.bytes.begin(), code.bytes.end(), rom.begin() + BENCH_ROM_CODE);
+    return rom;
+}
+
+static std::vector<uint8_t> alu_rom()
+{
+    BenchRomCode code;
+    code.emit16(0x31, 0xFFFE);                     // LD SP,0xFFFE
+    code.emit({0x3E, 0x01, 0x06, 0x03, 0x0E, 0x05}); // LD A,1; LD B,3; LD C,5
+
+    uint16_t loop = code.here();
+    code.emit({0x87, 0xCE, 0x07, 0x90, 0xDE, 0x02}); // ADD A,A; ADC A,7; SUB A,B; SBC A,2
+    code.emit({0x04, 0x0D, 0xA9, 0xB0});             // INC B; DEC C; XOR C; OR B
+    code.emit({0xE6, 0x7F, 0xFE, 0x10, 0x17, 0x2F}); // AND 0x7F; CP 0x10; RLA; CPL
+    code.emit({0x47, 0x79, 0x4F});                   // LD B,A; LD A,C; LD C,A
+    code.emit16(0xC3, loop);                         // JP loop
+
+    return bench_rom("BENCH ALU", code);
+}
+
+static std::vector<uint8_t> lcd_rom()
+{
+    BenchRomCode code;
+    code.emit16(0x31, 0xFFFE); // LD SP,0xFFFE
+
+    // tile map 0x9800 - 0x9BFF shows tiles 0 - 255 in turn
+    code.emit16(0x21, 0x9800);   // LD HL,0x9800
+    code.emit({0x06, 0x04});     // LD B,4
+    uint16_t map_outer = code.here();
+    code.emit({0x0E, 0x00});     // LD C,0
+    uint16_t map_inner = code.here();
+    code.emit({0x7D, 0x22, 0x0D}); // LD A,L; LD (HL+),A; DEC C
+    code.jr(0x20, map_inner);      // JR NZ,map_inner
+    code.emit({0x05});             // DEC B
+    code.jr(0x20, map_outer);      // JR NZ,map_outer
+
+    code.emit({0x3E, 0xE4, 0xE0, 0x47}); // LD A,0xE4; LDH (BGP),A
+    code.emit({0x3E, 0x91, 0xE0, 0x40}); // LD A,0x91; LDH (LCDC),A, LCD and BG on, tiles at 0x8000
+
+    uint16_t frame = code.here();
+    code.emit({0xF0, 0x44, 0xFE, 0x90}); // LDH A,(LY); CP 144
+    code.jr(0x20, frame);                // JR NZ,frame, wait for VBlank
+
+    // tiles 0 - 127 get a pattern that shifts by one every frame
+    code.emit({0x1C});             // INC E
+    code.emit16(0x21, 0x8000);     // LD HL,0x8000
+    code.emit({0x06, 0x08});       // LD B,8
+    uint16_t tile_outer = code.here();
+    code.emit({0x0E, 0x00});       // LD C,0
+    uint16_t tile_inner = code.here();
+    code.emit({0x7B, 0x22, 0x1C, 0x0D}); // LD A,E; LD (HL+),A; INC E; DEC C
+    code.jr(0x20, tile_inner);           // JR NZ,tile_inner
+    code.emit({0x05});                   // DEC B
+    code.jr(0x20, tile_outer);           // JR NZ,tile_outer
+
+    uint16_t leave = code.here();
+    code.emit({0xF0, 0x44, 0xFE, 0x90}); // LDH A,(LY); CP 144
+    code.jr(0x28, leave);                // JR Z,leave, once per frame
+    code.emit16(0xC3, frame);            // JP frame
+
+    return bench_rom("BENCH LCD", code);
+}
+
+static std::vector<uint8_t> mem_rom()
+{
+    BenchRomCode code;
+    code.emit16(0x31, 0xFFFE); // LD SP,0xFFFE
+    code.emit16(0xC3, 0);      // JP loop, patched below
+
+    uint16_t sub = code.here();
+    code.emit({0xC5, 0xE5, 0xE1, 0xC1, 0xC9}); // PUSH BC; PUSH HL; POP HL; POP BC; RET
+
+    uint16_t loop = code.here();
+    code.bytes[4] = loop & 0xFF;
+    code.bytes[5] = loop >> 8;
+
+    // 4KB from 0xC000 to 0xD000, complemented
+    code.emit16(0x11, 0xC000); // LD DE,0xC000
+    code.emit16(0x21, 0xD000); // LD HL,0xD000
+    code.emit({0x06, 0x10});   // LD B,16
+    uint16_t outer = code.here();
+    code.emit({0x0E, 0x00});   // LD C,0
+    uint16_t inner = code.here();
+    code.emit({0x1A, 0x2F, 0x22, 0x13}); // LD A,(DE); CPL; LD (HL+),A; INC DE
+    code.emit16(0xCD, sub);              // CALL sub
+    code.emit({0x0D});                   // DEC C
+    code.jr(0x20, inner);                // JR NZ,inner
+    code.emit({0x05});                   // DEC B
+    code.jr(0x20, outer);                // JR NZ,outer
+    code.emit16(0xC3, loop);             // JP loop
+
+    return bench_rom("BENCH MEM", code);
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc != 2)
+    {
+        std::cerr << "Usage: " << argv[0] << " <directory>" << std::endl;
+        return 1;
+    }
+
+    struct
+    {
+        const char *filename;
+        std::vector<uint8_t> rom;
+    } roms[] = {{"alu.gb", alu_rom()}, {"lcd.gb", lcd_rom()}, {"mem.gb", mem_rom()}};
+
+    for (const auto &entry : roms)
+    {
+        std::string path = std::string(argv[1]) + "/" + entry.filename;
+        std::ofstream file(path, std::ios::binary);
+
+        if (!file.write(reinterpret_cast<const char *>(entry.rom.data()), entry.rom.size()))
+        {
+            std::cerr << "Failed to write " << path << std::endl;
+            return 1;
+        }
+
+        std::printf("%s %016llx\n", path.c_str(),
+                    static_cast<unsigned long long>(cartridge_hash(entry.rom.data(), entry.rom.size())));
+    }
+
+    return 0;
+}
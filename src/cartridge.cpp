@@ -0,0 +1,116 @@
+#include "cartridge.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+bool CartridgeHeader::has_battery() const
+{
+    switch (type)
+    {
+    case 0x03: // MBC1+RAM+BATTERY
+    case 0x06: // MBC2+BATTERY
+    case 0x09: // ROM+RAM+BATTERY
+    case 0x0D: // MMM01+RAM+BATTERY
+    case 0x0F: // MBC3+TIMER+BATTERY
+    case 0x10: // MBC3+TIMER+RAM+BATTERY
+    case 0x13: // MBC3+RAM+BATTERY
+    case 0x1B: // MBC5+RAM+BATTERY
+    case 0x1E: // MBC5+RUMBLE+RAM+BATTERY
+    case 0x22: // MBC7+SENSOR+RUMBLE+RAM+BATTERY
+    case 0xFF: // HuC1+RAM+BATTERY
+        return true;
+    default:
+        return false;
+    }
+}
+
+size_t CartridgeHeader::ram_size() const
+{
+    switch (ram_size_code)
+    {
+    case 0x02:
+        return 0x2000; // 8KB
+    case 0x03:
+        return 0x8000; // 32KB
+    case 0x04:
+        return 0x20000; // 128KB
+    case 0x05:
+        return 0x10000; // 64KB
+    default:
+        return 0;
+    }
+}
+
+bool cartridge_parse_header(const uint8_t *data, size_t size, CartridgeHeader &header)
+{
+    if (size < CARTRIDGE_HEADER_END)
+    {
+        return false;
+    }
+
+    header.cgb_flag = data[0x0143];
+    header.type = data[0x0147];
+    header.rom_size_code = data[0x0148];
+    header.ram_size_code = data[0x0149];
+    header.header_checksum = data[0x014D];
+    header.global_checksum = (data[0x014E] << 8) | data[0x014F];
+
+    // CGB titles are shorter, the last byte holds the CGB flag instead
+    size_t title_length = header.cgb() ? 15 : 16;
+    std::memset(header.title, 0, sizeof(header.title));
+
+    for (size_t i = 0; i < title_length && data[0x0134 + i]; i++)
+    {
+        char c = static_cast<char>(data[0x0134 + i]);
+        header.title[i] = (c >= 0x20 && c < 0x7F) ? c : '?';
+    }
+
+    uint8_t checksum = 0;
+
+    for (size_t address = 0x0134; address <= 0x014C; address++)
+    {
+        checksum = checksum - data[address] - 1;
+    }
+
+    header.header_checksum_ok = checksum == header.header_checksum;
+
+    return true;
+}
+
+uint64_t cartridge_hash(const uint8_t *data, size_t size)
+{
+    uint64_t hash = 0xCBF29CE484222325; // FNV-1a
+
+    for (size_t i = 0; i < size; i++)
+    {
+        hash = (hash ^ data[i]) * 0x100000001B3;
+    }
+
+    return hash;
+}
+
+RomImage cartridge_make_image(std::vector<uint8_t> bytes)
+{
+    if (bytes.size() < CARTRIDGE_MAX_ROM_SIZE)
+    {
+        bytes.resize(CARTRIDGE_MAX_ROM_SIZE, 0);
+    }
+
+    return std::make_shared<const std::vector<uint8_t>>(std::move(bytes));
+}
+
+RomImage cartridge_load_image(const std::string &filename)
+{
+    std::ifstream file(filename, std::ios::binary);
+
+    if (!file)
+    {
+        return nullptr;
+    }
+
+    std::vector<uint8_t> buffer(std::istreambuf_iterator<char>(file), {});
+
+    return cartridge_make_image(std::move(buffer));
+}
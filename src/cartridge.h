@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+constexpr size_t CARTRIDGE_HEADER_END = 0x0150;   // the header spans 0x0100 - 0x014F
+constexpr size_t CARTRIDGE_MAX_ROM_SIZE = 0x8000; // 32KB, MBC banking isn't emulated yet
+
+// ROM images are immutable and shared by every instance running them,
+// they're padded to at least CARTRIDGE_MAX_ROM_SIZE so they fill the ROM pages
+using RomImage = std::shared_ptr<const std::vector<uint8_t>>;
+
+// cartridge header fields, from https://gbdev.io/pandocs/The_Cartridge_Header.html
+
+struct CartridgeHeader
+{
+    char title[17];           // 0x0134 - 0x0143, zero-terminated
+    uint8_t cgb_flag;         // 0x0143, 0x80: CGB enhanced, 0xC0: CGB only
+    uint8_t type;             // 0x0147, MBC and extra hardware
+    uint8_t rom_size_code;    // 0x0148, ROM size is 32KB << code
+    uint8_t ram_size_code;    // 0x0149
+    uint8_t header_checksum;  // 0x014D
+    uint16_t global_checksum; // 0x014E - 0x014F, big endian
+    bool header_checksum_ok;  // header_checksum matches bytes 0x0134 - 0x014C
+
+    bool cgb() const { return cgb_flag & 0x80; }
+    bool has_battery() const; // cartridge RAM is kept powered
+    size_t rom_size() const { return CARTRIDGE_MAX_ROM_SIZE << rom_size_code; }
+    size_t ram_size() const;
+};
+
+bool cartridge_parse_header(const uint8_t *data, size_t size, CartridgeHeader &header); // false if too small
+uint64_t cartridge_hash(const uint8_t *data, size_t size);                              // FNV-1a content hash
+
+RomImage cartridge_make_image(std::vector<uint8_t> bytes); // pad and wrap raw ROM bytes
+RomImage cartridge_load_image(const std::string &filename); // null if the file can't be read, doesn't print
@@ -0,0 +1,317 @@
+#include "corpus.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <unordered_set>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// index file layout, host endian:
+//   CorpusIndexHeader
+//   CorpusRecord[entry_count]
+//   path string table, paths aren't zero-terminated
+
+struct CorpusIndexHeader
+{
+    char magic[4];          // "GBCI"
+    uint32_t version;       // CORPUS_INDEX_VERSION
+    uint32_t entry_count;
+    uint32_t strings_size;  // bytes
+};
+
+struct CorpusRecord
+{
+    uint64_t hash;
+    uint64_t file_size;
+    uint32_t path_offset;   // into the string table
+    uint32_t path_length;
+    char title[16];
+    uint8_t cgb_flag;
+    uint8_t type;
+    uint8_t rom_size_code;
+    uint8_t ram_size_code;
+    uint8_t header_checksum;
+    uint8_t header_checksum_ok;
+    uint16_t global_checksum;
+};
+
+static_assert(sizeof(CorpusIndexHeader) == 16);
+static_assert(sizeof(CorpusRecord) == 48);
+
+bool CorpusEntry::supported() const
+{
+    if (!header.header_checksum_ok || file_size > CARTRIDGE_MAX_ROM_SIZE)
+    {
+        return false;
+    }
+
+    switch (header.type)
+    {
+    case 0x00: // ROM ONLY
+    case 0x08: // ROM+RAM
+    case 0x09: // ROM+RAM+BATTERY
+        return true;
+    default:
+        return false;
+    }
+}
+
+static bool is_rom_filename(const std::filesystem::path &path)
+{
+    std::string extension = path.extension().string();
+    std::transform(extension.begin(), extension.end(), extension.begin(),
+                   [](unsigned char c) { return std::tolower(c); });
+
+    return extension == ".gb" || extension == ".gbc";
+}
+
+// parses and hashes one file without copying it, false if it isn't a ROM
+static bool scan_file(const std::string &filename, CorpusEntry &entry)
+{
+#ifndef _WIN32
+    int fd = ::open(filename.c_str(), O_RDONLY);
+
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    struct stat info;
+
+    if (fstat(fd, &info) != 0 || static_cast<size_t>(info.st_size) < CARTRIDGE_HEADER_END)
+    {
+        ::close(fd);
+        return false;
+    }
+
+    size_t size = info.st_size;
+    void *mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+
+    if (mapping == MAP_FAILED)
+    {
+        return false;
+    }
+
+    madvise(mapping, size, MADV_SEQUENTIAL);
+
+    const uint8_t *data = static_cast<const uint8_t *>(mapping);
+    cartridge_parse_header(data, size, entry.header);
+    entry.hash = cartridge_hash(data, size);
+    entry.file_size = size;
+
+    munmap(mapping, size);
+#else
+    std::ifstream file(filename, std::ios::binary);
+    std::vector<uint8_t> data(std::istreambuf_iterator<char>(file), {});
+
+    if (!cartridge_parse_header(data.data(), data.size(), entry.header))
+    {
+        return false;
+    }
+
+    entry.hash = cartridge_hash(data.data(), data.size());
+    entry.file_size = data.size();
+#endif
+
+    entry.path = filename;
+
+    return true;
+}
+
+size_t Corpus::scan(const std::string &directory)
+{
+    size_t added = 0;
+    std::error_code error;
+
+    auto options = std::filesystem::directory_options::skip_permission_denied;
+    std::filesystem::recursive_directory_iterator it(directory, options, error), end;
+
+    if (error)
+    {
+        std::cerr << "Failed to scan ROM directory: " << directory << std::endl;
+        return 0;
+    }
+
+    for (; it != end; it.increment(error))
+    {
+        if (error)
+        {
+            break;
+        }
+
+        if (!it->is_regular_file(error) || !is_rom_filename(it->path()))
+        {
+            continue;
+        }
+
+        CorpusEntry entry;
+
+        if (scan_file(it->path().string(), entry))
+        {
+            entries.push_back(std::move(entry));
+            added++;
+        }
+    }
+
+    return added;
+}
+
+bool Corpus::save(const std::string &index_filename) const
+{
+    std::vector<CorpusRecord> records(entries.size());
+    std::string strings;
+
+    for (size_t i = 0; i < entries.size(); i++)
+    {
+        const CorpusEntry &entry = entries[i];
+        CorpusRecord &record = records[i];
+
+        record.hash = entry.hash;
+        record.file_size = entry.file_size;
+        record.path_offset = static_cast<uint32_t>(strings.size());
+        record.path_length = static_cast<uint32_t>(entry.path.size());
+        std::memcpy(record.title, entry.header.title, sizeof(record.title));
+        record.cgb_flag = entry.header.cgb_flag;
+        record.type = entry.header.type;
+        record.rom_size_code = entry.header.rom_size_code;
+        record.ram_size_code = entry.header.ram_size_code;
+        record.header_checksum = entry.header.header_checksum;
+        record.header_checksum_ok = entry.header.header_checksum_ok;
+        record.global_checksum = entry.header.global_checksum;
+
+        strings += entry.path;
+    }
+
+    CorpusIndexHeader header = {{'G', 'B', 'C', 'I'}, CORPUS_INDEX_VERSION,
+                                static_cast<uint32_t>(records.size()), static_cast<uint32_t>(strings.size())};
+
+    std::ofstream file(index_filename, std::ios::binary | std::ios::trunc);
+
+    if (!file)
+    {
+        std::cerr << "Failed to write corpus index: " << index_filename << std::endl;
+        return false;
+    }
+
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char *>(records.data()), records.size() * sizeof(CorpusRecord));
+    file.write(strings.data(), strings.size());
+
+    return static_cast<bool>(file);
+}
+
+bool Corpus::load(const std::string &index_filename)
+{
+    std::ifstream file(index_filename, std::ios::binary);
+
+    if (!file)
+    {
+        return false;
+    }
+
+    std::vector<uint8_t> buffer(std::istreambuf_iterator<char>(file), {});
+    CorpusIndexHeader header;
+
+    if (buffer.size() < sizeof(header))
+    {
+        return false;
+    }
+
+    std::memcpy(&header, buffer.data(), sizeof(header));
+
+    size_t records_size = static_cast<size_t>(header.entry_count) * sizeof(CorpusRecord);
+
+    if (std::memcmp(header.magic, "GBCI", 4) != 0 || header.version != CORPUS_INDEX_VERSION ||
+        buffer.size() != sizeof(header) + records_size + header.strings_size)
+    {
+        std::cerr << "Corpus index is corrupt or from another version: " << index_filename << std::endl;
+        return false;
+    }
+
+    const uint8_t *records = buffer.data() + sizeof(header);
+    const char *strings = reinterpret_cast<const char *>(records + records_size);
+    std::vector<CorpusEntry> loaded(header.entry_count);
+
+    for (size_t i = 0; i < loaded.size(); i++)
+    {
+        CorpusRecord record;
+        std::memcpy(&record, records + i * sizeof(CorpusRecord), sizeof(record));
+
+        if (static_cast<uint64_t>(record.path_offset) + record.path_length > header.strings_size)
+        {
+            return false;
+        }
+
+        CorpusEntry &entry = loaded[i];
+        entry.path.assign(strings + record.path_offset, record.path_length);
+        entry.hash = record.hash;
+        entry.file_size = record.file_size;
+        std::memcpy(entry.header.title, record.title, sizeof(record.title));
+        entry.header.title[16] = 0;
+        entry.header.cgb_flag = record.cgb_flag;
+        entry.header.type = record.type;
+        entry.header.rom_size_code = record.rom_size_code;
+        entry.header.ram_size_code = record.ram_size_code;
+        entry.header.header_checksum = record.header_checksum;
+        entry.header.header_checksum_ok = record.header_checksum_ok;
+        entry.header.global_checksum = record.global_checksum;
+    }
+
+    entries = std::move(loaded);
+
+    return true;
+}
+
+size_t Corpus::unique_images() const
+{
+    std::unordered_set<uint64_t> hashes;
+
+    for (const CorpusEntry &entry : entries)
+    {
+        hashes.insert(entry.hash);
+    }
+
+    return hashes.size();
+}
+
+RomImage Corpus::image(const CorpusEntry &entry)
+{
+    std::lock_guard<std::mutex> lock(image_mutex);
+
+    if (RomImage cached = images[entry.hash].lock())
+    {
+        return cached;
+    }
+
+    std::ifstream file(entry.path, std::ios::binary);
+
+    if (!file)
+    {
+        std::cerr << "Failed to open game ROM file: " << entry.path << std::endl;
+        return nullptr;
+    }
+
+    std::vector<uint8_t> bytes(std::istreambuf_iterator<char>(file), {});
+
+    if (bytes.size() != entry.file_size || cartridge_hash(bytes.data(), bytes.size()) != entry.hash)
+    {
+        std::cerr << "Game ROM changed since the corpus was indexed: " << entry.path << std::endl;
+        return nullptr;
+    }
+
+    RomImage image = cartridge_make_image(std::move(bytes));
+    images[entry.hash] = image;
+
+    return image;
+}
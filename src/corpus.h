@@ -0,0 +1,45 @@
+#pragma once
+
+#include "cartridge.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// an indexed directory of ROM files
+//
+// scan() maps every .gb/.gbc file once to parse its header and hash its
+// contents, save()/load() keep the result in a compact binary index so
+// later runs start without touching the ROMs. image() loads ROMs on demand
+// and hands out one shared image per distinct content hash
+
+constexpr uint32_t CORPUS_INDEX_VERSION = 1;
+
+struct CorpusEntry
+{
+    std::string path;      // as found by scan(), relative to its working directory
+    uint64_t hash;         // cartridge_hash() of the whole file
+    uint64_t file_size;    // bytes
+    CartridgeHeader header;
+
+    bool supported() const; // runs on this emulator: valid header, 32KB, no MBC
+};
+
+struct Corpus
+{
+    std::vector<CorpusEntry> entries;
+
+    // loaded images by content hash, expire once no instance uses them
+    std::mutex image_mutex;
+    std::unordered_map<uint64_t, std::weak_ptr<const std::vector<uint8_t>>> images;
+
+    size_t scan(const std::string &directory);     // recursive, returns the number of entries added
+    bool save(const std::string &index_filename) const;
+    bool load(const std::string &index_filename);  // replaces entries, false on a missing or corrupt index
+
+    size_t unique_images() const;      // distinct content hashes
+    RomImage image(const CorpusEntry &entry); // null if the file is gone or changed since the scan
+};
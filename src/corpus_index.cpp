@@ -0,0 +1,61 @@
+#include "corpus.h"
+
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+
+// builds a corpus index from a ROM directory, or lists an existing index
+//
+//   gameboy_corpus <rom_dir> <index_file>
+//   gameboy_corpus <index_file>
+
+int main(int argc, char *argv[])
+{
+    if (argc != 2 && argc != 3)
+    {
+        std::cerr << "Usage: " << argv[0] << " <rom_dir> <index_file> | <index_file>" << std::endl;
+        return 1;
+    }
+
+    Corpus corpus;
+    auto start = std::chrono::steady_clock::now();
+
+    if (argc == 2)
+    {
+        if (!corpus.load(argv[1]))
+        {
+            std::cerr << "Failed to load corpus index: " << argv[1] << std::endl;
+            return 1;
+        }
+
+        for (const CorpusEntry &entry : corpus.entries)
+        {
+            std::printf("%016llx %8llu type %02X cgb %02X %s %-16s %s\n", static_cast<unsigned long long>(entry.hash),
+                        static_cast<unsigned long long>(entry.file_size), entry.header.type, entry.header.cgb_flag,
+                        entry.supported() ? "ok " : "---", entry.header.title, entry.path.c_str());
+        }
+    }
+    else
+    {
+        corpus.scan(argv[1]);
+
+        if (!corpus.save(argv[2]))
+        {
+            return 1;
+        }
+    }
+
+    size_t supported = 0;
+
+    for (const CorpusEntry &entry : corpus.entries)
+    {
+        supported += entry.supported();
+    }
+
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+
+    std::cerr << corpus.entries.size() << " ROMs, " << corpus.unique_images() << " unique, " << supported
+              << " supported, " << elapsed.count() << " ms" << std::endl;
+
+    return 0;
+}
@@ -1,6 +1,6 @@
 #include "cpu.h"
 
-CPU::CPU()
+CPU::CPU(bool cgb)
 {
     // state after boot rom execution
     AF = 0x01B0;
@@ -10,6 +10,49 @@ CPU::CPU()
     SP = 0xFFFE;
     PC = 0x0100;
 
+    if (cgb)
+    {
+        AF = 0x1180;
+        BC = 0x0000;
+        DE = 0xFF56;
+        HL = 0x000D;
+    }
+
     IME = false;
     IME_scheduled = false;
+    speed_shift = 0;
+
+    flag_op = CPU_FLAGS_EAGER;
+    flag_lhs = flag_rhs = flag_result = 0;
+}
+
+void CPU::materialize_flags()
+{
+    uint8_t flags = (AF_bytes.F & CPU_FLAG_C) | ((flag_result == 0) * CPU_FLAG_Z);
+
+    switch (flag_op)
+    {
+    case CPU_FLAGS_ADD:
+        flags |= (((flag_lhs & 0x0F) + (flag_rhs & 0x0F)) > 0x0F) * CPU_FLAG_H; // carry from bit 4
+        break;
+    case CPU_FLAGS_SUB:
+        flags |= CPU_FLAG_N | (((flag_lhs & 0x0F) < (flag_rhs & 0x0F)) * CPU_FLAG_H); // borrow from bit 4
+        break;
+    case CPU_FLAGS_INC:
+        flags |= ((flag_result & 0x0F) == 0) * CPU_FLAG_H; // low nibble overflowed
+        break;
+    case CPU_FLAGS_DEC:
+        flags |= CPU_FLAG_N | (((flag_result & 0x0F) == 0x0F) * CPU_FLAG_H); // borrow from bit 4
+        break;
+    case CPU_FLAGS_ADC:
+        flags |= (((flag_lhs & 0x0F) + (flag_rhs & 0x0F) + 1) > 0x0F) * CPU_FLAG_H; // carry from bit 4, with the carry in
+        break;
+    case CPU_FLAGS_SBC:
+        flags |= CPU_FLAG_N | (((flag_lhs & 0x0F) < (flag_rhs & 0x0F) + 1) * CPU_FLAG_H); // borrow from bit 4, with the carry in
+        break;
+    default:
+        return;
+    }
+
+    set_flags(flags);
 }
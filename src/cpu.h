@@ -8,6 +8,22 @@ constexpr uint8_t CPU_FLAG_N = 1 << 6; // subtract flag
 constexpr uint8_t CPU_FLAG_H = 1 << 5; // half Carry flag
 constexpr uint8_t CPU_FLAG_C = 1 << 4; // carry flag
 
+// flags are evaluated lazily: ALU handlers record their operation and
+// operands, Z/N/H are only computed when F is actually read. C is cheap and
+// read by rotates, so it's always kept up to date in F. compiled with
+// -DGB_EAGER_FLAGS they're computed right away instead, the reference that
+// gameboy_flagcheck and benchmarks compare against
+enum CPUFlagOp : uint8_t
+{
+    CPU_FLAGS_EAGER, // F holds all flags
+    CPU_FLAGS_ADD,   // flag_lhs + flag_rhs, also ADC without carry in
+    CPU_FLAGS_SUB,   // flag_lhs - flag_rhs, also CP and SBC without carry in
+    CPU_FLAGS_INC,   // Z/H from flag_result, N clear
+    CPU_FLAGS_DEC,   // Z/H from flag_result, N set
+    CPU_FLAGS_ADC,   // flag_lhs + flag_rhs + 1
+    CPU_FLAGS_SBC,   // flag_lhs - flag_rhs - 1
+};
+
 struct CPU
 {
     // registers
@@ -54,6 +70,64 @@ struct CPU
     uint16_t SP, PC;    // stack pointer and program counter
     bool IME;           // Interrupt Master Enable flag
     bool IME_scheduled; // whether to enable IME after next instruction
+    uint8_t speed_shift; // 1 in CGB double-speed mode, instruction cycles are halved in real time
+
+    // pending flag computation, see CPUFlagOp
+    uint8_t flag_op;
+    uint8_t flag_lhs, flag_rhs, flag_result;
+
+    CPU(bool cgb = false);
+
+    bool flag_z() const { return flag_op == CPU_FLAGS_EAGER ? (AF_bytes.F & CPU_FLAG_Z) : flag_result == 0; }
+    bool flag_c() const { return AF_bytes.F & CPU_FLAG_C; }
+
+    // materializes and returns F, needed before F is read as a whole
+    uint8_t flags()
+    {
+        if (flag_op != CPU_FLAGS_EAGER)
+        {
+            materialize_flags();
+        }
+
+        return AF_bytes.F;
+    }
+
+    void materialize_flags();
 
-    CPU();
+    void set_flags(uint8_t flags)
+    {
+        AF_bytes.F = flags;
+        flag_op = CPU_FLAGS_EAGER;
+    }
+
+    void flags_add(uint8_t lhs, uint8_t rhs) { flags_adc(lhs, rhs, 0); }
+    void flags_sub(uint8_t lhs, uint8_t rhs) { flags_sbc(lhs, rhs, 0); }
+
+    // carry is the carry in, 0 or 1
+    void flags_adc(uint8_t lhs, uint8_t rhs, uint8_t carry)
+    {
+        AF_bytes.F = (lhs + rhs + carry > 0xFF) * CPU_FLAG_C;
+        record_flags(carry ? CPU_FLAGS_ADC : CPU_FLAGS_ADD, lhs, rhs, lhs + rhs + carry);
+    }
+
+    void flags_sbc(uint8_t lhs, uint8_t rhs, uint8_t carry)
+    {
+        AF_bytes.F = (lhs < rhs + carry) * CPU_FLAG_C;
+        record_flags(carry ? CPU_FLAGS_SBC : CPU_FLAGS_SUB, lhs, rhs, lhs - rhs - carry);
+    }
+
+    // C is left as is in F
+    void flags_inc(uint8_t result) { record_flags(CPU_FLAGS_INC, flag_lhs, flag_rhs, result); }
+    void flags_dec(uint8_t result) { record_flags(CPU_FLAGS_DEC, flag_lhs, flag_rhs, result); }
+
+    void record_flags(uint8_t op, uint8_t lhs, uint8_t rhs, uint8_t result)
+    {
+        flag_op = op;
+        flag_lhs = lhs;
+        flag_rhs = rhs;
+        flag_result = result;
+#ifdef GB_EAGER_FLAGS
+        materialize_flags();
+#endif
+    }
 };
\ No newline at end of file
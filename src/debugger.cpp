@@ -0,0 +1,145 @@
+#include <algorithm>
+
+#include "debugger.h"
+#include "gameboy.h"
+
+static uint16_t page_bit(uint16_t address) { return 1 << (address >> 12); }
+
+// pages that still have a point after one was removed
+static uint16_t pages_of(const std::vector<DebugPoint> &points)
+{
+    uint16_t pages = 0;
+
+    for (const DebugPoint &point : points)
+    {
+        pages |= page_bit(point.address);
+    }
+
+    return pages;
+}
+
+static void erase_address(std::vector<DebugPoint> &points, uint16_t address)
+{
+    points.erase(std::remove_if(points.begin(), points.end(),
+                                [address](const DebugPoint &point) { return point.address == address; }),
+                 points.end());
+}
+
+// true if any point at address has no condition or one that holds
+static bool any_holds(const std::vector<DebugPoint> &points, uint16_t address, const Gameboy &gb)
+{
+    return std::any_of(points.begin(), points.end(), [&](const DebugPoint &point) {
+        return point.address == address && (!point.condition || point.condition(gb));
+    });
+}
+
+void Watchpoints::add(uint16_t address, DebugCondition condition)
+{
+    list.push_back({address, std::move(condition)});
+    pages |= page_bit(address);
+}
+
+void Watchpoints::remove(uint16_t address)
+{
+    erase_address(list, address);
+    pages = pages_of(list);
+}
+
+void Watchpoints::clear()
+{
+    list.clear();
+    pages = 0;
+    hit = false;
+}
+
+bool Watchpoints::record(uint16_t address, uint8_t old_value, uint8_t value)
+{
+    bool watched = std::any_of(list.begin(), list.end(),
+                               [address](const DebugPoint &point) { return point.address == address; });
+
+    if (!watched || hit)
+    {
+        return watched; // only the first watched write of an instruction is reported
+    }
+
+    hit = true;
+    last_hit.reason = DEBUG_STOP_WATCHPOINT;
+    last_hit.address = address;
+    last_hit.old_value = old_value;
+    last_hit.value = value;
+    return true;
+}
+
+void Debugger::add_breakpoint(uint16_t address, DebugCondition condition)
+{
+    breakpoint_list.push_back({address, std::move(condition)});
+    breakpoints.set(address);
+    breakpoint_pages |= page_bit(address);
+}
+
+void Debugger::remove_breakpoint(uint16_t address)
+{
+    erase_address(breakpoint_list, address);
+    breakpoints.reset(address);
+    breakpoint_pages = pages_of(breakpoint_list);
+}
+
+void Debugger::add_condition(DebugCondition condition)
+{
+    conditions.push_back(std::move(condition));
+}
+
+void Debugger::clear()
+{
+    breakpoint_list.clear();
+    breakpoints.reset();
+    breakpoint_pages = 0;
+    conditions.clear();
+}
+
+bool Debugger::check_instruction(const Gameboy &gb)
+{
+    if (resuming)
+    {
+        resuming = false;
+        return false;
+    }
+
+    uint16_t pc = gb.cpu.PC;
+    DebugStopReason reason = DEBUG_STOP_NONE;
+
+    // the page mask keeps the bitset lookup off pages without breakpoints
+    if ((breakpoint_pages & page_bit(pc)) && breakpoints[pc] && any_holds(breakpoint_list, pc, gb))
+    {
+        reason = DEBUG_STOP_BREAKPOINT;
+    }
+    else if (std::any_of(conditions.begin(), conditions.end(),
+                         [&gb](const DebugCondition &condition) { return condition(gb); }))
+    {
+        reason = DEBUG_STOP_CONDITION;
+    }
+    else
+    {
+        return false;
+    }
+
+    stop = DebugStop();
+    stop.reason = reason;
+    stop.pc = pc;
+    resuming = true;
+    return true;
+}
+
+bool Debugger::check_watchpoint(const Gameboy &gb, Watchpoints &watchpoints)
+{
+    watchpoints.hit = false;
+
+    if (!any_holds(watchpoints.list, watchpoints.last_hit.address, gb))
+    {
+        return false;
+    }
+
+    stop = watchpoints.last_hit;
+    stop.pc = gb.cpu.PC; // the write already happened, so the next instruction is still checked
+    return true;
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <bitset>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+// breakpoints, watchpoints and conditional stops
+//
+// none of them cost anything while unset. breakpoints and conditions switch
+// run_frame() to a checked instruction loop, the unchecked one is the same
+// code as without a debugger. watchpoints null the page in MMU::write_pages,
+// so only writes to a watched 4KB page take the write_slow() path and look
+// at the watch list. a stop ends run_frame() with GB_FAULT_BREAK, the next
+// run_frame() continues the same frame from there
+
+struct Gameboy;
+
+constexpr size_t DEBUG_ADDRESS_SPACE = 0x10000;
+
+// extra condition for a breakpoint or watchpoint, or a stop condition of its
+// own. an empty condition always holds
+using DebugCondition = std::function<bool(const Gameboy &)>;
+
+enum DebugStopReason : uint8_t
+{
+    DEBUG_STOP_NONE,
+    DEBUG_STOP_BREAKPOINT, // about to execute an instruction at a breakpoint
+    DEBUG_STOP_WATCHPOINT, // the last instruction wrote to a watched address
+    DEBUG_STOP_CONDITION,  // a stop condition held after the last instruction
+};
+
+struct DebugStop
+{
+    DebugStopReason reason = DEBUG_STOP_NONE;
+    uint16_t pc = 0;        // PC of the next instruction to execute
+    uint16_t address = 0;   // written address, watchpoints only
+    uint8_t old_value = 0;  // value before the write
+    uint8_t value = 0;      // value written
+};
+
+// a breakpoint or watchpoint
+struct DebugPoint
+{
+    uint16_t address;
+    DebugCondition condition;
+};
+
+// lives in the MMU, MMU::write_slow() checks writes to the pages in pages
+struct Watchpoints
+{
+    std::vector<DebugPoint> list;
+    uint16_t pages = 0; // bit n set if page n has a watchpoint, MMU::map_banks() nulls their write pointers
+
+    bool hit = false;   // a write matched since the last check, ends the slice
+    DebugStop last_hit; // the first matching write of the instruction
+
+    void add(uint16_t address, DebugCondition condition);
+    void remove(uint16_t address); // all watchpoints on the address
+    void clear();
+
+    // called for writes to watched pages, returns true if address is watched
+    bool record(uint16_t address, uint8_t old_value, uint8_t value);
+};
+
+struct Debugger
+{
+    std::bitset<DEBUG_ADDRESS_SPACE> breakpoints; // addresses with at least one breakpoint
+    uint16_t breakpoint_pages = 0;                // bit n set if page n has a breakpoint
+    std::vector<DebugPoint> breakpoint_list;      // address and condition of each breakpoint
+    std::vector<DebugCondition> conditions;       // checked between any two instructions
+
+    DebugStop stop; // why the last GB_FAULT_BREAK happened
+
+    // the first instruction after a stop runs unchecked, so continuing
+    // doesn't stop again on the same breakpoint or condition
+    bool resuming = false;
+
+    // true if run_frame() needs the checked loop
+    bool checked() const { return breakpoint_pages || !conditions.empty(); }
+
+    void add_breakpoint(uint16_t address, DebugCondition condition);
+    void remove_breakpoint(uint16_t address); // all breakpoints on the address
+    void add_condition(DebugCondition condition);
+    void clear(); // breakpoints and conditions, watchpoints are cleared through the MMU
+
+    // before each instruction of the checked loop, true if gb should stop
+    bool check_instruction(const Gameboy &gb);
+
+    // after a slice that ended on a watched write, true if gb should stop
+    bool check_watchpoint(const Gameboy &gb, Watchpoints &watchpoints);
+};
@@ -0,0 +1,784 @@
+#include "exectrace.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// file layout, host endian:
+//   ExecTraceHeader
+//   blocks: ExecTraceBlockHeader, then `records` records taking `size` bytes,
+//           zero padded to EXECTRACE_BLOCK_ALIGNMENT
+//   ExecTraceIndexEntry[index_count], written by close()
+//
+// a record describes the instruction after the previous one:
+//   mask byte, EXECTRACE_FIELD_* bits
+//   opcode, and the CB-prefixed opcode if it's 0xCB
+//   cycles since the previous instruction started, varint
+//   then the fields set in mask, in bit order: PC, SP, BC, DE, HL as zigzag
+//   varint deltas of the 16-bit value, A, F and misc as plain bytes
+//
+// PC is only stored when it isn't the previous instruction's PC plus its
+// length, i.e. after jumps, calls, returns and interrupts
+
+struct ExecTraceHeader
+{
+    char magic[4];          // "GBXT"
+    uint32_t version;       // EXECTRACE_VERSION
+    uint32_t keyframe_interval;
+    uint32_t index_count;   // 0 until the trace is closed
+    uint64_t index_offset;  // bytes from the start of the file
+    uint64_t instructions;  // written by close()
+};
+
+struct ExecTraceBlockHeader
+{
+    char magic[4];           // "GBXB"
+    uint32_t records;        // after the keyframe, the block holds records + 1 instructions
+    uint64_t size;           // bytes of records
+    ExecTraceState keyframe; // first instruction of the block
+};
+
+static_assert(sizeof(ExecTraceHeader) == 32);
+static_assert(sizeof(ExecTraceBlockHeader) == 48);
+
+constexpr uint8_t EXECTRACE_FIELD_PC = 1 << 0;
+constexpr uint8_t EXECTRACE_FIELD_SP = 1 << 1;
+constexpr uint8_t EXECTRACE_FIELD_BC = 1 << 2;
+constexpr uint8_t EXECTRACE_FIELD_DE = 1 << 3;
+constexpr uint8_t EXECTRACE_FIELD_HL = 1 << 4;
+constexpr uint8_t EXECTRACE_FIELD_A = 1 << 5;
+constexpr uint8_t EXECTRACE_FIELD_F = 1 << 6;
+constexpr uint8_t EXECTRACE_FIELD_MISC = 1 << 7;
+
+constexpr size_t EXECTRACE_BLOCK_ALIGNMENT = alignof(ExecTraceBlockHeader); // the writer updates headers in place
+constexpr size_t EXECTRACE_MAX_RECORD = 32; // mask, 2 opcode bytes, 10 cycle bytes, 5 deltas of 3, 3 bytes
+
+// bytes of an instruction including its operands, only to predict PC
+static uint16_t opcode_length(uint8_t opcode)
+{
+    switch (opcode)
+    {
+    case 0x01: // LD rr,u16
+    case 0x08: // LD (u16),SP
+    case 0x11:
+    case 0x21:
+    case 0x31:
+    case 0xC2: // JP cc,u16 and JP u16
+    case 0xC3:
+    case 0xCA:
+    case 0xD2:
+    case 0xDA:
+    case 0xC4: // CALL cc,u16 and CALL u16
+    case 0xCC:
+    case 0xCD:
+    case 0xD4:
+    case 0xDC:
+    case 0xEA: // LD (u16),A
+    case 0xFA: // LD A,(u16)
+        return 3;
+    case 0x06: // LD r,u8
+    case 0x0E:
+    case 0x16:
+    case 0x1E:
+    case 0x26:
+    case 0x2E:
+    case 0x36:
+    case 0x3E:
+    case 0x10: // STOP
+    case 0x18: // JR i8 and JR cc,i8
+    case 0x20:
+    case 0x28:
+    case 0x30:
+    case 0x38:
+    case 0xC6: // ALU A,u8
+    case 0xCE:
+    case 0xD6:
+    case 0xDE:
+    case 0xE6:
+    case 0xEE:
+    case 0xF6:
+    case 0xFE:
+    case 0xCB: // prefix
+    case 0xE0: // LDH (u8),A
+    case 0xF0: // LDH A,(u8)
+    case 0xE8: // ADD SP,i8
+    case 0xF8: // LD HL,SP+i8
+        return 2;
+    default:
+        return 1;
+    }
+}
+
+static uint8_t *put_varint(uint8_t *out, uint64_t value)
+{
+    while (value >= 0x80)
+    {
+        *out++ = static_cast<uint8_t>(value) | 0x80;
+        value >>= 7;
+    }
+
+    *out++ = static_cast<uint8_t>(value);
+    return out;
+}
+
+static bool get_varint(const uint8_t *&in, const uint8_t *end, uint64_t &value)
+{
+    value = 0;
+
+    for (int shift = 0; shift < 64 && in < end; shift += 7)
+    {
+        uint8_t byte = *in++;
+        value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+
+        if (!(byte & 0x80))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// small steps either way take one byte
+static uint8_t *put_delta(uint8_t *out, uint16_t from, uint16_t to)
+{
+    int16_t delta = static_cast<int16_t>(to - from);
+    return put_varint(out, static_cast<uint16_t>((delta * 2) ^ (delta >> 15)));
+}
+
+static bool get_delta(const uint8_t *&in, const uint8_t *end, uint16_t &value)
+{
+    uint64_t zigzag;
+
+    if (!get_varint(in, end, zigzag))
+    {
+        return false;
+    }
+
+    value += static_cast<uint16_t>((zigzag >> 1) ^ (0 - (zigzag & 1)));
+    return true;
+}
+
+// decodes the record at in, state holds the previous instruction and
+// becomes the next one. false on a truncated or corrupt record
+static bool decode_record(const uint8_t *&in, const uint8_t *end, ExecTraceState &state)
+{
+    if (end - in < 2)
+    {
+        return false;
+    }
+
+    uint8_t mask = *in++;
+    uint16_t pc = state.PC + opcode_length(state.opcode);
+    uint64_t cycles;
+
+    state.instruction++;
+    state.opcode = *in++;
+    state.cb_opcode = 0;
+
+    if (state.opcode == 0xCB)
+    {
+        if (in == end)
+        {
+            return false;
+        }
+
+        state.cb_opcode = *in++;
+    }
+
+    if (!get_varint(in, end, cycles))
+    {
+        return false;
+    }
+
+    state.cycle += cycles;
+
+    if (mask & EXECTRACE_FIELD_PC)
+    {
+        if (!get_delta(in, end, state.PC))
+        {
+            return false;
+        }
+    }
+    else
+    {
+        state.PC = pc;
+    }
+
+    if (((mask & EXECTRACE_FIELD_SP) && !get_delta(in, end, state.SP)) ||
+        ((mask & EXECTRACE_FIELD_BC) && !get_delta(in, end, state.BC)) ||
+        ((mask & EXECTRACE_FIELD_DE) && !get_delta(in, end, state.DE)) ||
+        ((mask & EXECTRACE_FIELD_HL) && !get_delta(in, end, state.HL)))
+    {
+        return false;
+    }
+
+    size_t plain = !!(mask & EXECTRACE_FIELD_A) + !!(mask & EXECTRACE_FIELD_F) + !!(mask & EXECTRACE_FIELD_MISC);
+
+    if (static_cast<size_t>(end - in) < plain)
+    {
+        return false;
+    }
+
+    if (mask & EXECTRACE_FIELD_A)
+    {
+        state.AF = static_cast<uint16_t>((*in++ << 8) | (state.AF & 0xFF));
+    }
+
+    if (mask & EXECTRACE_FIELD_F)
+    {
+        state.AF = static_cast<uint16_t>((state.AF & 0xFF00) | *in++);
+    }
+
+    if (mask & EXECTRACE_FIELD_MISC)
+    {
+        state.misc = *in++;
+    }
+
+    return true;
+}
+
+std::string exectrace_format(const ExecTraceState &state)
+{
+    char line[160];
+    char opcode[8];
+
+    if (state.opcode == 0xCB)
+    {
+        std::snprintf(opcode, sizeof(opcode), "CB %02X", state.cb_opcode);
+    }
+    else
+    {
+        std::snprintf(opcode, sizeof(opcode), "%02X", state.opcode);
+    }
+
+    std::snprintf(line, sizeof(line), "%12llu %10llu PC %04X %-5s AF %04X BC %04X DE %04X HL %04X SP %04X IME %d%s",
+                  static_cast<unsigned long long>(state.cycle), static_cast<unsigned long long>(state.instruction),
+                  state.PC, opcode, state.AF, state.BC, state.DE, state.HL, state.SP,
+                  !!(state.misc & EXECTRACE_MISC_IME), (state.misc & EXECTRACE_MISC_DOUBLE_SPEED) ? " 2x" : "");
+
+    return line;
+}
+
+ExecTraceWriter::ExecTraceWriter()
+    : fd(-1), data(nullptr), mapped(0), size(0), block_offset(0), keyframe_interval(0), instructions(0),
+      failed(false), last{}
+{
+}
+
+ExecTraceWriter::~ExecTraceWriter()
+{
+    close();
+}
+
+void ExecTraceWriter::record(const CPU &cpu, uint64_t cycle, uint8_t opcode, uint8_t cb_opcode)
+{
+    if (!data || failed)
+    {
+        return;
+    }
+
+    // materializing F in the instance itself would change its lazy flag state
+    CPU flags = cpu;
+
+    ExecTraceState state;
+    state.cycle = cycle;
+    state.instruction = instructions;
+    state.AF = static_cast<uint16_t>((cpu.AF_bytes.A << 8) | flags.flags());
+    state.BC = cpu.BC;
+    state.DE = cpu.DE;
+    state.HL = cpu.HL;
+    state.SP = cpu.SP;
+    state.PC = cpu.PC;
+    state.opcode = opcode;
+    state.cb_opcode = opcode == 0xCB ? cb_opcode : 0;
+    state.misc = (cpu.IME ? EXECTRACE_MISC_IME : 0) | (cpu.IME_scheduled ? EXECTRACE_MISC_IME_SCHEDULED : 0) |
+                 (cpu.speed_shift ? EXECTRACE_MISC_DOUBLE_SPEED : 0);
+    state.reserved = 0;
+
+    ExecTraceBlockHeader *block = reinterpret_cast<ExecTraceBlockHeader *>(data + block_offset);
+
+    // cycle deltas are unsigned, a clock that went backwards (a loaded state) needs a keyframe
+    if (instructions == 0 || block->records + 1 >= keyframe_interval || cycle < last.cycle)
+    {
+        start_block(state);
+        return;
+    }
+
+    if (!reserve(EXECTRACE_MAX_RECORD))
+    {
+        return;
+    }
+
+    uint8_t *record = data + size;
+    uint8_t *out = record + 1;
+    uint8_t mask = 0;
+
+    *out++ = opcode;
+
+    if (opcode == 0xCB)
+    {
+        *out++ = cb_opcode;
+    }
+
+    out = put_varint(out, cycle - last.cycle);
+
+    if (state.PC != static_cast<uint16_t>(last.PC + opcode_length(last.opcode)))
+    {
+        mask |= EXECTRACE_FIELD_PC;
+        out = put_delta(out, last.PC, state.PC);
+    }
+
+    if (state.SP != last.SP)
+    {
+        mask |= EXECTRACE_FIELD_SP;
+        out = put_delta(out, last.SP, state.SP);
+    }
+
+    if (state.BC != last.BC)
+    {
+        mask |= EXECTRACE_FIELD_BC;
+        out = put_delta(out, last.BC, state.BC);
+    }
+
+    if (state.DE != last.DE)
+    {
+        mask |= EXECTRACE_FIELD_DE;
+        out = put_delta(out, last.DE, state.DE);
+    }
+
+    if (state.HL != last.HL)
+    {
+        mask |= EXECTRACE_FIELD_HL;
+        out = put_delta(out, last.HL, state.HL);
+    }
+
+    if ((state.AF ^ last.AF) & 0xFF00)
+    {
+        mask |= EXECTRACE_FIELD_A;
+        *out++ = static_cast<uint8_t>(state.AF >> 8);
+    }
+
+    if ((state.AF ^ last.AF) & 0x00FF)
+    {
+        mask |= EXECTRACE_FIELD_F;
+        *out++ = static_cast<uint8_t>(state.AF);
+    }
+
+    if (state.misc != last.misc)
+    {
+        mask |= EXECTRACE_FIELD_MISC;
+        *out++ = state.misc;
+    }
+
+    *record = mask;
+    size = out - data;
+
+    // size before records, a reader of a crashed trace never sees a record
+    // counted that isn't complete
+    block = reinterpret_cast<ExecTraceBlockHeader *>(data + block_offset);
+    block->size = size - block_offset - sizeof(ExecTraceBlockHeader);
+    block->records++;
+
+    last = state;
+    instructions++;
+}
+
+static size_t align_block(size_t offset)
+{
+    return (offset + EXECTRACE_BLOCK_ALIGNMENT - 1) & ~(EXECTRACE_BLOCK_ALIGNMENT - 1);
+}
+
+void ExecTraceWriter::start_block(const ExecTraceState &state)
+{
+    if (!reserve(align_block(size) - size + sizeof(ExecTraceBlockHeader)))
+    {
+        return;
+    }
+
+    size = align_block(size); // the padding is still zero from ftruncate()
+
+    ExecTraceBlockHeader block;
+    std::memcpy(block.magic, "GBXB", 4);
+    block.records = 0;
+    block.size = 0;
+    block.keyframe = state;
+
+    std::memcpy(data + size, &block, sizeof(block));
+    block_offset = size;
+    size += sizeof(block);
+    index.push_back({state.cycle, state.instruction, block_offset});
+
+    last = state;
+    instructions++;
+}
+
+#ifndef _WIN32
+
+bool ExecTraceWriter::open(const std::string &filename, uint32_t interval)
+{
+    close();
+
+    fd = ::open(filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+
+    if (fd < 0)
+    {
+        std::cerr << "Failed to open execution trace " << filename << ": " << std::strerror(errno) << std::endl;
+        return false;
+    }
+
+    void *mapping = MAP_FAILED;
+
+    if (ftruncate(fd, EXECTRACE_GROW_SIZE) == 0)
+    {
+        mapping = mmap(nullptr, EXECTRACE_GROW_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+
+    if (mapping == MAP_FAILED)
+    {
+        std::cerr << "Failed to map execution trace " << filename << ": " << std::strerror(errno) << std::endl;
+        ::close(fd);
+        fd = -1;
+        return false;
+    }
+
+    data = static_cast<uint8_t *>(mapping);
+    mapped = EXECTRACE_GROW_SIZE;
+    keyframe_interval = std::max<uint32_t>(interval, 1);
+    instructions = 0;
+    failed = false;
+    index.clear();
+
+    ExecTraceHeader header = {{'G', 'B', 'X', 'T'}, EXECTRACE_VERSION, keyframe_interval, 0, 0, 0};
+    std::memcpy(data, &header, sizeof(header));
+    size = sizeof(header);
+    block_offset = 0;
+
+    return true;
+}
+
+bool ExecTraceWriter::reserve(size_t bytes)
+{
+    while (size + bytes > mapped)
+    {
+        size_t grown = mapped + EXECTRACE_GROW_SIZE;
+        void *mapping = MAP_FAILED;
+
+        if (ftruncate(fd, grown) == 0)
+        {
+            mapping = mremap(data, mapped, grown, MREMAP_MAYMOVE);
+        }
+
+        if (mapping == MAP_FAILED)
+        {
+            // what's recorded so far stays readable
+            std::cerr << "Execution trace stopped, can't grow the file: " << std::strerror(errno) << std::endl;
+            failed = true;
+            return false;
+        }
+
+        data = static_cast<uint8_t *>(mapping);
+        mapped = grown;
+    }
+
+    return true;
+}
+
+bool ExecTraceWriter::close()
+{
+    if (fd < 0)
+    {
+        return true;
+    }
+
+    size_t index_bytes = index.size() * sizeof(ExecTraceIndexEntry);
+
+    // without an index readers rebuild it from the blocks
+    if (reserve(index_bytes))
+    {
+        ExecTraceHeader *header = reinterpret_cast<ExecTraceHeader *>(data);
+        std::memcpy(data + size, index.data(), index_bytes);
+        header->index_count = static_cast<uint32_t>(index.size());
+        header->index_offset = size;
+        header->instructions = instructions;
+        size += index_bytes;
+    }
+
+    munmap(data, mapped);
+    bool ok = ftruncate(fd, size) == 0;
+    ok &= ::close(fd) == 0;
+
+    if (!ok)
+    {
+        std::cerr << "Failed to finish execution trace: " << std::strerror(errno) << std::endl;
+    }
+
+    fd = -1;
+    data = nullptr;
+    mapped = size = 0;
+    index.clear();
+
+    return ok;
+}
+
+ExecTraceReader::~ExecTraceReader()
+{
+    if (data)
+    {
+        munmap(const_cast<uint8_t *>(data), size);
+    }
+}
+
+// the header of the block at offset, false unless the whole block lies
+// within the file
+static bool read_block(const uint8_t *data, size_t size, uint64_t offset, ExecTraceBlockHeader &block)
+{
+    if (offset > size || size - offset < sizeof(block))
+    {
+        return false;
+    }
+
+    std::memcpy(&block, data + offset, sizeof(block));
+    return std::memcmp(block.magic, "GBXB", 4) == 0 && block.size <= size - offset - sizeof(block);
+}
+
+bool ExecTraceReader::open(const std::string &filename)
+{
+    if (data)
+    {
+        munmap(const_cast<uint8_t *>(data), size);
+        data = nullptr;
+    }
+
+    index.clear();
+
+    int fd = ::open(filename.c_str(), O_RDONLY);
+
+    if (fd < 0)
+    {
+        std::cerr << "Failed to open execution trace " << filename << ": " << std::strerror(errno) << std::endl;
+        return false;
+    }
+
+    struct stat info;
+
+    if (fstat(fd, &info) != 0 || static_cast<size_t>(info.st_size) < sizeof(ExecTraceHeader))
+    {
+        std::cerr << "Not an execution trace: " << filename << std::endl;
+        ::close(fd);
+        return false;
+    }
+
+    size = info.st_size;
+    void *mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+
+    if (mapping == MAP_FAILED)
+    {
+        std::cerr << "Failed to map execution trace " << filename << ": " << std::strerror(errno) << std::endl;
+        return false;
+    }
+
+    data = static_cast<const uint8_t *>(mapping);
+
+    ExecTraceHeader header;
+    std::memcpy(&header, data, sizeof(header));
+
+    if (std::memcmp(header.magic, "GBXT", 4) != 0 || header.version != EXECTRACE_VERSION)
+    {
+        std::cerr << "Execution trace is corrupt or from another version: " << filename << std::endl;
+        return false;
+    }
+
+    keyframe_interval = header.keyframe_interval;
+    instructions = 0;
+    complete = header.index_count && header.index_offset <= size &&
+               header.index_count <= (size - header.index_offset) / sizeof(ExecTraceIndexEntry);
+
+    ExecTraceBlockHeader block;
+
+    if (complete)
+    {
+        index.resize(header.index_count);
+        std::memcpy(index.data(), data + header.index_offset, header.index_count * sizeof(ExecTraceIndexEntry));
+        instructions = header.instructions;
+
+        // the cursors trust the index, a corrupt one is rebuilt from the blocks below
+        for (const ExecTraceIndexEntry &entry : index)
+        {
+            if (!read_block(data, size, entry.offset, block))
+            {
+                complete = false;
+                index.clear();
+                instructions = 0;
+                break;
+            }
+        }
+
+        if (complete)
+        {
+            return true;
+        }
+    }
+
+    // not closed, probably a crash. the chain of block headers ends at the
+    // first one that was never written, the rest of the file is zeros
+    size_t offset = sizeof(ExecTraceHeader);
+
+    while (read_block(data, size, offset, block))
+    {
+        index.push_back({block.keyframe.cycle, block.keyframe.instruction, offset});
+        instructions = block.keyframe.instruction + block.records + 1;
+        offset = align_block(offset + sizeof(block) + block.size);
+    }
+
+    return true;
+}
+
+#else
+
+// traces are written and read through mmap(), other platforms don't support them
+
+bool ExecTraceWriter::open(const std::string &filename, uint32_t)
+{
+    std::cerr << "Execution traces aren't supported on this platform: " << filename << std::endl;
+    return false;
+}
+
+bool ExecTraceWriter::reserve(size_t)
+{
+    return false;
+}
+
+bool ExecTraceWriter::close()
+{
+    return true;
+}
+
+ExecTraceReader::~ExecTraceReader() {}
+
+bool ExecTraceReader::open(const std::string &filename)
+{
+    std::cerr << "Execution traces aren't supported on this platform: " << filename << std::endl;
+    return false;
+}
+
+#endif
+
+ExecTraceReader::ExecTraceReader() : data(nullptr), size(0), keyframe_interval(0), instructions(0), complete(false) {}
+
+size_t ExecTraceReader::find_block(uint64_t instruction) const
+{
+    auto after = std::upper_bound(index.begin(), index.end(), instruction,
+                                  [](uint64_t value, const ExecTraceIndexEntry &entry)
+                                  { return value < entry.instruction; });
+
+    return after - index.begin() - 1;
+}
+
+// walks the instructions of one block
+struct ExecTraceCursor
+{
+    const uint8_t *position; // next record
+    const uint8_t *end;      // end of the block's records
+    uint32_t remaining;      // records left
+    ExecTraceState state;    // current instruction
+
+    ExecTraceCursor(const uint8_t *data, const ExecTraceIndexEntry &entry)
+    {
+        ExecTraceBlockHeader block;
+        std::memcpy(&block, data + entry.offset, sizeof(block));
+
+        position = data + entry.offset + sizeof(block);
+        end = position + block.size;
+        remaining = block.records;
+        state = block.keyframe;
+    }
+
+    bool next() // false at the end of the block
+    {
+        if (!remaining)
+        {
+            return false;
+        }
+
+        remaining--;
+        return decode_record(position, end, state);
+    }
+};
+
+bool ExecTraceReader::seek_instruction(uint64_t instruction, ExecTraceState &state) const
+{
+    if (instruction >= instructions)
+    {
+        return false;
+    }
+
+    ExecTraceCursor cursor(data, index[find_block(instruction)]);
+
+    while (cursor.state.instruction < instruction)
+    {
+        if (!cursor.next())
+        {
+            return false;
+        }
+    }
+
+    state = cursor.state;
+    return true;
+}
+
+bool ExecTraceReader::seek_cycle(uint64_t cycle, ExecTraceState &state) const
+{
+    auto after = std::upper_bound(index.begin(), index.end(), cycle,
+                                  [](uint64_t value, const ExecTraceIndexEntry &entry) { return value < entry.cycle; });
+
+    if (after == index.begin())
+    {
+        return false;
+    }
+
+    ExecTraceCursor cursor(data, *(after - 1));
+    state = cursor.state;
+
+    while (cursor.next() && cursor.state.cycle <= cycle)
+    {
+        state = cursor.state;
+    }
+
+    return true;
+}
+
+size_t ExecTraceReader::read(uint64_t first, size_t count, std::vector<ExecTraceState> &states) const
+{
+    states.clear();
+
+    if (first >= instructions)
+    {
+        return 0;
+    }
+
+    for (size_t block = find_block(first); block < index.size() && states.size() < count; block++)
+    {
+        ExecTraceCursor cursor(data, index[block]);
+
+        do
+        {
+            if (cursor.state.instruction >= first)
+            {
+                states.push_back(cursor.state);
+            }
+        } while (states.size() < count && cursor.next());
+    }
+
+    return states.size();
+}
@@ -0,0 +1,124 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "cpu.h"
+
+// compact execution trace, every instruction's PC, opcode and registers
+//
+// only recorded when compiled with -DGB_TRACE_EXEC, Gameboy::run_opcode()
+// then hands each instruction to Gameboy::exec_trace if it's set. reading
+// needs no define.
+//
+// the file is a sequence of blocks. a block starts with a keyframe, the full
+// state of its first instruction, followed by one record per instruction
+// with only what changed since the one before, varint encoded: a few bytes
+// per instruction instead of a text line. an index of the blocks by cycle
+// and instruction number is appended when the trace is closed, so a reader
+// finds any point by binary search and decodes at most one block from its
+// keyframe. the writer fills a growing shared mapping of the file and keeps
+// the current block's header up to date, so a trace cut short by a crash
+// can still be read up to its last instruction
+
+constexpr uint32_t EXECTRACE_VERSION = 1;
+constexpr uint32_t EXECTRACE_DEFAULT_KEYFRAME_INTERVAL = 4096; // instructions per block
+constexpr size_t EXECTRACE_GROW_SIZE = 64 * 1024 * 1024;      // the file and its mapping grow by this much
+
+// ExecTraceState::misc bits
+constexpr uint8_t EXECTRACE_MISC_IME = 1 << 0;           // CPU::IME
+constexpr uint8_t EXECTRACE_MISC_IME_SCHEDULED = 1 << 1; // CPU::IME_scheduled
+constexpr uint8_t EXECTRACE_MISC_DOUBLE_SPEED = 1 << 2;  // CPU::speed_shift is 1
+
+// CPU state before an instruction ran. also the keyframe layout in the file
+struct ExecTraceState
+{
+    uint64_t cycle;       // Gameboy::total_cycles when the instruction started
+    uint64_t instruction; // position in the trace, from 0
+    uint16_t AF;          // with F materialized
+    uint16_t BC, DE, HL, SP, PC;
+    uint8_t opcode;    // at PC
+    uint8_t cb_opcode; // at PC + 1 if opcode is 0xCB, otherwise 0
+    uint8_t misc;      // EXECTRACE_MISC_* bits
+    uint8_t reserved;
+};
+
+static_assert(sizeof(ExecTraceState) == 32);
+
+struct ExecTraceIndexEntry
+{
+    uint64_t cycle;       // of the block's keyframe
+    uint64_t instruction; // of the block's keyframe
+    uint64_t offset;      // of the block in the file
+};
+
+static_assert(sizeof(ExecTraceIndexEntry) == 24);
+
+struct ExecTraceWriter
+{
+    int fd;               // -1 while closed
+    uint8_t *data;        // shared mapping of the whole file
+    size_t mapped;        // bytes mapped, the file is as large
+    size_t size;          // bytes written
+    size_t block_offset;  // header of the block being written
+    uint32_t keyframe_interval;
+    uint64_t instructions; // recorded so far
+    bool failed;           // growing the file failed, nothing more is recorded
+
+    ExecTraceState last; // previous instruction, the next record is relative to it
+    std::vector<ExecTraceIndexEntry> index;
+
+    ExecTraceWriter();
+    ~ExecTraceWriter(); // close()s
+
+    ExecTraceWriter(const ExecTraceWriter &) = delete;
+    ExecTraceWriter &operator=(const ExecTraceWriter &) = delete;
+
+    bool open(const std::string &filename, uint32_t keyframe_interval = EXECTRACE_DEFAULT_KEYFRAME_INTERVAL);
+
+    // append an instruction about to run. cycle is Gameboy::total_cycles
+    // before its fetch
+    void record(const CPU &cpu, uint64_t cycle, uint8_t opcode, uint8_t cb_opcode);
+
+    // append the index and trim the file to its size, false on I/O errors
+    bool close();
+
+    void start_block(const ExecTraceState &state);
+    bool reserve(size_t bytes); // grow the file until bytes more fit
+};
+
+// seeking by cycle assumes the clock only ran forward while recording,
+// loading a state in between makes cycles ambiguous. seeking by
+// instruction always works
+struct ExecTraceReader
+{
+    const uint8_t *data; // read-only mapping of the file
+    size_t size;
+    uint32_t keyframe_interval;
+    uint64_t instructions; // in the trace
+    bool complete;         // closed properly, false if the index was rebuilt from the blocks (not closed, or corrupt)
+    std::vector<ExecTraceIndexEntry> index;
+
+    ExecTraceReader();
+    ~ExecTraceReader(); // unmaps
+
+    ExecTraceReader(const ExecTraceReader &) = delete;
+    ExecTraceReader &operator=(const ExecTraceReader &) = delete;
+
+    bool open(const std::string &filename); // false if it's missing or not a trace
+
+    // state of the last instruction that started at or before cycle, false
+    // if the trace starts later
+    bool seek_cycle(uint64_t cycle, ExecTraceState &state) const;
+    bool seek_instruction(uint64_t instruction, ExecTraceState &state) const;
+
+    // decodes up to count consecutive instructions from first on, returns
+    // how many there were
+    size_t read(uint64_t first, size_t count, std::vector<ExecTraceState> &states) const;
+
+    size_t find_block(uint64_t instruction) const; // index of the block holding the instruction
+};
+
+std::string exectrace_format(const ExecTraceState &state); // one line, registers as hex
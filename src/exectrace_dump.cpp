@@ -0,0 +1,65 @@
+#include "exectrace.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+
+// prints the instructions of an execution trace, see src/exectrace.h
+//
+//   gameboy_exectrace <trace_file>                 summary
+//   gameboy_exectrace <trace_file> <cycle> [count] count instructions from the one running at cycle
+
+constexpr size_t EXECTRACE_DUMP_DEFAULT_COUNT = 32;
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2 || argc > 4)
+    {
+        std::cerr << "Usage: " << argv[0] << " <trace_file> [cycle] [count]" << std::endl;
+        return 1;
+    }
+
+    ExecTraceReader trace;
+
+    if (!trace.open(argv[1]))
+    {
+        return 1;
+    }
+
+    if (argc == 2)
+    {
+        std::printf("%llu instructions in %zu blocks of up to %u, %zu bytes%s\n",
+                    static_cast<unsigned long long>(trace.instructions), trace.index.size(), trace.keyframe_interval,
+                    trace.size, trace.complete ? "" : ", not closed or corrupt, index rebuilt");
+
+        ExecTraceState first, last;
+
+        if (trace.seek_instruction(0, first) && trace.seek_instruction(trace.instructions - 1, last))
+        {
+            std::printf("cycles %llu - %llu\n", static_cast<unsigned long long>(first.cycle),
+                        static_cast<unsigned long long>(last.cycle));
+        }
+
+        return 0;
+    }
+
+    uint64_t cycle = std::strtoull(argv[2], nullptr, 10);
+    size_t count = argc > 3 ? std::strtoull(argv[3], nullptr, 10) : EXECTRACE_DUMP_DEFAULT_COUNT;
+    ExecTraceState state;
+
+    if (!trace.seek_cycle(cycle, state))
+    {
+        std::cerr << "The trace starts after cycle " << cycle << std::endl;
+        return 1;
+    }
+
+    std::vector<ExecTraceState> states;
+    trace.read(state.instruction, count, states);
+
+    for (const ExecTraceState &instruction : states)
+    {
+        std::printf("%s\n", exectrace_format(instruction).c_str());
+    }
+
+    return 0;
+}
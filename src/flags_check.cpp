@@ -0,0 +1,168 @@
+#include "gameboy.h"
+
+#include <cstdio>
+#include <vector>
+
+// differential check of the lazily evaluated flags (see CPUFlagOp) against
+// flags computed eagerly from their definitions
+//
+//   gameboy_flagcheck
+//
+// every ALU opcode with lazy flags runs through its handler for all operand
+// pairs and both carry ins. the carry in is left either as materialized
+// flags or as a pending SUB, so handlers reading C from lazy state are
+// covered too. F is compared both through flag_z()/flag_c(), which
+// conditional jumps use without materializing, and through flags(). prints
+// the first mismatches of each opcode and exits 1 if there were any
+
+constexpr uint16_t FLAG_CHECK_CODE = 0xC000;    // WRAM, where the instruction is placed
+constexpr uint16_t FLAG_CHECK_OPERAND = 0xC100; // (HL) operand
+constexpr int FLAG_CHECK_MAX_REPORTS = 8;       // mismatches printed per opcode
+
+enum FlagCheckOperand
+{
+    FLAG_CHECK_B,  // rhs in B
+    FLAG_CHECK_HL, // rhs at (HL)
+    FLAG_CHECK_U8, // rhs is the immediate
+    FLAG_CHECK_NONE,
+};
+
+enum FlagCheckOp
+{
+    FLAG_CHECK_ADD,
+    FLAG_CHECK_ADC,
+    FLAG_CHECK_SUB,
+    FLAG_CHECK_SBC,
+    FLAG_CHECK_INC,
+    FLAG_CHECK_DEC,
+};
+
+struct FlagCheckCase
+{
+    const char *name;
+    uint8_t opcode;
+    FlagCheckOp op;
+    FlagCheckOperand operand;
+    bool lhs_in_b; // INC B / DEC B work on B instead of A
+};
+
+static const FlagCheckCase FLAG_CHECK_CASES[] = {
+    {"ADD A,(HL)", 0x86, FLAG_CHECK_ADD, FLAG_CHECK_HL, false},
+    {"ADC A,u8", 0xCE, FLAG_CHECK_ADC, FLAG_CHECK_U8, false},
+    {"SUB A,B", 0x90, FLAG_CHECK_SUB, FLAG_CHECK_B, false},
+    {"SBC A,u8", 0xDE, FLAG_CHECK_SBC, FLAG_CHECK_U8, false},
+    {"CP A,u8", 0xFE, FLAG_CHECK_SUB, FLAG_CHECK_U8, false},
+    {"CP A,(HL)", 0xBE, FLAG_CHECK_SUB, FLAG_CHECK_HL, false},
+    {"INC B", 0x04, FLAG_CHECK_INC, FLAG_CHECK_NONE, true},
+    {"DEC B", 0x05, FLAG_CHECK_DEC, FLAG_CHECK_NONE, true},
+};
+
+// the reference, straight from the instruction definitions
+static uint8_t expected_flags(FlagCheckOp op, unsigned lhs, unsigned rhs, unsigned carry)
+{
+    unsigned result = 0, half = 0, subtract = 0;
+
+    switch (op)
+    {
+    case FLAG_CHECK_ADD:
+    case FLAG_CHECK_ADC:
+        carry = op == FLAG_CHECK_ADC ? carry : 0;
+        result = lhs + rhs + carry;
+        half = (lhs & 0x0F) + (rhs & 0x0F) + carry > 0x0F;
+        carry = result > 0xFF;
+        break;
+    case FLAG_CHECK_SUB:
+    case FLAG_CHECK_SBC:
+        carry = op == FLAG_CHECK_SBC ? carry : 0;
+        result = lhs - rhs - carry;
+        half = (lhs & 0x0F) < (rhs & 0x0F) + carry;
+        carry = lhs < rhs + carry;
+        subtract = 1;
+        break;
+    case FLAG_CHECK_INC:
+        result = lhs + 1;
+        half = (lhs & 0x0F) == 0x0F;
+        break;
+    case FLAG_CHECK_DEC:
+        result = lhs - 1;
+        half = (lhs & 0x0F) == 0x00;
+        subtract = 1;
+        break;
+    }
+
+    return ((result & 0xFF) == 0) * CPU_FLAG_Z | subtract * CPU_FLAG_N | half * CPU_FLAG_H | carry * CPU_FLAG_C;
+}
+
+static unsigned check_case(Gameboy &gb, const FlagCheckCase &test)
+{
+    unsigned mismatches = 0;
+
+    for (unsigned lhs = 0; lhs < 0x100; lhs++)
+    {
+        for (unsigned rhs = 0; rhs < 0x100; rhs++)
+        {
+            if (test.operand == FLAG_CHECK_NONE && rhs != 0)
+            {
+                break; // rhs is unused, one pass is enough
+            }
+
+            for (unsigned carry = 0; carry < 2; carry++)
+            {
+                for (bool lazy_carry : {false, true})
+                {
+                    CPU &cpu = gb.cpu;
+
+                    if (lazy_carry)
+                    {
+                        cpu.flags_sub(0, carry); // pending, with C = carry
+                    }
+                    else
+                    {
+                        cpu.set_flags(carry * CPU_FLAG_C | CPU_FLAG_Z | CPU_FLAG_H); // the other flags must not leak through
+                    }
+
+                    cpu.AF_bytes.A = test.lhs_in_b ? 0 : lhs;
+                    cpu.BC_bytes.B = test.lhs_in_b ? lhs : rhs;
+                    cpu.HL = FLAG_CHECK_OPERAND;
+                    cpu.PC = FLAG_CHECK_CODE;
+                    gb.mmu.write8(FLAG_CHECK_CODE, test.opcode);
+                    gb.mmu.write8(FLAG_CHECK_CODE + 1, rhs);
+                    gb.mmu.write8(FLAG_CHECK_OPERAND, rhs);
+
+                    gb.run_opcode();
+
+                    uint8_t expected = expected_flags(test.op, lhs, rhs, carry);
+                    bool z = cpu.flag_z(), c = cpu.flag_c();
+                    uint8_t flags = cpu.flags();
+
+                    if (flags != expected || z != bool(expected & CPU_FLAG_Z) || c != bool(expected & CPU_FLAG_C))
+                    {
+                        if (mismatches++ < FLAG_CHECK_MAX_REPORTS)
+                        {
+                            std::printf("%s lhs %02X rhs %02X carry %u%s: F %02X (Z %d C %d), expected %02X\n",
+                                        test.name, lhs, rhs, carry, lazy_carry ? " pending" : "", flags, z, c,
+                                        expected);
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    return mismatches;
+}
+
+int main()
+{
+    Gameboy gb(cartridge_make_image(std::vector<uint8_t>(CARTRIDGE_MAX_ROM_SIZE, 0)));
+    unsigned failed = 0;
+
+    for (const FlagCheckCase &test : FLAG_CHECK_CASES)
+    {
+        unsigned mismatches = check_case(gb, test);
+        std::printf("%-10s %s\n", test.name, mismatches ? "FAILED" : "ok");
+        failed += mismatches != 0;
+    }
+
+    return failed ? 1 : 0;
+}
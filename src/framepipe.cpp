@@ -0,0 +1,128 @@
+#include "framepipe.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+
+FramePipeline::FramePipeline(size_t pool_size, size_t num_encoders, FramePipePolicy pipe_policy,
+                             FrameConsumer frame_consumer)
+    : policy(pipe_policy), consumer(std::move(frame_consumer)), pool(std::max<size_t>(pool_size, 1)),
+      free_frames(pool.size()), ready_frames(pool.size())
+{
+    for (size_t i = 0; i < pool.size(); i++)
+    {
+        free_frames.push(static_cast<uint32_t>(i));
+    }
+
+    for (size_t i = 0; i < std::max<size_t>(num_encoders, 1); i++)
+    {
+        encoders.emplace_back(&FramePipeline::encoder_loop, this);
+    }
+}
+
+FramePipeline::~FramePipeline()
+{
+    close();
+}
+
+bool FramePipeline::submit(const PPU &ppu, uint64_t frame, uint32_t source)
+{
+    uint32_t index;
+
+    while (!free_frames.pop(index))
+    {
+        if (policy == FRAME_PIPE_DROP)
+        {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+
+        // check again after reading the signal, a buffer freed in between
+        // bumps it and wait() returns right away
+        uint32_t seen = free_signal.load(std::memory_order_acquire);
+
+        if (free_frames.pop(index))
+        {
+            break;
+        }
+
+        free_signal.wait(seen, std::memory_order_acquire);
+    }
+
+    CapturedFrame &captured = pool[index];
+    captured.frame = frame;
+    captured.source = source;
+    captured.pixels = ppu.framebuffer;
+
+    // never fails, there are as many cells as buffers
+    ready_frames.push(index);
+    submitted.fetch_add(1, std::memory_order_relaxed);
+    ready_signal.fetch_add(1, std::memory_order_release);
+    ready_signal.notify_one();
+    return true;
+}
+
+void FramePipeline::encoder_loop()
+{
+    while (true)
+    {
+        uint32_t seen = ready_signal.load(std::memory_order_acquire);
+        uint32_t index;
+
+        if (ready_frames.pop(index))
+        {
+            consumer(pool[index]);
+            encoded.fetch_add(1, std::memory_order_relaxed);
+
+            free_frames.push(index);
+            free_signal.fetch_add(1, std::memory_order_release);
+            free_signal.notify_one();
+            continue;
+        }
+
+        if (closing.load(std::memory_order_acquire))
+        {
+            return; // nothing left to encode
+        }
+
+        ready_signal.wait(seen, std::memory_order_acquire);
+    }
+}
+
+void FramePipeline::close()
+{
+    if (closing.exchange(true))
+    {
+        return;
+    }
+
+    ready_signal.fetch_add(1, std::memory_order_release);
+    ready_signal.notify_all();
+
+    for (std::thread &encoder : encoders)
+    {
+        encoder.join();
+    }
+}
+
+FrameConsumer frame_pgm_writer(const std::string &directory)
+{
+    return [directory](const CapturedFrame &captured) {
+        static constexpr uint8_t shades[4] = {255, 170, 85, 0}; // shade 0 is the lightest
+
+        char name[64];
+        std::snprintf(name, sizeof(name), "/%u_%06llu.pgm", captured.source,
+                      static_cast<unsigned long long>(captured.frame));
+
+        std::array<uint8_t, PPU_SCREEN_WIDTH * PPU_SCREEN_HEIGHT> gray;
+
+        for (size_t i = 0; i < gray.size(); i++)
+        {
+            gray[i] = shades[captured.pixels[i] & 0x03];
+        }
+
+        std::ofstream file(directory + name, std::ios::binary);
+        file << "P5\n" << PPU_SCREEN_WIDTH << " " << PPU_SCREEN_HEIGHT << "\n255\n";
+        file.write(reinterpret_cast<const char *>(gray.data()), gray.size());
+    };
+}
@@ -0,0 +1,178 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ppu.h"
+
+// hands finished frames from emulation threads to encoder threads
+//
+// the emulation side copies the framebuffer into a buffer from a pool that
+// is allocated up front and pushes its index onto a lock-free queue, so it
+// never allocates, locks or touches a file. encoder threads pop frames, run
+// the consumer (an image or video encoder) and return the buffer to the pool.
+// when the encoders fall behind and the pool runs dry, the policy decides
+// between dropping the frame and waiting for a buffer to come back
+
+constexpr size_t FRAME_PIPE_CACHE_LINE = 64;
+
+// bounded multi-producer multi-consumer queue after Dmitry Vyukov. each cell
+// carries a sequence number that tells producers and consumers whose turn it
+// is, so both sides only contend on their own position counter
+template <typename T> struct MpmcQueue
+{
+    struct alignas(FRAME_PIPE_CACHE_LINE) Cell
+    {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    std::unique_ptr<Cell[]> cells;
+    size_t mask; // capacity - 1, the capacity is a power of two
+    alignas(FRAME_PIPE_CACHE_LINE) std::atomic<size_t> enqueue_position{0};
+    alignas(FRAME_PIPE_CACHE_LINE) std::atomic<size_t> dequeue_position{0};
+
+    explicit MpmcQueue(size_t min_capacity)
+    {
+        size_t capacity = 2;
+
+        while (capacity < min_capacity)
+        {
+            capacity *= 2;
+        }
+
+        cells = std::make_unique<Cell[]>(capacity);
+        mask = capacity - 1;
+
+        for (size_t i = 0; i < capacity; i++)
+        {
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    bool push(const T &value) // false if full
+    {
+        size_t position = enqueue_position.load(std::memory_order_relaxed);
+
+        while (true)
+        {
+            Cell &cell = cells[position & mask];
+            size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            intptr_t difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position);
+
+            if (difference == 0)
+            {
+                if (enqueue_position.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                {
+                    cell.value = value;
+                    cell.sequence.store(position + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (difference < 0)
+            {
+                return false;
+            }
+            else
+            {
+                position = enqueue_position.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    bool pop(T &value) // false if empty
+    {
+        size_t position = dequeue_position.load(std::memory_order_relaxed);
+
+        while (true)
+        {
+            Cell &cell = cells[position & mask];
+            size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            intptr_t difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position + 1);
+
+            if (difference == 0)
+            {
+                if (dequeue_position.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                {
+                    value = cell.value;
+                    cell.sequence.store(position + mask + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (difference < 0)
+            {
+                return false;
+            }
+            else
+            {
+                position = dequeue_position.load(std::memory_order_relaxed);
+            }
+        }
+    }
+};
+
+enum FramePipePolicy : uint8_t
+{
+    FRAME_PIPE_DROP,  // the emulation thread skips the frame, counted in FramePipeline::dropped
+    FRAME_PIPE_BLOCK, // the emulation thread waits for an encoder to free a buffer
+};
+
+struct CapturedFrame
+{
+    uint64_t frame;  // frame number given by the producer
+    uint32_t source; // lane or instance the frame came from
+    std::array<uint8_t, PPU_SCREEN_WIDTH * PPU_SCREEN_HEIGHT> pixels; // shade indices, as in PPU::framebuffer
+};
+
+// runs on an encoder thread. with several encoders frames of one source can
+// arrive out of order, CapturedFrame::frame tells their order
+using FrameConsumer = std::function<void(const CapturedFrame &)>;
+
+struct FramePipeline
+{
+    FramePipePolicy policy;
+    FrameConsumer consumer;
+
+    std::vector<CapturedFrame> pool; // allocated by the constructor, never resized
+    MpmcQueue<uint32_t> free_frames;  // indices of pool buffers producers can fill
+    MpmcQueue<uint32_t> ready_frames; // filled buffers waiting for an encoder
+
+    // bumped after every push, the other side sleeps in atomic wait() on them
+    std::atomic<uint32_t> ready_signal{0}; // encoders wait for frames
+    std::atomic<uint32_t> free_signal{0};  // blocked producers wait for buffers
+    std::atomic<bool> closing{false};
+
+    // statistics
+    std::atomic<uint64_t> submitted{0};
+    std::atomic<uint64_t> dropped{0};
+    std::atomic<uint64_t> encoded{0};
+
+    std::vector<std::thread> encoders;
+
+    FramePipeline(size_t pool_size, size_t num_encoders, FramePipePolicy policy, FrameConsumer consumer);
+    ~FramePipeline(); // close()s
+
+    FramePipeline(const FramePipeline &) = delete;
+    FramePipeline &operator=(const FramePipeline &) = delete;
+
+    // copy the framebuffer into the pipeline, from any emulation thread.
+    // false if the frame was dropped
+    bool submit(const PPU &ppu, uint64_t frame, uint32_t source);
+
+    // encode the frames already submitted and stop the encoders. no submit()
+    // may run concurrently or afterwards
+    void close();
+
+    void encoder_loop();
+};
+
+// writes every frame to directory/<source>_<frame>.pgm, an 8-bit grayscale
+// image any viewer or ffmpeg reads
+FrameConsumer frame_pgm_writer(const std::string &directory);
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+#include "ppu.h"
+
+// connects an instance to a display, speakers and controls. the core never
+// calls a frontend, the main loop hands it every finished frame. which one a
+// binary uses is picked at link time: frontend_null.cpp for headless runs,
+// frontend_raylib.cpp for a window
+
+struct Frontend
+{
+    virtual ~Frontend() = default;
+
+    // video, called after every frame. a frontend tracks the lines that
+    // changed since its previous call with PPU::line_dirty()
+    virtual void present(const PPU &ppu) = 0;
+
+    // audio, interleaved stereo. nothing produces samples until there's an APU
+    virtual void play(const int16_t *samples, size_t count) = 0;
+
+    virtual uint8_t poll_input() = 0; // currently pressed buttons (JOYPAD_* bits)
+    virtual bool should_close() = 0;  // the user asked to quit
+};
+
+// defined by the frontend linked into the binary
+std::unique_ptr<Frontend> make_frontend();
+
+// discards video and audio and presses nothing, for servers and benchmarks
+struct NullFrontend : Frontend
+{
+    void present(const PPU &) override {}
+    void play(const int16_t *, size_t) override {}
+    uint8_t poll_input() override { return 0; }
+    bool should_close() override { return false; }
+};
@@ -0,0 +1,6 @@
+#include "frontend.h"
+
+std::unique_ptr<Frontend> make_frontend()
+{
+    return std::make_unique<NullFrontend>();
+}
@@ -0,0 +1,85 @@
+#include "frontend.h"
+
+#include <array>
+
+#include <raylib.h>
+
+constexpr int RAYLIB_SCALE = 4;    // window pixels per Game Boy pixel
+constexpr int RAYLIB_TARGET_FPS = 60; // close enough to 59.7
+
+// shade index to 8-bit gray, 0 is the lightest
+constexpr std::array<uint8_t, 4> RAYLIB_SHADES = {0xFF, 0xAA, 0x55, 0x00};
+
+struct RaylibFrontend : Frontend
+{
+    Texture2D texture;
+    uint64_t seen_lines = 0; // PPU::line_version at the previous present()
+    std::array<uint8_t, PPU_SCREEN_WIDTH> line; // gray pixels of one line for the upload
+
+    RaylibFrontend()
+    {
+        InitWindow(PPU_SCREEN_WIDTH * RAYLIB_SCALE, PPU_SCREEN_HEIGHT * RAYLIB_SCALE, "Gameboy");
+        SetTargetFPS(RAYLIB_TARGET_FPS);
+
+        Image image = GenImageColor(PPU_SCREEN_WIDTH, PPU_SCREEN_HEIGHT, WHITE);
+        ImageFormat(&image, PIXELFORMAT_UNCOMPRESSED_GRAYSCALE);
+        texture = LoadTextureFromImage(image);
+        UnloadImage(image);
+    }
+
+    ~RaylibFrontend() override
+    {
+        UnloadTexture(texture);
+        CloseWindow();
+    }
+
+    void present(const PPU &ppu) override
+    {
+        // only lines that changed are converted and uploaded
+        for (int y = 0; y < PPU_SCREEN_HEIGHT; y++)
+        {
+            if (!ppu.line_dirty(y, seen_lines))
+            {
+                continue;
+            }
+
+            for (int x = 0; x < PPU_SCREEN_WIDTH; x++)
+            {
+                line[x] = RAYLIB_SHADES[ppu.framebuffer[y * PPU_SCREEN_WIDTH + x] & 0x03];
+            }
+
+            UpdateTextureRec(texture, Rectangle{0, static_cast<float>(y), PPU_SCREEN_WIDTH, 1}, line.data());
+        }
+
+        seen_lines = ppu.line_version;
+
+        BeginDrawing();
+        DrawTextureEx(texture, Vector2{0, 0}, 0.0f, RAYLIB_SCALE, WHITE);
+        EndDrawing();
+    }
+
+    void play(const int16_t *, size_t) override {}
+
+    uint8_t poll_input() override
+    {
+        uint8_t pressed = 0;
+
+        pressed |= IsKeyDown(KEY_RIGHT) ? JOYPAD_RIGHT : 0;
+        pressed |= IsKeyDown(KEY_LEFT) ? JOYPAD_LEFT : 0;
+        pressed |= IsKeyDown(KEY_UP) ? JOYPAD_UP : 0;
+        pressed |= IsKeyDown(KEY_DOWN) ? JOYPAD_DOWN : 0;
+        pressed |= IsKeyDown(KEY_Z) ? JOYPAD_A : 0;
+        pressed |= IsKeyDown(KEY_X) ? JOYPAD_B : 0;
+        pressed |= IsKeyDown(KEY_BACKSPACE) ? JOYPAD_SELECT : 0;
+        pressed |= IsKeyDown(KEY_ENTER) ? JOYPAD_START : 0;
+
+        return pressed;
+    }
+
+    bool should_close() override { return WindowShouldClose(); }
+};
+
+std::unique_ptr<Frontend> make_frontend()
+{
+    return std::make_unique<RaylibFrontend>();
+}
@@ -0,0 +1,151 @@
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <vector>
+
+#include "gameboy.h"
+#include "lockstep.h"
+
+// libFuzzer entry point (make fuzz, needs clang). the input is the ROM, cut
+// to CARTRIDGE_MAX_ROM_SIZE, so the fuzzer mutates code and header alike
+//
+// every input runs for FUZZ_FRAMES frames on the reference configuration,
+// the fast core without idle loop skipping, and on alternative paths that
+// have to end in exactly the same state:
+//   - idle loop skipping
+//   - a save_state() / load_state() round trip into a fresh instance halfway
+//   - FUZZ_LOCKSTEP_LANES copies in a LockstepGroup, lane i a frame ahead of
+//     lane i + 1 so their PCs diverge and the masked kernels run
+// a mismatch aborts, which libFuzzer reports as a crash. the accurate core is
+// left out, it places memory accesses differently relative to the PPU by design
+//
+// make fuzz-replay builds the same checks with a main() that runs the files
+// given on the command line, to replay crashes without libFuzzer
+
+constexpr uint64_t FUZZ_FRAMES = 4;
+constexpr size_t FUZZ_LOCKSTEP_LANES = FUZZ_FRAMES; // each lane runs at least one frame in lockstep
+
+struct FuzzResult
+{
+    uint64_t state_hash;
+    GameboyFault fault;
+    uint16_t fault_pc;
+
+    bool operator==(const FuzzResult &) const = default;
+};
+
+static void run_frames(Gameboy &gb, uint64_t frames)
+{
+    for (uint64_t frame = 0; frame < frames && gb.fault == GB_FAULT_NONE; frame++)
+    {
+        gb.run_frame();
+    }
+}
+
+static FuzzResult result_of(const Gameboy &gb)
+{
+    std::vector<uint8_t> state = gb.save_state();
+    return {cartridge_hash(state.data(), state.size()), gb.fault, gb.fault_pc};
+}
+
+static void check(const FuzzResult &reference, const FuzzResult &alternative, const char *path)
+{
+    if (reference == alternative)
+    {
+        return;
+    }
+
+    std::fprintf(stderr, "%s differs from the reference: state %016llx vs %016llx, fault %d at %04X vs %d at %04X\n",
+                 path, static_cast<unsigned long long>(alternative.state_hash),
+                 static_cast<unsigned long long>(reference.state_hash), alternative.fault, alternative.fault_pc,
+                 reference.fault, reference.fault_pc);
+    std::abort();
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    RomImage image = cartridge_make_image(std::vector<uint8_t>(data, data + std::min(size, CARTRIDGE_MAX_ROM_SIZE)));
+
+    Gameboy reference(image);
+    reference.idle_skip = false;
+    run_frames(reference, FUZZ_FRAMES);
+    FuzzResult expected = result_of(reference);
+
+    Gameboy idle_skipping(image);
+    idle_skipping.idle_skip = true;
+    run_frames(idle_skipping, FUZZ_FRAMES);
+    check(expected, result_of(idle_skipping), "idle loop skipping");
+
+    Gameboy first_half(image);
+    first_half.idle_skip = false;
+    run_frames(first_half, FUZZ_FRAMES / 2);
+
+    Gameboy second_half(image); // the fault is part of the state, so this also covers faulted instances
+    second_half.idle_skip = false;
+
+    if (!second_half.load_state(first_half.save_state()))
+    {
+        std::fprintf(stderr, "state round trip: load_state() failed\n");
+        std::abort();
+    }
+
+    run_frames(second_half, FUZZ_FRAMES - FUZZ_FRAMES / 2);
+    check(expected, result_of(second_half), "state round trip");
+
+    // lane i runs its first i frames on the scalar core. a lane leaves the
+    // group once it faulted, like run_frames() stops
+    std::vector<std::unique_ptr<Gameboy>> lanes;
+
+    for (size_t i = 0; i < FUZZ_LOCKSTEP_LANES; i++)
+    {
+        lanes.push_back(std::make_unique<Gameboy>(image));
+        lanes[i]->idle_skip = false;
+        run_frames(*lanes[i], i);
+    }
+
+    for (uint64_t frame = 0; frame < FUZZ_FRAMES; frame++)
+    {
+        Gameboy *group[FUZZ_LOCKSTEP_LANES];
+        size_t count = 0;
+
+        for (size_t i = 0; i < FUZZ_LOCKSTEP_LANES; i++)
+        {
+            if (frame + i < FUZZ_FRAMES && lanes[i]->fault == GB_FAULT_NONE)
+            {
+                group[count++] = lanes[i].get();
+            }
+        }
+
+        LockstepGroup(group, count).run_frame();
+    }
+
+    for (const auto &lane : lanes)
+    {
+        check(expected, result_of(*lane), "lockstep");
+    }
+
+    return 0;
+}
+
+#ifdef GB_FUZZ_REPLAY
+
+int main(int argc, char *argv[])
+{
+    for (int i = 1; i < argc; i++)
+    {
+        std::ifstream file(argv[i], std::ios::binary);
+        std::vector<uint8_t> input(std::istreambuf_iterator<char>(file), {});
+
+        LLVMFuzzerTestOneInput(input.data(), input.size());
+        std::printf("%s ok\n", argv[i]);
+    }
+
+    return 0;
+}
+
+#endif
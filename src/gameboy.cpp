@@ -1,120 +1,218 @@
-#include <iostream>
+#include <algorithm>
+#include <cstring>
+#include <mutex>
+#include <memory>
 #include <string>
+#include <unordered_map>
 
 #include "opcodes.h"
 #include "gameboy.h"
 
-Gameboy::Gameboy(const std::string &game_rom_filename) : ppu(mmu)
-{
-    // init memory
-
-    mmu.load_game_rom(game_rom_filename);
-
-    // init opcodes
-
-    for (size_t i = 0; i < GB_NUM_OPCODES; i++)
-    {
-        opcodes[i] = op_unimplemented;
-        cb_opcodes[i] = op_unimplemented;
-    }
-
-    opcodes[0x00] = op_0x00_NOP;
-    opcodes[0x01] = op_0x01_LD_BC_u16;
-    opcodes[0x04] = op_0x04_INC_B;
-    opcodes[0x05] = op_0x05_DEC_B;
-    opcodes[0x06] = op_0x06_LD_B_u8;
-    opcodes[0x0B] = op_0x0B_DEC_BC;
-    opcodes[0x0C] = op_0x0C_INC_C;
-    opcodes[0x0D] = op_0x0D_DEC_C;
-    opcodes[0x0E] = op_0x0E_LD_C_u8;
-    opcodes[0x11] = op_0x11_LD_DE_u16;
-    opcodes[0x12] = op_0x12_LD_DE_A;
-    opcodes[0x13] = op_0x13_INC_DE;
-    opcodes[0x15] = op_0x15_DEC_D;
-    opcodes[0x16] = op_0x16_LD_D_u8;
-    opcodes[0x17] = op_0x17_RLA;
-    opcodes[0x18] = op_0x18_JR_i8;
-    opcodes[0x19] = op_0x19_ADD_HL_DE;
-    opcodes[0x1A] = op_0x1A_LD_A_DE;
-    opcodes[0x1C] = op_0x1C_INC_E;
-    opcodes[0x1D] = op_0x1D_DEC_E;
-    opcodes[0x1E] = op_0x1E_LD_E_u8;
-    opcodes[0x20] = op_0x20_JR_NZ_i8;
-    opcodes[0x21] = op_0x21_LD_HL_u16;
-    opcodes[0x22] = op_0x22_LD_HLp_A;
-    opcodes[0x23] = op_0x23_INC_HL;
-    opcodes[0x24] = op_0x24_INC_H;
-    opcodes[0x28] = op_0x28_JR_Z_i8;
-    opcodes[0x2A] = op_0x2A_LD_A_HLp;
-    opcodes[0x2E] = op_0x2E_LD_L_u8;
-    opcodes[0x2F] = op_0x2F_CPL;
-    opcodes[0x31] = op_0x31_LD_SP_u16;
-    opcodes[0x32] = op_0x32_LD_HLm_A;
-    opcodes[0x36] = op_0x36_LD_HL_u8;
-    opcodes[0x3D] = op_0x3D_DEC_A;
-    opcodes[0x47] = op_0x47_LD_B_A;
-    opcodes[0x4F] = op_0x4F_LD_C_A;
-    opcodes[0x56] = op_0x56_LD_D_HL;
-    opcodes[0x57] = op_0x57_LD_D_A;
-    opcodes[0x5E] = op_0x5E_LD_E_HL;
-    opcodes[0x5F] = op_0x5F_LD_E_A;
-    opcodes[0x67] = op_0x67_LD_H_A;
-    opcodes[0x77] = op_0x77_LD_HL_A;
-    opcodes[0x78] = op_0x78_LD_A_B;
-    opcodes[0x79] = op_0x79_LD_A_C;
-    opcodes[0x7B] = op_0x7B_LD_A_E;
-    opcodes[0x7C] = op_0x7C_LD_A_H;
-    opcodes[0x7D] = op_0x7D_LD_A_L;
-    opcodes[0x7E] = op_0x7E_LD_A_HL;
-    opcodes[0x86] = op_0x86_ADD_A_HL;
-    opcodes[0x87] = op_0x87_ADD_A_A;
-    opcodes[0x90] = op_0x90_SUB_A_B;
-    opcodes[0x3E] = op_0x3E_LD_A_u8;
-    opcodes[0xA1] = op_0xA1_AND_A_C;
-    opcodes[0xA7] = op_0xA7_AND_A_A;
-    opcodes[0xA9] = op_0xA9_XOR_A_C;
-    opcodes[0xAF] = op_0xAF_XOR_A_A;
-    opcodes[0xB0] = op_0xB0_OR_A_B;
-    opcodes[0xB1] = op_0xB1_OR_A_C;
-    opcodes[0XBE] = op_0xBE_CP_A_HL;
-    opcodes[0xC1] = op_0xC1_POP_BC;
-    opcodes[0xC3] = op_0xC3_JP_u16;
-    opcodes[0xC5] = op_0xC5_PUSH_BC;
-    opcodes[0xC8] = op_0xC8_RET_Z;
-    opcodes[0xC9] = op_0xC9_RET;
-    opcodes[0xCA] = op_0xCA_JP_Z_u16;
-    opcodes[0xCB] = op_0xCB_prefixed;
-    opcodes[0xCD] = op_0xCD_CALL_u16;
-    opcodes[0xD1] = op_0xD1_POP_DE;
-    opcodes[0xD5] = op_0xD5_PUSH_DE;
-    opcodes[0xE0] = op_0xE0_LD_u8_A;
-    opcodes[0xE1] = op_0xE1_POP_HL;
-    opcodes[0xE2] = op_0xE2_LD_C_A;
-    opcodes[0xE5] = op_0xE5_PUSH_HL;
-    opcodes[0xE6] = op_0xE6_AND_A_u8;
-    opcodes[0xE9] = op_0xE9_JP_HL;
-    opcodes[0xEA] = op_0xEA_LD_u16_A;
-    opcodes[0xEF] = op_0xEF_RST_28h;
-    opcodes[0xF0] = op_0xF0_LD_A_FF00_u8;
-    opcodes[0xF1] = op_0xF1_POP_AF;
-    opcodes[0xF3] = op_0xF3_DI;
-    opcodes[0xF5] = op_0xF5_PUSH_AF;
-    opcodes[0xFA] = op_0xFA_LD_A_u16;
-    opcodes[0xFB] = op_0xFB_EI;
-    opcodes[0xFE] = op_0xFE_CP_A_u8;
-
-    cb_opcodes[0x11] = op_0xCB_0x11_RL_C;
-    cb_opcodes[0x37] = op_0xCB_0x37_SWAP_A;
-    cb_opcodes[0x7C] = op_0xCB_0x7C_BIT_7_H;
-    cb_opcodes[0x87] = op_0xCB_0x87_RES_0_A;
+#ifdef GB_PROFILE
+#include "profiler.h"
+#endif
+
+// instrumented builds count every executed instruction, so they don't skip any
+#if defined(GB_PROFILE) || defined(GB_TRACE_MEM) || defined(GB_TRACE_EXEC)
+constexpr bool GB_IDLE_SKIP_DEFAULT = false;
+#else
+constexpr bool GB_IDLE_SKIP_DEFAULT = true;
+#endif
+
+// validation builds can start every instance on the accurate core
+#ifdef GB_ACCURATE
+constexpr bool GB_ACCURATE_DEFAULT = true;
+#else
+constexpr bool GB_ACCURATE_DEFAULT = false;
+#endif
+
+constexpr uint32_t GB_STATE_MAGIC = 0x54534247; // "GBST"
+constexpr uint32_t GB_STATE_VERSION = 6;        // bump whenever the layout below changes
+
+uint8_t (*Gameboy::opcodes[GB_NUM_OPCODES])(Gameboy &);
+uint8_t (*Gameboy::cb_opcodes[GB_NUM_OPCODES])(Gameboy &);
+uint8_t (*Gameboy::accurate_opcodes[GB_NUM_OPCODES])(Gameboy &);
+uint8_t (*Gameboy::accurate_cb_opcodes[GB_NUM_OPCODES])(Gameboy &);
+
+void Gameboy::init_opcode_tables()
+{
+    fill_opcode_tables<false>(opcodes, cb_opcodes);
+    fill_opcode_tables<true>(accurate_opcodes, accurate_cb_opcodes);
+}
+
+Gameboy::Gameboy(const std::string &game_rom_filename, const std::string &boot_rom_filename,
+                 std::pmr::memory_resource *memory)
+    : mmu(memory), ppu(mmu), total_cycles(0), frame_deadline(0), accurate(GB_ACCURATE_DEFAULT), instruction_cycles(0),
+      fault(GB_FAULT_NONE), fault_pc(0), idle_skip(GB_IDLE_SKIP_DEFAULT), idle_candidate(false),
+      idle_skipped_cycles(0)
+{
+    if (!mmu.load_game_rom(game_rom_filename, load_error))
+    {
+        fault = GB_FAULT_ROM_LOAD;
+        return;
+    }
+
+    power_on(boot_rom_filename);
+}
+
+Gameboy::Gameboy(RomImage game_rom, const std::string &boot_rom_filename, std::pmr::memory_resource *memory)
+    : mmu(memory), ppu(mmu), total_cycles(0), frame_deadline(0), accurate(GB_ACCURATE_DEFAULT), instruction_cycles(0),
+      fault(GB_FAULT_NONE), fault_pc(0), idle_skip(GB_IDLE_SKIP_DEFAULT), idle_candidate(false),
+      idle_skipped_cycles(0)
+{
+    if (!mmu.map_game_rom(std::move(game_rom), load_error))
+    {
+        fault = GB_FAULT_ROM_LOAD;
+        return;
+    }
+
+    power_on(boot_rom_filename);
+}
+
+void Gameboy::power_on(const std::string &boot_rom_filename)
+{
+    if (mmu.cgb)
+    {
+        cpu = CPU(true); // CGB boot ROM leaves different register values
+    }
+
+    // init opcodes (once per process, the tables are shared)
+
+    static std::once_flag opcode_tables_initialized;
+    std::call_once(opcode_tables_initialized, init_opcode_tables);
+
+    if (!boot_rom_filename.empty())
+    {
+        run_boot_rom(boot_rom_filename);
+    }
 }
 
+// post-boot snapshots, keyed by a hash of the boot ROM overlay page, which
+// contains both the boot ROM and the cartridge header
+static std::mutex boot_snapshots_mutex;
+static std::unordered_map<uint64_t, std::shared_ptr<const std::vector<uint8_t>>> boot_snapshots;
+
+void Gameboy::run_boot_rom(const std::string &boot_rom_filename)
+{
+    if (!mmu.load_boot_rom(boot_rom_filename, load_error))
+    {
+        fault = GB_FAULT_ROM_LOAD;
+        return;
+    }
+
+    uint64_t key = cartridge_hash(mmu.boot_page.data(), 0x900); // boot ROM and cartridge header
+
+    std::shared_ptr<const std::vector<uint8_t>> snapshot;
+
+    {
+        std::lock_guard<std::mutex> lock(boot_snapshots_mutex);
+        auto it = boot_snapshots.find(key);
+
+        if (it != boot_snapshots.end())
+        {
+            snapshot = it->second;
+        }
+    }
+
+    if (snapshot && load_state(*snapshot))
+    {
+        mmu.boot_page.clear(); // the snapshot was taken after the boot ROM unmapped itself
+        mmu.map_banks();
+        return;
+    }
+
+    // registers start out cleared, execution begins at 0x0000
+    cpu.AF = cpu.BC = cpu.DE = cpu.HL = cpu.SP = cpu.PC = 0;
+    cpu.set_flags(0);
+
+    while (!mmu.boot_page.empty() && total_cycles < GB_BOOT_ROM_MAX_CYCLES && fault == GB_FAULT_NONE)
+    {
+        uint8_t cycles_this_step = run_opcode() >> cpu.speed_shift;
+        total_cycles += cycles_this_step;
+        ppu.step(cycles_this_step);
+    }
+
+    frame_deadline = total_cycles; // frames start counting after boot
+
+    if (fault != GB_FAULT_NONE)
+    {
+        return;
+    }
+
+    if (!mmu.boot_page.empty())
+    {
+        fault = GB_FAULT_LOCKUP; // didn't finish within GB_BOOT_ROM_MAX_CYCLES, callers report the fault
+        fault_pc = cpu.PC;
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(boot_snapshots_mutex);
+    boot_snapshots.emplace(key, std::make_shared<const std::vector<uint8_t>>(save_state()));
+}
+
+template <bool ACCURATE>
 uint8_t Gameboy::run_opcode()
 {
     bool should_enable_IME = cpu.IME_scheduled;
 
-    uint8_t opcode = mmu.read8(cpu.PC);
-    uint8_t cycles = opcodes[opcode](*this);
+#ifdef GB_PROFILE
+    uint16_t pc = cpu.PC;
+    uint8_t cb_opcode = mmu.read8(pc + 1); // only meaningful if opcode is 0xCB
+#endif
+
+#ifdef GB_TRACE_MEM
+    mmu.trace.now = total_cycles;
+    mmu.trace.cpu_active = true;
+#endif
+
+#ifdef GB_TRACE_EXEC
+    uint64_t start_cycles = total_cycles; // the accurate core's fetch already ticks the clock
+#endif
+
+    uint8_t opcode;
+    uint8_t cycles;
+
+    if constexpr (ACCURATE)
+    {
+        instruction_cycles = 0;
+        opcode = bus_read8<true>(cpu.PC); // the fetch is the first M-cycle
+
+#ifdef GB_TRACE_EXEC
+        if (exec_trace)
+        {
+            exec_trace->record(cpu, start_cycles, opcode, mmu.read8(cpu.PC + 1));
+        }
+#endif
+
+        cycles = accurate_opcodes[opcode](*this);
+
+        // internal M-cycles at the end of the instruction
+        while (instruction_cycles < cycles)
+        {
+            tick_mcycle();
+        }
+    }
+    else
+    {
+        opcode = mmu.read8(cpu.PC);
+
+#ifdef GB_TRACE_EXEC
+        if (exec_trace)
+        {
+            exec_trace->record(cpu, start_cycles, opcode, mmu.read8(cpu.PC + 1));
+        }
+#endif
+
+        cycles = opcodes[opcode](*this);
+    }
+
+#ifdef GB_PROFILE
+    profile_local().record(pc, opcode, cb_opcode, cycles);
+#endif
+
+#ifdef GB_TRACE_MEM
+    mmu.trace.cpu_active = false;
+#endif
 
     if (should_enable_IME)
     {
@@ -123,4 +221,473 @@ uint8_t Gameboy::run_opcode()
     }
 
     return cycles;
+}
+
+template uint8_t Gameboy::run_opcode<false>();
+template uint8_t Gameboy::run_opcode<true>();
+
+GameboyFault Gameboy::run_frame()
+{
+    begin_frame();
+
+    while (begin_slice())
+    {
+        if (debugger.checked())
+        {
+            accurate ? run_slice<true, true>() : run_slice<false, true>();
+        }
+        else
+        {
+            accurate ? run_slice<true, false>() : run_slice<false, false>();
+        }
+
+        end_slice();
+    }
+
+    return end_frame();
+}
+
+void Gameboy::begin_frame()
+{
+    if (fault == GB_FAULT_BREAK)
+    {
+        fault = GB_FAULT_NONE; // continue where the debugger stopped
+    }
+
+    if (total_cycles >= frame_deadline)
+    {
+        // overshoot of the previous frame is carried over into this one
+        frame_deadline += GB_CYCLES_PER_FRAME;
+
+        // the other end of a link cable only syncs with us at frame boundaries
+        mmu.serial_receive();
+    }
+
+    if (fault == GB_FAULT_STOPPED && mmu.joypad_buttons)
+    {
+        fault = GB_FAULT_NONE; // a button press ends STOP
+    }
+}
+
+// the frame runs in slices that end at the next serial event or a fault, so
+// the inner loops only compare against a deadline
+bool Gameboy::begin_slice()
+{
+    if (total_cycles >= frame_deadline || fault != GB_FAULT_NONE)
+    {
+        return false;
+    }
+
+    service_events();
+    mmu.slice_deadline = std::min(frame_deadline, mmu.serial.transfer_end);
+    return true;
+}
+
+void Gameboy::end_slice()
+{
+    // a fault raised by the same instruction takes precedence
+    if (mmu.watchpoints.hit && debugger.check_watchpoint(*this, mmu.watchpoints) && fault == GB_FAULT_NONE)
+    {
+        fault = GB_FAULT_BREAK;
+    }
+}
+
+GameboyFault Gameboy::end_frame()
+{
+    if (fault == GB_FAULT_STOPPED && total_cycles < frame_deadline)
+    {
+        total_cycles = frame_deadline; // the clock keeps running while the CPU is stopped
+    }
+
+    return fault;
+}
+
+template <bool ACCURATE, bool CHECKED>
+void Gameboy::run_slice()
+{
+    while (total_cycles < mmu.slice_deadline)
+    {
+        if constexpr (CHECKED)
+        {
+            if (debugger.check_instruction(*this))
+            {
+                fault = GB_FAULT_BREAK; // not a fault of the machine, fault_pc is left alone
+                return;
+            }
+        }
+
+        if constexpr (ACCURATE)
+        {
+            run_opcode<true>(); // ticks the clock and PPU itself
+        }
+        else
+        {
+            // total_cycles and the PPU run on the normal speed clock, in CGB
+            // double-speed mode each instruction takes half as long
+            uint8_t cycles_this_step = run_opcode() >> cpu.speed_shift;
+            total_cycles += cycles_this_step;
+            ppu.step(cycles_this_step);
+
+            if (idle_candidate)
+            {
+                idle_candidate = false;
+
+                // skipping would jump over the instructions the checked loop looks at
+                if constexpr (!CHECKED)
+                {
+                    skip_idle_loop();
+                }
+            }
+        }
+    }
+}
+
+void Gameboy::raise_fault(GameboyFault reason)
+{
+    fault = reason;
+    fault_pc = cpu.PC;
+    mmu.slice_deadline = 0;
+}
+
+const char *gb_fault_name(GameboyFault fault)
+{
+    switch (fault)
+    {
+    case GB_FAULT_NONE:
+        return "none";
+    case GB_FAULT_UNIMPLEMENTED_OPCODE:
+        return "unimplemented opcode";
+    case GB_FAULT_ILLEGAL_OPCODE:
+        return "illegal opcode";
+    case GB_FAULT_LOCKUP:
+        return "lockup";
+    case GB_FAULT_ROM_LOAD:
+        return "ROM load failed";
+    case GB_FAULT_STOPPED:
+        return "stopped";
+    case GB_FAULT_BREAK:
+        return "break";
+    }
+
+    return "unknown";
+}
+
+void Gameboy::service_events()
+{
+    Serial &serial = mmu.serial;
+
+    if (serial.start_pending)
+    {
+        // SC was written with the internal clock selected. the byte is swapped
+        // with the other side right away, SB and SC only change when the 8
+        // bits would have been shifted
+        serial.start_pending = false;
+
+        uint8_t sent = mmu.mem[0xFF01];
+        serial.record(sent);
+        serial.incoming = serial.link ? serial.link->exchange(serial.side, sent) : 0xFF;
+
+        bool fast_clock = mmu.cgb && (mmu.mem[0xFF02] & 0x02);
+        uint32_t cycles = fast_clock ? SERIAL_FAST_BYTE_CYCLES : SERIAL_BYTE_CYCLES;
+        serial.transfer_end = total_cycles + (cycles >> cpu.speed_shift);
+    }
+
+    if (total_cycles >= serial.transfer_end)
+    {
+        serial.transfer_end = SERIAL_IDLE;
+        mmu.mem[0xFF01] = serial.incoming;
+        mmu.mem[0xFF02] &= 0x7F;
+        mmu.mem[0xFF0F] |= 0x08; // serial interrupt request
+
+        if (serial.link)
+        {
+            serial.link->publish(serial.side, serial.incoming);
+        }
+    }
+}
+
+// decodes the loop at pc into loop, leaving loop.length 0 if it isn't idle.
+// an idle loop only reloads A from registers the CPU can't observe changing
+// while it spins unless the PPU changes mode, tests A with CP/AND and jumps
+// back. everything it computes is rewritten every iteration, so iterations
+// that read the same register values are identical
+static void decode_idle_loop(const MMU &mmu, uint16_t pc, uint8_t speed_shift, IdleLoop &loop)
+{
+    loop.pc = pc;
+    loop.length = 0;
+    loop.num_instructions = 0;
+    loop.reads_ly = loop.reads_stat = false;
+
+    uint32_t length = 0;
+    uint16_t address = pc;
+
+    while (loop.num_instructions < GB_IDLE_LOOP_MAX_INSTRUCTIONS)
+    {
+        uint8_t opcode = mmu.read8(address);
+        uint8_t operand = mmu.read8(address + 1);
+        uint8_t cycles;
+
+        switch (opcode)
+        {
+        case 0xF0: // LDH A,(u8)
+            // JOYP only changes between frames and HRAM only when the CPU writes it
+            if (operand != 0x44 && operand != 0x41 && operand != 0x00 && (operand < 0x80 || operand == 0xFF))
+            {
+                return;
+            }
+
+            loop.reads_ly |= operand == 0x44;
+            loop.reads_stat |= operand == 0x41;
+            cycles = 12;
+            break;
+        case 0xFE: // CP A,u8
+        case 0xE6: // AND A,u8
+            cycles = 8;
+            break;
+        case 0x18: // JR i8
+        case 0x20: // JR NZ,i8
+        case 0x28: // JR Z,i8
+            if (static_cast<uint16_t>(address + 2 + static_cast<int8_t>(operand)) != pc)
+            {
+                return;
+            }
+
+            loop.cycles[loop.num_instructions++] = 12 >> speed_shift;
+            loop.length = length + (12 >> speed_shift);
+            return;
+        default:
+            return;
+        }
+
+        loop.cycles[loop.num_instructions++] = cycles >> speed_shift;
+        length += cycles >> speed_shift;
+        address += 2;
+    }
+}
+
+// fast-forwards an idle loop whole iterations at a time, crediting their
+// cycles. the PPU is stepped at the same instruction boundaries as if the
+// loop had run, and skipping stops before any PPU event that changes what
+// the loop reads, so the result is exactly that of running it
+void Gameboy::skip_idle_loop()
+{
+    if (!idle_skip)
+    {
+        return;
+    }
+
+    IdleLoop &loop = idle_loop;
+
+    if (cpu.PC != loop.pc)
+    {
+        decode_idle_loop(mmu, cpu.PC, cpu.speed_shift, loop);
+    }
+
+    if (!loop.length)
+    {
+        return; // busy loop, nothing to skip
+    }
+
+    if (total_cycles - loop.head_cycles == loop.length && total_cycles < mmu.slice_deadline &&
+        (!loop.reads_ly || mmu.read8(0xFF44) == loop.head_ly) &&
+        (!loop.reads_stat || mmu.read8(0xFF41) == loop.head_stat))
+    {
+        // the iteration that just ended read the same values the next one
+        // will. an iteration is at most 60 cycles, shorter than any PPU
+        // mode, so equal values mean nothing changed in between
+        uint64_t start = total_cycles;
+        int pending = 0; // cycles not yet passed to the PPU
+
+        while (total_cycles + loop.length <= mmu.slice_deadline)
+        {
+            // iterations that end before the next PPU event
+            uint64_t until_event = ppu.cycles_until_event() - pending;
+            uint64_t iterations = std::min(until_event - 1, mmu.slice_deadline - total_cycles) / loop.length;
+
+            if (iterations)
+            {
+                pending += static_cast<int>(iterations * loop.length);
+                total_cycles += iterations * loop.length;
+                continue;
+            }
+
+            // the next event falls within this iteration, stop before it if
+            // it changes a register the loop reads. LY changes when HBlank
+            // or a VBlank line ends
+            uint8_t mode = mmu.read8(0xFF41) & 0x03;
+            bool ly_changes = mode == PPU_MODE_HBLANK || mode == PPU_MODE_VBLANK;
+
+            if (loop.reads_stat || (loop.reads_ly && ly_changes))
+            {
+                break;
+            }
+
+            ppu.step(pending);
+            pending = 0;
+
+            for (int i = 0; i < loop.num_instructions; i++)
+            {
+                ppu.step(loop.cycles[i]);
+            }
+
+            total_cycles += loop.length;
+        }
+
+        ppu.step(pending);
+        idle_skipped_cycles += total_cycles - start;
+    }
+
+    loop.head_cycles = total_cycles;
+    loop.head_ly = mmu.read8(0xFF44);
+    loop.head_stat = mmu.read8(0xFF41);
+}
+
+template <typename T>
+static void append_state(std::vector<uint8_t> &state, const T &value)
+{
+    size_t offset = state.size();
+    state.resize(offset + sizeof(T));
+    std::memcpy(&state[offset], &value, sizeof(T));
+}
+
+template <typename T>
+static bool read_state(const std::vector<uint8_t> &state, size_t &offset, T &value)
+{
+    if (state.size() - offset < sizeof(T))
+    {
+        return false;
+    }
+
+    std::memcpy(&value, state.data() + offset, sizeof(T));
+    offset += sizeof(T);
+    return true;
+}
+
+std::vector<uint8_t> Gameboy::save_state() const
+{
+    std::vector<uint8_t> state;
+    state.reserve(64 + mmu.mem.size());
+
+    append_state(state, GB_STATE_MAGIC);
+    append_state(state, GB_STATE_VERSION);
+
+    // states always hold materialized flags, without the operands they were
+    // computed from, so machines in the same state save the same bytes
+    CPU saved_cpu = cpu;
+    saved_cpu.flags();
+    saved_cpu.flag_lhs = saved_cpu.flag_rhs = saved_cpu.flag_result = 0;
+    append_state(state, saved_cpu);
+    append_state(state, total_cycles);
+    append_state(state, frame_deadline);
+    append_state(state, fault); // only GB_FAULT_STOPPED and GB_FAULT_BREAK are expected to be saved and resumed
+    append_state(state, fault_pc);
+    append_state(state, mmu.serial.transfer_end);
+    append_state(state, mmu.serial.incoming);
+    append_state(state, ppu.scanline_cycles);
+    append_state(state, ppu.window_line);
+    append_state(state, mmu.joypad_buttons);
+    append_state(state, mmu.cgb);
+    state.insert(state.end(), mmu.mem.begin(), mmu.mem.end());
+
+    if (mmu.save_file)
+    {
+        // battery RAM lives in the save file mapping, store it in place of the unused mem range
+        std::copy_n(mmu.save_file->data, SAVEFILE_SIZE, state.end() - MMU_ADDRESSABLE_MEM + 0xA000);
+    }
+
+    if (mmu.cgb)
+    {
+        append_state(state, mmu.bg_palettes);
+        append_state(state, mmu.obj_palettes);
+        append_state(state, mmu.hdma_source);
+        append_state(state, mmu.hdma_dest);
+        append_state(state, mmu.hdma_blocks);
+        append_state(state, mmu.hdma_active);
+        state.insert(state.end(), mmu.vram_bank1.begin(), mmu.vram_bank1.end());
+        state.insert(state.end(), mmu.wram_banks.begin(), mmu.wram_banks.end());
+    }
+
+    return state;
+}
+
+bool Gameboy::load_state(const std::vector<uint8_t> &state, bool restore_save_file)
+{
+    size_t offset = 0;
+    uint32_t magic = 0, version = 0;
+
+    if (fault == GB_FAULT_ROM_LOAD)
+    {
+        return false; // no cartridge to resume the state on
+    }
+
+    if (!read_state(state, offset, magic) || magic != GB_STATE_MAGIC ||
+        !read_state(state, offset, version) || version != GB_STATE_VERSION)
+    {
+        return false;
+    }
+
+    // the layout only depends on the CGB flag, so checking it and the size up
+    // front means a truncated or foreign state leaves the instance untouched
+    size_t cgb_offset = offset + sizeof(cpu) + sizeof(total_cycles) + sizeof(frame_deadline) +
+                        sizeof(fault) + sizeof(fault_pc) + sizeof(mmu.serial.transfer_end) + sizeof(mmu.serial.incoming) +
+                        sizeof(ppu.scanline_cycles) + sizeof(ppu.window_line) + sizeof(mmu.joypad_buttons);
+    size_t expected_size = cgb_offset + sizeof(mmu.cgb) + mmu.mem.size();
+
+    if (mmu.cgb)
+    {
+        expected_size += sizeof(mmu.bg_palettes) + sizeof(mmu.obj_palettes) + sizeof(mmu.hdma_source) +
+                         sizeof(mmu.hdma_dest) + sizeof(mmu.hdma_blocks) + sizeof(mmu.hdma_active) +
+                         mmu.vram_bank1.size() + mmu.wram_banks.size();
+    }
+
+    if (state.size() != expected_size || state[cgb_offset] != mmu.cgb)
+    {
+        return false;
+    }
+
+    read_state(state, offset, cpu);
+    read_state(state, offset, total_cycles);
+    read_state(state, offset, frame_deadline);
+    read_state(state, offset, fault);
+    read_state(state, offset, fault_pc);
+    read_state(state, offset, mmu.serial.transfer_end);
+    read_state(state, offset, mmu.serial.incoming);
+    read_state(state, offset, ppu.scanline_cycles);
+    read_state(state, offset, ppu.window_line);
+    read_state(state, offset, mmu.joypad_buttons);
+    offset += sizeof(mmu.cgb); // checked above
+
+    std::copy_n(state.begin() + offset, mmu.mem.size(), mmu.mem.begin());
+    offset += mmu.mem.size();
+
+    if (mmu.save_file && restore_save_file)
+    {
+        std::copy_n(&mmu.mem[0xA000], SAVEFILE_SIZE, mmu.save_file->data);
+        mmu.save_file->dirty_pages = (1u << (SAVEFILE_SIZE / SAVEFILE_PAGE_SIZE)) - 1;
+    }
+    else
+    {
+        mmu.save_file.reset(); // map_banks() below maps the state's cartridge RAM in mem instead
+    }
+
+    if (mmu.cgb)
+    {
+        read_state(state, offset, mmu.bg_palettes);
+        read_state(state, offset, mmu.obj_palettes);
+        read_state(state, offset, mmu.hdma_source);
+        read_state(state, offset, mmu.hdma_dest);
+        read_state(state, offset, mmu.hdma_blocks);
+        read_state(state, offset, mmu.hdma_active);
+
+        std::copy_n(state.begin() + offset, mmu.vram_bank1.size(), mmu.vram_bank1.begin());
+        offset += mmu.vram_bank1.size();
+        std::copy_n(state.begin() + offset, mmu.wram_banks.size(), mmu.wram_banks.begin());
+    }
+
+    mmu.map_banks();
+    mmu.tile_cache.invalidate_all(); // VRAM was replaced behind write8()
+    mmu.serial.start_pending = false; // SC writes are serviced before an instance is saved
+    idle_loop.pc = GB_IDLE_LOOP_NONE;
+
+    return true;
 }
\ No newline at end of file
@@ -2,24 +2,227 @@
 
 #include <cstdint>
 #include <string>
+#include <vector>
 
 #include "mmu.h"
 #include "opcodes.h"
 #include "cpu.h"
+#include "debugger.h"
 #include "ppu.h"
 
+#ifdef GB_TRACE_EXEC
+#include "exectrace.h"
+#endif
+
 // 256 "normal" opcodes and 256 CB-prefixed opcodes = 512 total
 const size_t GB_NUM_OPCODES = 256;
 
+// t-cycles per frame (154 scanlines * 456 cycles)
+constexpr uint64_t GB_CYCLES_PER_FRAME = 70224;
+
+// longest loop body the idle loop detector looks at, in bytes
+constexpr int GB_IDLE_LOOP_MAX_BYTES = 10;
+constexpr int GB_IDLE_LOOP_MAX_INSTRUCTIONS = GB_IDLE_LOOP_MAX_BYTES / 2;
+constexpr uint32_t GB_IDLE_LOOP_NONE = 0x10000; // no loop head recorded
+
+// give up on a boot ROM that hasn't unmapped itself after this many t-cycles
+constexpr uint64_t GB_BOOT_ROM_MAX_CYCLES = 16 * 1024 * 1024;
+
+// a short loop that only polls LY, STAT, JOYP or HRAM, see Gameboy::skip_idle_loop()
+struct IdleLoop
+{
+    uint32_t pc = GB_IDLE_LOOP_NONE; // loop head
+    uint32_t length = 0;             // t-cycles per iteration, 0 if the loop at pc isn't idle
+    uint8_t num_instructions = 0;    // in the loop body
+    uint8_t cycles[GB_IDLE_LOOP_MAX_INSTRUCTIONS] = {}; // t-cycles of each instruction
+    bool reads_ly = false;           // polls LY, which changes when a scanline ends
+    bool reads_stat = false;         // polls STAT, which changes on every PPU event
+
+    uint64_t head_cycles = 0;        // total_cycles when pc was last reached
+    uint8_t head_ly = 0;             // LY at that point
+    uint8_t head_stat = 0;           // STAT at that point
+};
+
+// why an instance stopped executing, see Gameboy::fault. everything but
+// GB_FAULT_STOPPED and GB_FAULT_BREAK is fatal: the instance won't run again
+// until a state is loaded, hosts of many instances quarantine it and carry on
+// with the rest
+enum GameboyFault : uint8_t
+{
+    GB_FAULT_NONE,
+    GB_FAULT_UNIMPLEMENTED_OPCODE, // no handler for the opcode at fault_pc yet
+    GB_FAULT_ILLEGAL_OPCODE,       // one of the opcodes that hang the CPU on hardware
+    GB_FAULT_LOCKUP,               // jumps to itself with no interrupt to leave, or a boot ROM that never finished
+    GB_FAULT_ROM_LOAD,             // the game or boot ROM couldn't be loaded, the instance has no cartridge
+    GB_FAULT_STOPPED,              // STOP, low power mode until a button is pressed
+    GB_FAULT_BREAK,                // stopped by the debugger mid-frame, Debugger::stop has the PC
+};
+
+inline bool gb_fault_fatal(GameboyFault fault)
+{
+    return fault != GB_FAULT_NONE && fault != GB_FAULT_STOPPED && fault != GB_FAULT_BREAK;
+}
+const char *gb_fault_name(GameboyFault fault);
+
 struct Gameboy
 {
-    uint8_t (*opcodes[GB_NUM_OPCODES])(Gameboy &);    // opcode lookup table
-    uint8_t (*cb_opcodes[GB_NUM_OPCODES])(Gameboy &); // CB-prefixed opcode lookup table
-    MMU mmu;                                          // memory management unit
-    CPU cpu;                                          // CPU registers and state
-    PPU ppu;                                          // pixel processing unit
+    // lookup tables are shared by all instances, so running many instances
+    // doesn't multiply their cache footprint
+    static uint8_t (*opcodes[GB_NUM_OPCODES])(Gameboy &);    // opcode lookup table
+    static uint8_t (*cb_opcodes[GB_NUM_OPCODES])(Gameboy &); // CB-prefixed opcode lookup table
+
+    // the same handlers instantiated for the accurate core
+    static uint8_t (*accurate_opcodes[GB_NUM_OPCODES])(Gameboy &);
+    static uint8_t (*accurate_cb_opcodes[GB_NUM_OPCODES])(Gameboy &);
+
+    MMU mmu;                 // memory management unit
+    CPU cpu;                 // CPU registers and state
+    PPU ppu;                 // pixel processing unit
+    uint64_t total_cycles;   // t-cycles executed since power on
+    uint64_t frame_deadline; // value of total_cycles at which the current frame ends
+
+    // the accurate core ticks the PPU once per M-cycle as the handlers access
+    // memory, instead of once per instruction. slower, for timing test ROMs
+    bool accurate;
+    uint8_t instruction_cycles; // t-cycles ticked so far by the current instruction, accurate core only
+
+    // set by a handler that can't go on, or by the constructor if the ROMs
+    // can't be loaded. handlers zero mmu.slice_deadline to stop right away,
+    // so the instruction loops never test for faults
+    GameboyFault fault;
+    uint16_t fault_pc; // PC of the faulting instruction
+    std::string load_error; // why, with GB_FAULT_ROM_LOAD. the core doesn't print, callers report it
+
+    // idle loop detection, see skip_idle_loop()
+    bool idle_skip;               // fast-forward loops that only poll LY/STAT/JOYP/HRAM
+    bool idle_candidate;          // set by short backward jumps, checked after each instruction
+    IdleLoop idle_loop;           // last loop head reached through a backward jump
+    uint64_t idle_skipped_cycles; // t-cycles fast-forwarded so far, for statistics
+
+    // breakpoints and stop conditions, watchpoints live in mmu.watchpoints.
+    // while breakpoints or conditions are set, run_frame() uses the checked
+    // loop and doesn't skip idle loops, so every instruction is looked at
+    Debugger debugger;
+
+#ifdef GB_TRACE_EXEC
+    ExecTraceWriter *exec_trace = nullptr; // every instruction is recorded while set, owned by the caller
+#endif
+
+    // with a boot ROM, the first instance of a cartridge runs it and later
+    // instances start from a cached snapshot of the post-boot state
+    // memory backs the address space and CGB banks, see MMU
+    Gameboy(const std::string &game_rom_filename, const std::string &boot_rom_filename = "",
+            std::pmr::memory_resource *memory = std::pmr::get_default_resource());
+    Gameboy(RomImage game_rom, const std::string &boot_rom_filename = "",
+            std::pmr::memory_resource *memory = std::pmr::get_default_resource());
+
+    void power_on(const std::string &boot_rom_filename); // shared by the constructors
+
+    static void init_opcode_tables(); // fill the shared lookup tables
+
+    void run_boot_rom(const std::string &boot_rom_filename);
+
+    // executes one instruction and returns its t-cycles. the fast core leaves
+    // advancing the clock and PPU to the caller, the accurate one ticks them itself
+    template <bool ACCURATE = false> uint8_t run_opcode();
+    void skip_idle_loop(); // called at the head of a loop after a backward jump
+    // run opcodes and PPU until the end of the current frame or a fault. after
+    // GB_FAULT_BREAK the next call finishes the interrupted frame
+    GameboyFault run_frame();
+    // run_frame() in pieces, for hosts that interleave the instructions of
+    // several instances (see LockstepGroup)
+    void begin_frame();
+    bool begin_slice(); // false once the frame is over or faulted, otherwise sets mmu.slice_deadline
+    void end_slice();   // after the slice's instructions ran
+    GameboyFault end_frame();
+    template <bool ACCURATE, bool CHECKED> void run_slice(); // instructions up to mmu.slice_deadline
+    void raise_fault(GameboyFault reason); // record a fault at PC and end the slice
+    void service_events(); // start and finish serial transfers, between slices of run_frame()
+
+    void tick_mcycle()
+    {
+        uint8_t cycles = 4 >> cpu.speed_shift; // the PPU runs on the normal speed clock
+        total_cycles += cycles;
+
+#ifdef GB_TRACE_MEM
+        // the accurate core steps the PPU mid-instruction, its STAT/LY
+        // updates aren't CPU traffic
+        bool cpu_active = mmu.trace.cpu_active;
+        mmu.trace.cpu_active = false;
+        ppu.step(cycles);
+        mmu.trace.cpu_active = cpu_active;
+#else
+        ppu.step(cycles);
+#endif
+
+        instruction_cycles += 4;
+
+#ifdef GB_TRACE_MEM
+        mmu.trace.now = total_cycles;
+#endif
+    }
+
+    // memory accesses of opcode handlers. with ACCURATE each one completes an
+    // M-cycle first, so it happens on the same cycle relative to the PPU as on
+    // hardware. 16-bit accesses take two M-cycles, stack writes go high byte first
+    template <bool ACCURATE> uint8_t bus_read8(uint16_t address)
+    {
+        if constexpr (ACCURATE)
+        {
+            tick_mcycle();
+        }
+
+        return mmu.read8(address);
+    }
+
+    template <bool ACCURATE> void bus_write8(uint16_t address, uint8_t value)
+    {
+        if constexpr (ACCURATE)
+        {
+            tick_mcycle();
+        }
+
+        mmu.write8(address, value);
+    }
+
+    template <bool ACCURATE> uint16_t bus_read16(uint16_t address)
+    {
+        if constexpr (ACCURATE)
+        {
+            uint8_t low = bus_read8<true>(address);
+            return low | (bus_read8<true>(address + 1) << 8);
+        }
+
+        return mmu.read16(address);
+    }
+
+    template <bool ACCURATE> void bus_write16(uint16_t address, uint16_t value)
+    {
+        if constexpr (ACCURATE)
+        {
+            bus_write8<true>(address + 1, value >> 8);
+            bus_write8<true>(address, value & 0xFF);
+            return;
+        }
+
+        mmu.write16(address, value);
+    }
+
+    // an M-cycle without memory access that comes before later accesses
+    template <bool ACCURATE> void bus_idle()
+    {
+        if constexpr (ACCURATE)
+        {
+            tick_mcycle();
+        }
+    }
 
-    Gameboy(const std::string &game_rom_filename);
+    std::vector<uint8_t> save_state() const;           // serialize the full machine state
 
-    uint8_t run_opcode();
+    // restore a state from save_state(). the state's cartridge RAM only goes
+    // to an attached .sav file if restore_save_file is set. otherwise the
+    // file is flushed and detached, keeping what the game last saved to it,
+    // and the instance runs on in-memory cartridge RAM from then on, so
+    // resetting to an initial state doesn't wipe the player's save
+    bool load_state(const std::vector<uint8_t> &state, bool restore_save_file = false);
 };
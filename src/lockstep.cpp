@@ -0,0 +1,554 @@
+#include <algorithm>
+#include <bit>
+
+#include "lockstep.h"
+
+// instrumented builds count every executed instruction, so they don't vectorise any
+#if defined(GB_PROFILE) || defined(GB_TRACE_MEM) || defined(GB_TRACE_EXEC)
+constexpr bool LOCKSTEP_VECTORIZE = false;
+#else
+constexpr bool LOCKSTEP_VECTORIZE = true;
+#endif
+
+// the vectors are passed by reference, by value their ABI would depend on
+// whether AVX is enabled
+
+static inline void blend8(LockstepBytes &reg, const LockstepBytes &value, const LockstepBytes &mask)
+{
+    reg = (value & mask) | (reg & ~mask);
+}
+
+static inline void blend16(LockstepWords &reg, const LockstepWords &value, const LockstepWords &mask)
+{
+    reg = (value & mask) | (reg & ~mask);
+}
+
+static inline void join16(const LockstepBytes &high, const LockstepBytes &low, LockstepWords &pair)
+{
+    pair = (__builtin_convertvector(high, LockstepWords) << 8) | __builtin_convertvector(low, LockstepWords);
+}
+
+static inline void split16(const LockstepWords &pair, LockstepBytes &high, LockstepBytes &low, const LockstepBytes &mask)
+{
+    blend8(high, __builtin_convertvector(pair >> 8, LockstepBytes), mask);
+    blend8(low, __builtin_convertvector(pair, LockstepBytes), mask);
+}
+
+// the flag bit in the lanes where a comparison holds. comparisons give -1
+// for true, which converts to all bits set
+template <typename Mask> static inline LockstepBytes flag_if(const Mask &condition, uint8_t flag)
+{
+    return __builtin_convertvector(condition, LockstepBytes) & flag;
+}
+
+// lanes only leave lockstep for a whole frame
+static bool lockstep_supported(const Gameboy &gb)
+{
+    return !gb.accurate && !gb.debugger.checked() && gb.mmu.watchpoints.list.empty();
+}
+
+LockstepGroup::LockstepGroup(Gameboy *const *group_lanes, size_t count)
+    : regs{}, num_lanes(std::min(count, LOCKSTEP_LANES)), lane_bits{}, rom(nullptr), rom_mapped(0), lag{}, budget{},
+      speed_shift{}, ime_scheduled(0), due(0)
+{
+    if (num_lanes && group_lanes[0]->mmu.rom_image)
+    {
+        rom = group_lanes[0]->mmu.rom_image->data();
+    }
+
+    for (size_t i = 0; i < num_lanes; i++)
+    {
+        lanes[i] = group_lanes[i];
+        lane_bits[i] = static_cast<uint16_t>(1u << i);
+    }
+}
+
+void LockstepGroup::run_frame()
+{
+    uint32_t locked = 0;  // lanes run here this frame
+    uint32_t running = 0; // of those, the ones whose frame isn't over
+
+    for (size_t i = 0; i < num_lanes; i++)
+    {
+        Gameboy &gb = *lanes[i];
+
+        if (!lockstep_supported(gb))
+        {
+            gb.run_frame();
+            continue;
+        }
+
+        load(i);
+        lag[i] = 0;
+        gb.begin_frame();
+        locked |= 1u << i;
+
+        if (gb.begin_slice())
+        {
+            running |= 1u << i;
+        }
+    }
+
+    due = running;
+
+    while (true)
+    {
+        for (uint32_t pending = due; pending; pending &= pending - 1)
+        {
+            if (!settle(std::countr_zero(pending)))
+            {
+                running &= ~(pending & -pending);
+            }
+        }
+
+        due = 0;
+
+        if (!running)
+        {
+            break;
+        }
+
+        step(running);
+    }
+
+    for (uint32_t pending = locked; pending; pending &= pending - 1)
+    {
+        size_t i = std::countr_zero(pending);
+        store(i);
+        lanes[i]->end_frame();
+    }
+}
+
+void LockstepGroup::step(uint32_t running)
+{
+    uint32_t pending = running;
+
+    while (pending)
+    {
+        // the lanes at the same PC as the first one left
+        size_t leader = std::countr_zero(pending);
+        uint16_t pc = regs.PC[leader];
+        LockstepWords same_pc = __builtin_convertvector(regs.PC == pc, LockstepWords) & lane_bits;
+        uint32_t group = 0;
+
+        for (size_t i = 0; i < num_lanes; i++)
+        {
+            group |= same_pc[i];
+        }
+
+        group &= pending;
+        pending &= ~group;
+
+        // ROM is immutable, so an instruction there is the same in every
+        // lane that maps the same image
+        uint32_t shared = group & rom_mapped;
+
+        if (LOCKSTEP_VECTORIZE && shared && pc <= 0x7FFD && execute(rom + pc, shared))
+        {
+            vector_instructions += std::popcount(shared);
+            group &= ~shared;
+        }
+
+        for (uint32_t lanes_left = group; lanes_left; lanes_left &= lanes_left - 1)
+        {
+            step_scalar(std::countr_zero(lanes_left));
+        }
+    }
+}
+
+void LockstepGroup::step_scalar(size_t lane)
+{
+    Gameboy &gb = *lanes[lane];
+
+    catch_up(lane); // the instruction may read LY or STAT
+    store(lane);
+
+    // the bookkeeping of Gameboy::run_slice() after a fast-core instruction
+    uint8_t cycles_this_step = gb.run_opcode() >> gb.cpu.speed_shift;
+    gb.total_cycles += cycles_this_step;
+    gb.ppu.step(cycles_this_step);
+
+    if (gb.idle_candidate)
+    {
+        gb.idle_candidate = false;
+        gb.skip_idle_loop();
+    }
+
+    load(lane);
+    due |= 1u << lane;
+    scalar_instructions++;
+}
+
+// kernels for the opcodes the loops of most games spend their time in,
+// matching the fast core's handlers in opcodes.cpp bit for bit. memory
+// accesses, stack operations, STOP and anything else stay on the scalar core
+bool LockstepGroup::execute(const uint8_t *code, uint32_t group)
+{
+    LockstepWords word_mask = __builtin_convertvector((lane_bits & static_cast<uint16_t>(group)) != 0, LockstepWords);
+    LockstepBytes mask = __builtin_convertvector(word_mask, LockstepBytes);
+
+    // register operands of the opcode encoding, index 6 is (HL)
+    LockstepBytes *r8[8] = {&regs.B, &regs.C, &regs.D, &regs.E, &regs.H, &regs.L, nullptr, &regs.A};
+
+    LockstepBytes cycles = LockstepBytes{} + 4;
+    LockstepBytes flags = regs.F;
+    uint32_t idle = 0; // lanes that took a short backward jump
+    LockstepWords next_pc = regs.PC + 1;
+    LockstepWords pair;
+    uint8_t opcode = code[0];
+
+    switch (opcode)
+    {
+    case 0x00: // NOP
+        break;
+    case 0x47: // LD r,r
+    case 0x4F:
+    case 0x57:
+    case 0x5F:
+    case 0x67:
+    case 0x78:
+    case 0x79:
+    case 0x7B:
+    case 0x7C:
+    case 0x7D:
+        blend8(*r8[(opcode >> 3) & 7], *r8[opcode & 7], mask);
+        break;
+    case 0x06: // LD r,u8
+    case 0x0E:
+    case 0x16:
+    case 0x1E:
+    case 0x2E:
+    case 0x3E:
+        blend8(*r8[(opcode >> 3) & 7], LockstepBytes{} + code[1], mask);
+        next_pc = regs.PC + 2;
+        cycles = LockstepBytes{} + 8;
+        break;
+    case 0x04: // INC r
+    case 0x0C:
+    case 0x1C:
+    case 0x24:
+    {
+        LockstepBytes &reg = *r8[(opcode >> 3) & 7];
+        LockstepBytes result = reg + 1;
+        flags = (flags & CPU_FLAG_C) | flag_if(result == 0, CPU_FLAG_Z) | flag_if((result & 0x0F) == 0, CPU_FLAG_H);
+        blend8(reg, result, mask);
+        break;
+    }
+    case 0x05: // DEC r
+    case 0x0D:
+    case 0x15:
+    case 0x1D:
+    case 0x3D:
+    {
+        LockstepBytes &reg = *r8[(opcode >> 3) & 7];
+        LockstepBytes result = reg - 1;
+        flags = (flags & CPU_FLAG_C) | CPU_FLAG_N | flag_if(result == 0, CPU_FLAG_Z) |
+                flag_if((result & 0x0F) == 0x0F, CPU_FLAG_H);
+        blend8(reg, result, mask);
+        break;
+    }
+    case 0x01: // LD BC,u16
+        split16(LockstepWords{} + static_cast<uint16_t>(code[1] | (code[2] << 8)), regs.B, regs.C, mask);
+        next_pc = regs.PC + 3;
+        cycles = LockstepBytes{} + 12;
+        break;
+    case 0x11: // LD DE,u16
+        split16(LockstepWords{} + static_cast<uint16_t>(code[1] | (code[2] << 8)), regs.D, regs.E, mask);
+        next_pc = regs.PC + 3;
+        cycles = LockstepBytes{} + 12;
+        break;
+    case 0x21: // LD HL,u16
+        split16(LockstepWords{} + static_cast<uint16_t>(code[1] | (code[2] << 8)), regs.H, regs.L, mask);
+        next_pc = regs.PC + 3;
+        cycles = LockstepBytes{} + 12;
+        break;
+    case 0x31: // LD SP,u16
+        blend16(regs.SP, LockstepWords{} + static_cast<uint16_t>(code[1] | (code[2] << 8)), word_mask);
+        next_pc = regs.PC + 3;
+        cycles = LockstepBytes{} + 12;
+        break;
+    case 0x0B: // DEC BC
+        join16(regs.B, regs.C, pair);
+        split16(pair - 1, regs.B, regs.C, mask);
+        cycles = LockstepBytes{} + 8;
+        break;
+    case 0x13: // INC DE
+        join16(regs.D, regs.E, pair);
+        split16(pair + 1, regs.D, regs.E, mask);
+        cycles = LockstepBytes{} + 8;
+        break;
+    case 0x23: // INC HL
+        join16(regs.H, regs.L, pair);
+        split16(pair + 1, regs.H, regs.L, mask);
+        cycles = LockstepBytes{} + 8;
+        break;
+    case 0x19: // ADD HL,DE
+    {
+        LockstepWords de;
+        join16(regs.H, regs.L, pair);
+        join16(regs.D, regs.E, de);
+        LockstepWords result = pair + de;
+        flags = (flags & CPU_FLAG_Z) | flag_if(((pair & 0x0FFF) + (de & 0x0FFF)) > 0x0FFF, CPU_FLAG_H) |
+                flag_if(result < pair, CPU_FLAG_C);
+        split16(result, regs.H, regs.L, mask);
+        cycles = LockstepBytes{} + 8;
+        break;
+    }
+    case 0x87: // ADD A,A
+    {
+        LockstepBytes result = regs.A + regs.A;
+        flags = flag_if(result == 0, CPU_FLAG_Z) | flag_if((regs.A & 0x0F) > 0x07, CPU_FLAG_H) |
+                flag_if(regs.A > 0x7F, CPU_FLAG_C);
+        blend8(regs.A, result, mask);
+        break;
+    }
+    case 0xA1: // AND A,r
+    case 0xA7:
+    {
+        LockstepBytes result = regs.A & *r8[opcode & 7];
+        flags = CPU_FLAG_H | flag_if(result == 0, CPU_FLAG_Z);
+        blend8(regs.A, result, mask);
+        break;
+    }
+    case 0xA9: // XOR A,r
+    case 0xAF:
+    {
+        LockstepBytes result = regs.A ^ *r8[opcode & 7];
+        flags = flag_if(result == 0, CPU_FLAG_Z);
+        blend8(regs.A, result, mask);
+        break;
+    }
+    case 0xB0: // OR A,r
+    case 0xB1:
+    {
+        LockstepBytes result = regs.A | *r8[opcode & 7];
+        flags = flag_if(result == 0, CPU_FLAG_Z);
+        blend8(regs.A, result, mask);
+        break;
+    }
+    case 0xE6: // AND A,u8
+    {
+        LockstepBytes result = regs.A & code[1];
+        flags = CPU_FLAG_H | flag_if(result == 0, CPU_FLAG_Z);
+        blend8(regs.A, result, mask);
+        next_pc = regs.PC + 2;
+        cycles = LockstepBytes{} + 8;
+        break;
+    }
+    case 0xFE: // CP A,u8
+        flags = CPU_FLAG_N | flag_if(regs.A == code[1], CPU_FLAG_Z) |
+                flag_if((regs.A & 0x0F) < static_cast<uint8_t>(code[1] & 0x0F), CPU_FLAG_H) | flag_if(regs.A < code[1], CPU_FLAG_C);
+        next_pc = regs.PC + 2;
+        cycles = LockstepBytes{} + 8;
+        break;
+    case 0x2F: // CPL
+        blend8(regs.A, ~regs.A, mask);
+        flags |= CPU_FLAG_N | CPU_FLAG_H;
+        break;
+    case 0x17: // RLA
+    {
+        LockstepBytes result = (regs.A << 1) | ((flags & CPU_FLAG_C) >> 4);
+        flags = (regs.A >> 7) * CPU_FLAG_C;
+        blend8(regs.A, result, mask);
+        break;
+    }
+    case 0x18: // JR i8
+    case 0x20: // JR NZ,i8
+    case 0x28: // JR Z,i8
+    {
+        int8_t offset = static_cast<int8_t>(code[1]);
+
+        if (opcode == 0x18 && offset == -2)
+        {
+            return false; // a lockup unless an interrupt can leave it, the handler checks
+        }
+
+        LockstepWords zero = __builtin_convertvector(__builtin_convertvector(flags & CPU_FLAG_Z, LockstepWords) != 0,
+                                                     LockstepWords);
+        LockstepWords taken = opcode == 0x18 ? LockstepWords{} + 0xFFFF : opcode == 0x28 ? zero : ~zero;
+
+        next_pc = regs.PC + 2;
+        blend16(next_pc, next_pc + static_cast<uint16_t>(offset), taken);
+        cycles = 8 + (__builtin_convertvector(taken, LockstepBytes) & 4);
+
+        if (offset < 0 && offset >= -GB_IDLE_LOOP_MAX_BYTES)
+        {
+            for (size_t i = 0; i < num_lanes; i++)
+            {
+                idle |= (taken[i] & 1u) << i;
+            }
+        }
+
+        break;
+    }
+    case 0xC3: // JP u16
+        next_pc = LockstepWords{} + static_cast<uint16_t>(code[1] | (code[2] << 8));
+        cycles = LockstepBytes{} + 16;
+        break;
+    case 0xCA: // JP Z,u16
+    {
+        LockstepWords zero = __builtin_convertvector(__builtin_convertvector(flags & CPU_FLAG_Z, LockstepWords) != 0,
+                                                     LockstepWords);
+        next_pc = regs.PC + 3;
+        blend16(next_pc, LockstepWords{} + static_cast<uint16_t>(code[1] | (code[2] << 8)), zero);
+        cycles = 12 + (__builtin_convertvector(zero, LockstepBytes) & 4);
+        break;
+    }
+    case 0xCB:
+        next_pc = regs.PC + 2;
+        cycles = LockstepBytes{} + 8;
+
+        switch (code[1])
+        {
+        case 0x11: // RL C
+        {
+            LockstepBytes result = (regs.C << 1) | ((flags & CPU_FLAG_C) >> 4);
+            flags = flag_if(result == 0, CPU_FLAG_Z) | (regs.C >> 7) * CPU_FLAG_C;
+            blend8(regs.C, result, mask);
+            break;
+        }
+        case 0x37: // SWAP A
+        {
+            LockstepBytes result = (regs.A << 4) | (regs.A >> 4);
+            flags = flag_if(result == 0, CPU_FLAG_Z);
+            blend8(regs.A, result, mask);
+            break;
+        }
+        case 0x7C: // BIT 7,H
+            flags = (flags & CPU_FLAG_C) | CPU_FLAG_H | flag_if((regs.H & 0x80) == 0, CPU_FLAG_Z);
+            break;
+        case 0x87: // RES 0,A
+            blend8(regs.A, regs.A & 0xFE, mask);
+            break;
+        default:
+            return false;
+        }
+
+        break;
+    default:
+        return false;
+    }
+
+    blend8(regs.F, flags, mask);
+    blend16(regs.PC, next_pc, word_mask);
+    retire(group, cycles, idle & group);
+    return true;
+}
+
+void LockstepGroup::retire(uint32_t group, const LockstepBytes &cycles, uint32_t idle)
+{
+    LockstepWords word_mask = __builtin_convertvector((lane_bits & static_cast<uint16_t>(group)) != 0, LockstepWords);
+    lag += __builtin_convertvector(cycles >> speed_shift, LockstepWords) & word_mask;
+
+    LockstepWords over = __builtin_convertvector(lag >= budget, LockstepWords) & lane_bits;
+    uint32_t reached = 0;
+
+    for (size_t i = 0; i < num_lanes; i++)
+    {
+        reached |= over[i];
+    }
+
+    due |= reached & group;
+
+    // what Gameboy::run_opcode() does around the handler
+    for (uint32_t lanes_left = ime_scheduled & group; lanes_left; lanes_left &= lanes_left - 1)
+    {
+        CPU &cpu = lanes[std::countr_zero(lanes_left)]->cpu;
+        cpu.IME = true;
+        cpu.IME_scheduled = false;
+    }
+
+    ime_scheduled &= ~group;
+
+    // a short backward jump, Gameboy::skip_idle_loop() looks at the clock right away
+    for (uint32_t lanes_left = idle; lanes_left; lanes_left &= lanes_left - 1)
+    {
+        size_t i = std::countr_zero(lanes_left);
+        Gameboy &gb = *lanes[i];
+
+        catch_up(i);
+        gb.cpu.PC = regs.PC[i]; // the loop head it decodes
+        gb.skip_idle_loop();
+        due |= 1u << i;
+    }
+}
+
+void LockstepGroup::catch_up(size_t lane)
+{
+    Gameboy &gb = *lanes[lane];
+    uint16_t cycles = lag[lane];
+
+    if (cycles)
+    {
+        gb.total_cycles += cycles;
+        gb.ppu.step(cycles);
+        lag[lane] = 0;
+    }
+}
+
+bool LockstepGroup::settle(size_t lane)
+{
+    Gameboy &gb = *lanes[lane];
+
+    catch_up(lane);
+
+    // the slice loop of Gameboy::run_frame()
+    while (gb.total_cycles >= gb.mmu.slice_deadline)
+    {
+        gb.end_slice();
+
+        if (!gb.begin_slice())
+        {
+            return false;
+        }
+    }
+
+    uint64_t slice_left = gb.mmu.slice_deadline - gb.total_cycles;
+    int64_t until_event = std::max(gb.ppu.cycles_until_event(), 0);
+    budget[lane] = static_cast<uint16_t>(std::min<uint64_t>({slice_left, static_cast<uint64_t>(until_event), LOCKSTEP_MAX_LAG}));
+    return true;
+}
+
+void LockstepGroup::load(size_t lane)
+{
+    CPU &cpu = lanes[lane]->cpu;
+
+    regs.A[lane] = cpu.AF_bytes.A;
+    regs.F[lane] = cpu.flags();
+    regs.B[lane] = cpu.BC_bytes.B;
+    regs.C[lane] = cpu.BC_bytes.C;
+    regs.D[lane] = cpu.DE_bytes.D;
+    regs.E[lane] = cpu.DE_bytes.E;
+    regs.H[lane] = cpu.HL_bytes.H;
+    regs.L[lane] = cpu.HL_bytes.L;
+    regs.SP[lane] = cpu.SP;
+    regs.PC[lane] = cpu.PC;
+    speed_shift[lane] = cpu.speed_shift;
+
+    // banks only switch through writes, which only scalar instructions do
+    uint32_t mapped = rom != nullptr;
+
+    for (size_t page = 0; page < 0x8; page++)
+    {
+        mapped &= lanes[lane]->mmu.read_pages[page] == rom + page * MMU_PAGE_SIZE;
+    }
+
+    rom_mapped = (rom_mapped & ~(1u << lane)) | mapped << lane;
+    ime_scheduled = (ime_scheduled & ~(1u << lane)) | static_cast<uint32_t>(cpu.IME_scheduled) << lane;
+}
+
+void LockstepGroup::store(size_t lane)
+{
+    CPU &cpu = lanes[lane]->cpu;
+
+    cpu.AF_bytes.A = regs.A[lane];
+    cpu.set_flags(regs.F[lane]);
+    cpu.BC_bytes.B = regs.B[lane];
+    cpu.BC_bytes.C = regs.C[lane];
+    cpu.DE_bytes.D = regs.D[lane];
+    cpu.DE_bytes.E = regs.E[lane];
+    cpu.HL_bytes.H = regs.H[lane];
+    cpu.HL_bytes.L = regs.L[lane];
+    cpu.SP = regs.SP[lane];
+    cpu.PC = regs.PC[lane];
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#include "gameboy.h"
+
+// steps a group of instances of the same ROM together, one instruction of
+// every lane at a time, with the CPU registers stored as structure of arrays
+//
+// each step the lanes are grouped by PC. a group whose instruction is one of
+// the common register-only opcodes runs as a single vector operation over all
+// lanes, masked to the lanes of the group, so e.g. a JR NZ that some lanes
+// take and others don't updates each lane's PC and cycles from its own Z
+// flag. lanes whose PC diverged from the rest, instructions touching memory
+// and everything else run on the scalar core one lane at a time.
+//
+// vectorised instructions don't touch memory, so nothing can observe a
+// lane's clock and PPU while only they run. they just add up their cycles,
+// and a lane catches up when the sum reaches its next PPU event or the end
+// of its slice, or before it runs a scalar instruction. the PPU only changes
+// LY and STAT at events, so stepping it by the sum is the same as stepping
+// it instruction by instruction, and a lane ends up in the same state as
+// after Gameboy::run_frame().
+//
+// the vectors are GCC vector extensions, the compiler lowers them to AVX2 or
+// AVX-512 with -march=native and to SSE2 otherwise. instrumented builds
+// (GB_PROFILE, GB_TRACE_MEM, GB_TRACE_EXEC) record every instruction in
+// Gameboy::run_opcode(), so they run everything on the scalar core
+//
+// it is slower than the scalar core so far: make bench-lockstep on 64 lanes
+// of bench/roms.txt runs 0.65x (mem.gb) to 0.98x (alu.gb) of the scalar
+// instructions per second, with 33-81% of them vectorised. grouping by PC
+// and catching up lanes for every scalar instruction costs more than the
+// vector kernels save, which is why GameboyBatch::lockstep is off by default.
+// src/fuzz.cpp checks that it ends in the same state as the scalar core
+
+constexpr size_t LOCKSTEP_LANES = 16;
+
+typedef uint8_t LockstepBytes __attribute__((vector_size(LOCKSTEP_LANES)));      // an 8-bit register of every lane
+typedef uint16_t LockstepWords __attribute__((vector_size(2 * LOCKSTEP_LANES))); // a 16-bit register of every lane
+
+static_assert(LOCKSTEP_LANES <= 16, "lane_bits are 16-bit");
+
+// registers of every lane, authoritative while LockstepGroup::run_frame()
+// runs. F always holds materialized flags
+struct LockstepRegisters
+{
+    LockstepBytes A, F, B, C, D, E, H, L;
+    LockstepWords SP, PC;
+};
+
+constexpr uint16_t LOCKSTEP_MAX_LAG = 0x8000; // budgets are capped here, so lags can't overflow
+
+struct LockstepGroup
+{
+    LockstepRegisters regs;
+    std::array<Gameboy *, LOCKSTEP_LANES> lanes{}; // not owned
+    size_t num_lanes;
+    LockstepWords lane_bits; // 1 << lane, turns lane masks into vector masks
+    const uint8_t *rom;      // image of the first lane, null if it has none
+    uint32_t rom_mapped;     // lanes whose ROM pages all map it, without a boot ROM on top
+
+    // per lane timing, see above
+    LockstepWords lag;         // t-cycles run since Gameboy::total_cycles and the PPU were last advanced
+    LockstepWords budget;      // lag at which they have to catch up
+    LockstepBytes speed_shift; // CPU::speed_shift
+    uint32_t ime_scheduled;    // lanes with CPU::IME_scheduled set
+    uint32_t due;              // lanes that reached their budget or ran a scalar instruction this step
+
+    // instructions run so far, counted per lane
+    uint64_t vector_instructions = 0; // by the vector kernels
+    uint64_t scalar_instructions = 0; // by Gameboy::run_opcode()
+
+    // up to LOCKSTEP_LANES instances, usually sharing one RomImage: only
+    // lanes that map the first lane's image run vectorised
+    LockstepGroup(Gameboy *const *group_lanes, size_t count);
+
+    // advance every lane by one frame, like Gameboy::run_frame() on each.
+    // lanes on the accurate core or with breakpoints, conditions or
+    // watchpoints just run Gameboy::run_frame() first
+    void run_frame();
+
+    void step(uint32_t running);       // one instruction on each lane in running
+    void step_scalar(size_t lane);     // one instruction on the scalar core
+    bool execute(const uint8_t *code, uint32_t group); // false if the opcode has no vector kernel
+    void retire(uint32_t group, const LockstepBytes &cycles, uint32_t idle); // lag, IME and idle loops after a vector step
+
+    void catch_up(size_t lane); // advance the lane's clock and PPU by its lag
+    bool settle(size_t lane);   // catch up, move on to the next slice if needed and set the budget, false when the frame is over
+
+    void load(size_t lane);  // Gameboy::cpu into regs
+    void store(size_t lane); // regs into Gameboy::cpu
+};
@@ -1,17 +1,98 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <string>
+
+#include "framepipe.h"
+#include "frontend.h"
 #include "gameboy.h"
 
-int main()
+// gameboy <rom_file> [max_frames] [record_directory]
+//
+// runs until the frontend closes, or for max_frames frames if given. the
+// headless build has nothing to close, it reports its speed when it's done.
+// with a record directory every frame is written there as a PGM image by
+// encoder threads, the emulation loop only copies the framebuffer.
+// built with -DGB_TRACE_EXEC, every instruction goes to MAIN_EXEC_TRACE_FILE,
+// read it with gameboy_exectrace
+
+constexpr size_t MAIN_RECORD_POOL_FRAMES = 64;
+constexpr size_t MAIN_RECORD_ENCODERS = 2;
+constexpr const char *MAIN_EXEC_TRACE_FILE = "gameboy.gbxt";
+
+int main(int argc, char *argv[])
 {
-    Gameboy gb("test_roms/game.gb");
+    const std::string game_rom_filename = argc > 1 ? argv[1] : "test_roms/game.gb";
+    uint64_t max_frames = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 0; // 0 = no limit
 
-    uint64_t cycles = 0;
+    Gameboy gb(game_rom_filename);
 
-    while (true)
+    if (gb.fault == GB_FAULT_ROM_LOAD)
     {
-        uint8_t cycles_this_step = gb.run_opcode();
-        cycles += cycles_this_step;
-        gb.ppu.step(cycles_this_step);
+        std::fprintf(stderr, "%s\n", gb.load_error.c_str());
+        return 1;
     }
 
+    if (gb.mmu.has_battery())
+    {
+        // keep cartridge RAM next to the ROM, e.g. game.gb -> game.sav
+        savefile_flusher_start();
+        gb.mmu.attach_save_file(std::filesystem::path(game_rom_filename).replace_extension(".sav").string());
+    }
+
+    std::unique_ptr<Frontend> frontend = make_frontend();
+    std::unique_ptr<FramePipeline> recorder;
+
+    if (argc > 3)
+    {
+        // a recording should have every frame, so emulation waits for the encoders
+        recorder = std::make_unique<FramePipeline>(MAIN_RECORD_POOL_FRAMES, MAIN_RECORD_ENCODERS, FRAME_PIPE_BLOCK,
+                                                   frame_pgm_writer(argv[3]));
+    }
+
+#ifdef GB_TRACE_EXEC
+    ExecTraceWriter exec_trace; // closed on every way out, so a fault leaves a complete trace
+
+    if (exec_trace.open(MAIN_EXEC_TRACE_FILE))
+    {
+        gb.exec_trace = &exec_trace;
+    }
+#endif
+
+    auto start = std::chrono::steady_clock::now();
+    uint64_t frames = 0;
+
+    while ((!max_frames || frames < max_frames) && !frontend->should_close())
+    {
+        gb.mmu.set_buttons(frontend->poll_input());
+
+        if (gb_fault_fatal(gb.run_frame()))
+        {
+            std::fprintf(stderr, "Stopped at PC %04X: %s\n", gb.fault_pc, gb_fault_name(gb.fault));
+            return 1;
+        }
+
+        if (recorder)
+        {
+            recorder->submit(gb.ppu, frames, 0);
+        }
+
+        frontend->present(gb.ppu);
+        frames++;
+    }
+
+    if (recorder)
+    {
+        recorder->close();
+        std::fprintf(stderr, "%llu frames recorded, %llu dropped\n",
+                     static_cast<unsigned long long>(recorder->encoded.load()),
+                     static_cast<unsigned long long>(recorder->dropped.load()));
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::fprintf(stderr, "%llu frames in %.3f s, %.1f fps\n", static_cast<unsigned long long>(frames), seconds,
+                 frames / seconds);
+
     return 0;
 }
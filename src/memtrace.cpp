@@ -0,0 +1,124 @@
+#include "memtrace.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <numeric>
+#include <vector>
+
+void MemTrace::record(uint16_t address, uint8_t value, bool write, uint8_t stat)
+{
+    if (!cpu_active)
+    {
+        return;
+    }
+
+    uint8_t page = address >> 8;
+    uint8_t mode = stat & MEMTRACE_MODE;
+
+    (write ? page_writes : page_reads)[page]++;
+
+    if (mode >= 2) // OAM scan or drawing
+    {
+        vram_during_oam_drawing += (address >= 0x8000 && address < 0xA000);
+        oam_during_oam_drawing += (address >= 0xFE00 && address < 0xFEA0);
+    }
+
+    if (address >= 0xFF00 && address < 0xFF80)
+    {
+        (write ? io_writes : io_reads)[address - 0xFF00]++;
+
+        MemAccessEvent &event = ring[ring_events++ & (MEMTRACE_RING_SIZE - 1)];
+        event.cycle = now;
+        event.address = address;
+        event.value = value;
+        event.flags = (write ? MEMTRACE_WRITE : 0) | mode;
+    }
+}
+
+void MemTrace::clear()
+{
+    *this = MemTrace{};
+}
+
+static void append_counts(std::string &out, const char *key, const std::array<uint64_t, 256> &counts)
+{
+    char number[32];
+
+    out += "  \"";
+    out += key;
+    out += "\": [";
+
+    for (size_t i = 0; i < counts.size(); i++)
+    {
+        std::snprintf(number, sizeof(number), "%s%llu", i ? ", " : "", static_cast<unsigned long long>(counts[i]));
+        out += number;
+    }
+
+    out += "]";
+}
+
+std::string memtrace_json(const MemTrace &trace, size_t top_io)
+{
+    std::string out = "{\n";
+    char entry[160];
+
+    append_counts(out, "page_reads", trace.page_reads);
+    out += ",\n";
+    append_counts(out, "page_writes", trace.page_writes);
+
+    std::snprintf(entry, sizeof(entry),
+                  ",\n  \"vram_during_oam_drawing\": %llu,\n  \"oam_during_oam_drawing\": %llu,\n  \"io\": [",
+                  static_cast<unsigned long long>(trace.vram_during_oam_drawing),
+                  static_cast<unsigned long long>(trace.oam_during_oam_drawing));
+    out += entry;
+
+    // hottest I/O registers by total accesses
+
+    std::vector<size_t> registers(trace.io_reads.size());
+    std::iota(registers.begin(), registers.end(), 0);
+    top_io = std::min(top_io, registers.size());
+
+    auto accesses = [&](size_t reg)
+    { return trace.io_reads[reg] + trace.io_writes[reg]; };
+
+    std::partial_sort(registers.begin(), registers.begin() + top_io, registers.end(), [&](size_t a, size_t b)
+                      { return accesses(a) > accesses(b); });
+
+    for (size_t i = 0; i < top_io && accesses(registers[i]); i++)
+    {
+        size_t reg = registers[i];
+        std::snprintf(entry, sizeof(entry), "%s\n    {\"address\": \"0x%04zX\", \"reads\": %llu, \"writes\": %llu}",
+                      i ? "," : "", 0xFF00 + reg, static_cast<unsigned long long>(trace.io_reads[reg]),
+                      static_cast<unsigned long long>(trace.io_writes[reg]));
+        out += entry;
+    }
+
+    out += "\n  ]\n}\n";
+    return out;
+}
+
+std::string memtrace_chrome(const MemTrace &trace)
+{
+    // instant events on one track per register, timestamps in microseconds
+    // of emulated time (4.194304 t-cycles per microsecond)
+
+    std::string out = "{\"traceEvents\": [";
+    char event[192];
+
+    uint64_t count = std::min<uint64_t>(trace.ring_events, MEMTRACE_RING_SIZE);
+    uint64_t first = trace.ring_events - count;
+
+    for (uint64_t i = first; i < trace.ring_events; i++)
+    {
+        const MemAccessEvent &e = trace.ring[i & (MEMTRACE_RING_SIZE - 1)];
+        std::snprintf(event, sizeof(event),
+                      "%s\n  {\"name\": \"%s 0x%04X\", \"ph\": \"i\", \"s\": \"t\", \"pid\": 0, \"tid\": %u, "
+                      "\"ts\": %.3f, \"args\": {\"value\": %u, \"ppu_mode\": %u}}",
+                      i != first ? "," : "", (e.flags & MEMTRACE_WRITE) ? "write" : "read", e.address, e.address & 0xFF,
+                      static_cast<double>(e.cycle) / 4.194304, e.value, e.flags & MEMTRACE_MODE);
+        out += event;
+    }
+
+    out += "\n]}\n";
+    return out;
+}
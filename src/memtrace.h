@@ -0,0 +1,48 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string>
+
+// memory access heatmap and I/O register trace
+//
+// only collected when compiled with -DGB_TRACE_MEM, MMU::read8/write8 then
+// record into the MMU's own MemTrace. without the define MMU has no trace
+// member and its access functions are unchanged
+
+constexpr size_t MEMTRACE_RING_SIZE = 4096; // most recent I/O accesses kept, power of two
+
+constexpr uint8_t MEMTRACE_WRITE = 1 << 7; // MemAccessEvent::flags: access was a write
+constexpr uint8_t MEMTRACE_MODE = 0x03;    // MemAccessEvent::flags: PPU mode at the time
+
+struct MemAccessEvent
+{
+    uint64_t cycle;   // Gameboy::total_cycles when the access happened
+    uint16_t address; // 0xFF00 - 0xFF7F
+    uint8_t value;    // value read or written
+    uint8_t flags;    // MEMTRACE_* bits
+};
+
+struct MemTrace
+{
+    uint64_t now = 0;        // current cycle, kept up to date by Gameboy::run_opcode()
+    bool cpu_active = false; // only CPU accesses are recorded, not the PPU's own register traffic
+
+    std::array<uint64_t, 256> page_reads{};  // reads per 256-byte page
+    std::array<uint64_t, 256> page_writes{}; // writes per 256-byte page
+    std::array<uint64_t, 128> io_reads{};    // reads per I/O register 0xFF00 - 0xFF7F
+    std::array<uint64_t, 128> io_writes{};   // writes per I/O register 0xFF00 - 0xFF7F
+
+    // accesses the CPU couldn't make on hardware while the PPU owns the memory
+    uint64_t vram_during_oam_drawing = 0; // VRAM accesses in modes 2/3
+    uint64_t oam_during_oam_drawing = 0;  // OAM accesses in modes 2/3
+
+    std::array<MemAccessEvent, MEMTRACE_RING_SIZE> ring{}; // I/O accesses, oldest overwritten first
+    uint64_t ring_events = 0;                               // total I/O accesses ever pushed to ring
+
+    void record(uint16_t address, uint8_t value, bool write, uint8_t stat);
+    void clear();
+};
+
+std::string memtrace_json(const MemTrace &trace, size_t top_io = 16); // heatmap and hottest registers
+std::string memtrace_chrome(const MemTrace &trace);                   // ring as chrome://tracing events
@@ -1,14 +1,14 @@
 #include "mmu.h"
 
 #include <algorithm>
+#include <cstring>
 #include <fstream>
-#include <iostream>
 #include <iterator>
 
-MMU::MMU()
+MMU::MMU(std::pmr::memory_resource *memory)
+    : mem(MMU_ADDRESSABLE_MEM, 0, memory), joypad_buttons(0), cgb(false), vram_bank1(memory), wram_banks(memory),
+      hdma_source(0), hdma_dest(0), hdma_blocks(0), hdma_active(false), slice_deadline(0)
 {
-    mem.resize(MMU_ADDRESSABLE_MEM, 0);
-
     // set hardware registers to initial values after boot ROM execution
     // from https://gbdev.io/pandocs/Power_Up_Sequence.html
     mem[0xFF00] = 0xCF;
@@ -53,32 +53,234 @@ MMU::MMU()
     mem[0xFF4A] = 0x00;
     mem[0xFF4B] = 0x00;
     mem[0xFFFF] = 0x00;
+
+    map_banks();
+}
+
+bool MMU::load_game_rom(const std::string &filename, std::string &error)
+{
+    RomImage image = cartridge_load_image(filename);
+
+    if (!image)
+    {
+        error = "Failed to open game ROM file: " + filename;
+        return false;
+    }
+
+    return map_game_rom(std::move(image), error);
+}
+
+bool MMU::map_game_rom(RomImage image, std::string &error)
+{
+    if (!image)
+    {
+        error = "No game ROM image";
+        return false;
+    }
+
+    if (image->size() > CARTRIDGE_MAX_ROM_SIZE)
+    {
+        error = "Game ROM too large (max 32KB for now)";
+        return false;
+    }
+
+    if (image->size() < CARTRIDGE_MAX_ROM_SIZE)
+    {
+        // map_banks() maps all eight ROM pages, images that didn't come from
+        // cartridge_make_image() may be shorter
+        image = cartridge_make_image(*image);
+    }
+
+    rom_image = std::move(image);
+    cartridge_parse_header(rom_image->data(), rom_image->size(), cartridge);
+    map_banks();
+
+    if (cartridge.cgb())
+    {
+        enable_cgb();
+    }
+
+    return true;
 }
 
-void MMU::load_game_rom(const std::string &filename)
+bool MMU::load_boot_rom(const std::string &filename, std::string &error)
 {
     std::ifstream file(filename, std::ios::binary);
 
     if (!file)
     {
-        std::cerr << "Failed to open game ROM file: " << filename << std::endl;
-        exit(1);
+        error = "Failed to open boot ROM file: " + filename;
+        return false;
     }
 
     std::vector<uint8_t> buffer(std::istreambuf_iterator<char>(file), {});
 
-    if (buffer.size() > 0x8000)
+    if (buffer.size() != 0x100 && buffer.size() != 0x900)
+    {
+        error = "Boot ROM must be 256 (DMG) or 2304 (CGB) bytes";
+        return false;
+    }
+
+    // the boot ROM covers 0x0000 - 0x00FF, a CGB boot ROM also 0x0200 - 0x08FF,
+    // the cartridge header at 0x0100 - 0x01FF stays visible in between
+    boot_page.assign(read_pages[0x0], read_pages[0x0] + MMU_PAGE_SIZE);
+    std::copy(buffer.begin(), buffer.begin() + 0x100, boot_page.begin());
+
+    if (buffer.size() == 0x900)
+    {
+        std::copy(buffer.begin() + 0x200, buffer.end(), boot_page.begin() + 0x200);
+    }
+
+    // hardware registers start out cleared, the boot ROM initializes them
+    std::fill(mem.begin() + 0xFF01, mem.begin() + 0xFF80, 0);
+
+    map_banks();
+
+    return true;
+}
+
+bool MMU::attach_save_file(const std::string &filename)
+{
+    auto file = std::make_unique<SaveFile>();
+
+    if (!file->open(filename))
+    {
+        return false;
+    }
+
+    save_file = std::move(file);
+    map_banks();
+
+    return true;
+}
+
+void MMU::enable_cgb()
+{
+    cgb = true;
+    vram_bank1.assign(MMU_VRAM_BANK_SIZE, 0);
+    wram_banks.assign(MMU_CGB_WRAM_BANKS * MMU_WRAM_BANK_SIZE, 0);
+
+    // CGB-only registers after boot ROM execution
+    mem[0xFF4D] = 0x7E; // KEY1, normal speed
+    mem[0xFF4F] = 0xFE; // VBK, VRAM bank 0
+    mem[0xFF55] = 0xFF; // HDMA5, no transfer active
+    mem[0xFF70] = 0xF8; // SVBK, WRAM bank 1
+
+    map_banks();
+}
+
+void MMU::map_banks()
+{
+    for (size_t page = 0; page < MMU_NUM_PAGES; page++)
+    {
+        read_pages[page] = &mem[page * MMU_PAGE_SIZE];
+        write_pages[page] = read_pages[page];
+    }
+
+    // ROM (0x0000 - 0x7FFF), VRAM (0x8000 - 0x9FFF, invalidates decoded tiles)
+    // and OAM/I/O (0xF000 - 0xFFFF) need special handling on writes
+    std::fill(write_pages.begin(), write_pages.begin() + 0xA, nullptr);
+    write_pages[0xF] = nullptr;
+
+    if (rom_image)
+    {
+        for (size_t page = 0; page < 0x8; page++)
+        {
+            // the image is never written, writes to ROM go through write_slow()
+            read_pages[page] = const_cast<uint8_t *>(&(*rom_image)[page * MMU_PAGE_SIZE]);
+        }
+    }
+
+    if (!boot_page.empty())
+    {
+        read_pages[0x0] = &boot_page[0];
+    }
+
+    if (save_file)
+    {
+        // writes go through write_slow() to mark the page dirty
+        read_pages[0xA] = save_file->data;
+        read_pages[0xB] = save_file->data + MMU_PAGE_SIZE;
+        write_pages[0xA] = write_pages[0xB] = nullptr;
+    }
+
+    if (cgb)
+    {
+        if (mem[0xFF4F] & 0x01) // VBK
+        {
+            read_pages[0x8] = &vram_bank1[0];
+            read_pages[0x9] = &vram_bank1[MMU_PAGE_SIZE];
+        }
+
+        size_t wram_bank = std::max(mem[0xFF70] & 0x07, 1); // SVBK, bank 0 selects bank 1
+
+        if (wram_bank > 1) // bank 1 lives in mem
+        {
+            read_pages[0xD] = write_pages[0xD] = &wram_banks[wram_bank * MMU_WRAM_BANK_SIZE];
+        }
+    }
+
+    // writes to watched pages go through write_slow(), which checks the address
+    for (size_t page = 0; page < MMU_NUM_PAGES; page++)
+    {
+        if (watchpoints.pages & (1 << page))
+        {
+            write_pages[page] = nullptr;
+        }
+    }
+}
+
+void MMU::add_watchpoint(uint16_t address, DebugCondition condition)
+{
+    watchpoints.add(address, std::move(condition));
+    map_banks();
+}
+
+void MMU::remove_watchpoint(uint16_t address)
+{
+    watchpoints.remove(address);
+    map_banks();
+}
+
+void MMU::clear_watchpoints()
+{
+    watchpoints.clear();
+    map_banks();
+}
+
+void MMU::set_buttons(uint8_t pressed)
+{
+    joypad_buttons = pressed;
+    update_joypad();
+}
+
+void MMU::update_joypad()
+{
+    uint8_t select = mem[0xFF00] & 0x30; // bit 4: directions, bit 5: actions (0 = selected)
+    uint8_t state = 0x0F;               // low nibble: 0 = pressed
+
+    if (!(select & 0x10))
+    {
+        state &= ~(joypad_buttons & 0x0F);
+    }
+
+    if (!(select & 0x20))
     {
-        std::cerr << "Game ROM too large (max 32KB for now)" << std::endl;
-        exit(1);
+        state &= ~(joypad_buttons >> 4);
     }
 
-    std::copy(buffer.begin(), buffer.end(), mem.begin());
+    mem[0xFF00] = 0xC0 | select | state;
 }
 
 uint8_t MMU::read8(uint16_t address) const
 {
-    return mem[address];
+    uint8_t value = read_pages[address >> 12][address & (MMU_PAGE_SIZE - 1)];
+
+#ifdef GB_TRACE_MEM
+    trace.record(address, value, false, mem[0xFF41]);
+#endif
+
+    return value;
 }
 
 uint16_t MMU::read16(uint16_t address) const
@@ -86,9 +288,39 @@ uint16_t MMU::read16(uint16_t address) const
     return (read8(address + 1) << 8) | read8(address);
 }
 
+void MMU::read_block(uint16_t address, uint8_t *out, size_t size) const
+{
+    size_t position = address;
+    size = std::min(size, MMU_ADDRESSABLE_MEM - position);
+
+    // page by page, neighbouring pages can belong to different banks
+    while (size)
+    {
+        size_t offset = position & (MMU_PAGE_SIZE - 1);
+        size_t length = std::min(size, MMU_PAGE_SIZE - offset);
+
+        std::memcpy(out, read_pages[position >> 12] + offset, length);
+        out += length;
+        position += length;
+        size -= length;
+    }
+}
+
 void MMU::write8(uint16_t address, uint8_t value)
 {
-    mem[address] = value;
+#ifdef GB_TRACE_MEM
+    trace.record(address, value, true, mem[0xFF41]);
+#endif
+
+    uint8_t *page = write_pages[address >> 12];
+
+    if (page)
+    {
+        page[address & (MMU_PAGE_SIZE - 1)] = value;
+        return;
+    }
+
+    write_slow(address, value);
 }
 
 void MMU::write16(uint16_t address, uint16_t value)
@@ -96,3 +328,231 @@ void MMU::write16(uint16_t address, uint16_t value)
     write8(address, value & 0xFF);            // low byte
     write8(address + 1, (value >> 8) & 0xFF); // high byte
 }
+
+
+void MMU::write_slow(uint16_t address, uint8_t value)
+{
+    uint8_t *read_page = read_pages[address >> 12];
+
+    if ((watchpoints.pages & (1 << (address >> 12))) &&
+        watchpoints.record(address, read_page[address & (MMU_PAGE_SIZE - 1)], value))
+    {
+        slice_deadline = 0; // stop after this instruction
+    }
+
+    if (address < 0x8000)
+    {
+        return; // ROM is read-only, MBC commands aren't emulated yet
+    }
+
+    if (address >= 0xFF00)
+    {
+        write_io(address, value);
+        return;
+    }
+
+    if (address < 0xA000)
+    {
+        tile_cache.invalidate(cgb && (mem[0xFF4F] & 0x01), address);
+    }
+    else if (address < 0xC000 && save_file)
+    {
+        save_file->mark_dirty(address - 0xA000);
+    }
+
+    read_page[address & (MMU_PAGE_SIZE - 1)] = value; // VRAM, OAM, echo RAM, battery RAM, watched RAM
+}
+
+void MMU::write_io(uint16_t address, uint8_t value)
+{
+    if (address >= 0xFF80) // HRAM and IE
+    {
+        mem[address] = value;
+        return;
+    }
+
+    if (address == 0xFF00)
+    {
+        // only the select bits are writable, the button state is read-only
+        mem[0xFF00] = (mem[0xFF00] & ~0x30) | (value & 0x30);
+        update_joypad();
+        return;
+    }
+
+    if (address == 0xFF01) // SB
+    {
+        mem[0xFF01] = value;
+
+        if (serial.link)
+        {
+            serial.link->publish(serial.side, value);
+        }
+
+        return;
+    }
+
+    if (address == 0xFF02) // SC
+    {
+        mem[0xFF02] = value | (cgb ? 0x7C : 0x7E);
+
+        // start with the internal clock, an external clock transfer just
+        // waits for the other side
+        if ((value & 0x81) == 0x81 && serial.transfer_end == SERIAL_IDLE)
+        {
+            serial.start_pending = true;
+            slice_deadline = 0;
+        }
+
+        return;
+    }
+
+    if (address == 0xFF50 && value && !boot_page.empty())
+    {
+        // boot ROM finished, unmap it for good
+        boot_page.clear();
+        boot_page.shrink_to_fit();
+        mem[0xFF50] = 0xFF;
+        map_banks();
+        return;
+    }
+
+    if (cgb)
+    {
+        switch (address)
+        {
+        case 0xFF4D: // KEY1, only the prepare bit is writable, STOP does the switch
+            mem[0xFF4D] = (mem[0xFF4D] & 0x80) | 0x7E | (value & 0x01);
+            return;
+
+        case 0xFF4F: // VBK
+            mem[0xFF4F] = 0xFE | (value & 0x01);
+            map_banks();
+            return;
+
+        case 0xFF70: // SVBK
+            mem[0xFF70] = 0xF8 | (value & 0x07);
+            map_banks();
+            return;
+
+        case 0xFF51: // HDMA1, source high
+            hdma_source = (hdma_source & 0x00FF) | (value << 8);
+            return;
+
+        case 0xFF52: // HDMA2, source low
+            hdma_source = (hdma_source & 0xFF00) | (value & 0xF0);
+            return;
+
+        case 0xFF53: // HDMA3, destination high (offset into VRAM)
+            hdma_dest = (hdma_dest & 0x00FF) | ((value & 0x1F) << 8);
+            return;
+
+        case 0xFF54: // HDMA4, destination low
+            hdma_dest = (hdma_dest & 0xFF00) | (value & 0xF0);
+            return;
+
+        case 0xFF55: // HDMA5, start or cancel a transfer
+            if (hdma_active && !(value & 0x80))
+            {
+                hdma_active = false;
+                mem[0xFF55] = 0x80 | (hdma_blocks - 1);
+            }
+            else if (value & 0x80)
+            {
+                hdma_active = true;
+                hdma_blocks = (value & 0x7F) + 1;
+                mem[0xFF55] = value & 0x7F;
+            }
+            else // general purpose DMA, copies everything at once
+            {
+                for (int i = (value & 0x7F) + 1; i > 0; i--)
+                {
+                    hdma_copy_block();
+                }
+
+                mem[0xFF55] = 0xFF;
+            }
+            return;
+
+        case 0xFF68: // BCPS
+            mem[0xFF68] = value | 0x40;
+            mem[0xFF69] = bg_palettes[value & 0x3F];
+            return;
+
+        case 0xFF69: // BCPD
+            write_palette(0xFF68, bg_palettes, value);
+            return;
+
+        case 0xFF6A: // OCPS
+            mem[0xFF6A] = value | 0x40;
+            mem[0xFF6B] = obj_palettes[value & 0x3F];
+            return;
+
+        case 0xFF6B: // OCPD
+            write_palette(0xFF6A, obj_palettes, value);
+            return;
+        }
+    }
+
+    mem[address] = value;
+}
+
+void MMU::write_palette(uint16_t index_register, std::array<uint8_t, MMU_PALETTE_SIZE> &palettes, uint8_t value)
+{
+    uint8_t index = mem[index_register];
+    palettes[index & 0x3F] = value;
+
+    if (index & 0x80) // auto increment
+    {
+        index = (index & 0xC0) | ((index + 1) & 0x3F);
+    }
+
+    // keep the data register readable without a branch in read8()
+    mem[index_register] = index;
+    mem[index_register + 1] = palettes[index & 0x3F];
+}
+
+void MMU::hdma_copy_block()
+{
+    for (int i = 0; i < 16; i++)
+    {
+        write8(0x8000 | (hdma_dest & 0x1FFF), read8(hdma_source));
+        hdma_source++;
+        hdma_dest++;
+    }
+}
+
+void MMU::hdma_hblank()
+{
+    if (!hdma_active)
+    {
+        return;
+    }
+
+    hdma_copy_block();
+
+    if (--hdma_blocks == 0)
+    {
+        hdma_active = false;
+        mem[0xFF55] = 0xFF;
+    }
+    else
+    {
+        mem[0xFF55] = hdma_blocks - 1;
+    }
+}
+
+void MMU::serial_receive()
+{
+    uint8_t value;
+
+    // only a transfer waiting for the clock takes the byte, until SC starts
+    // one it stays queued on the cable and SB keeps what the game wrote
+    if (!serial.link || !(mem[0xFF02] & 0x80) || !serial.link->receive(serial.side, value))
+    {
+        return;
+    }
+
+    mem[0xFF01] = value;
+    mem[0xFF02] &= 0x7F;
+    mem[0xFF0F] |= 0x08; // serial interrupt request
+}
@@ -1,21 +1,136 @@
 #pragma once
 
+#include <array>
 #include <cstdint>
+#include <memory>
+#include <memory_resource>
 #include <string>
 #include <vector>
 
+#include "cartridge.h"
+#include "debugger.h"
+#include "savefile.h"
+#include "serial.h"
+#include "tilecache.h"
+
+#ifdef GB_TRACE_MEM
+#include "memtrace.h"
+#endif
+
 const size_t MMU_ADDRESSABLE_MEM = 0x10000; // 64KB
 
+// the address space is mapped through a table of 4KB pages, so bank
+// switching only swaps page pointers instead of copying memory
+constexpr size_t MMU_PAGE_SIZE = 0x1000;
+constexpr size_t MMU_NUM_PAGES = MMU_ADDRESSABLE_MEM / MMU_PAGE_SIZE;
+
+// CGB banked memory
+constexpr size_t MMU_VRAM_BANK_SIZE = 0x2000; // 0x8000 - 0x9FFF, banks 0-1
+constexpr size_t MMU_WRAM_BANK_SIZE = 0x1000; // 0xD000 - 0xDFFF, banks 1-7
+constexpr size_t MMU_CGB_WRAM_BANKS = 8;
+constexpr size_t MMU_PALETTE_SIZE = 64; // 8 palettes * 4 colors * 2 bytes
+
+// button bit masks for MMU::joypad_buttons (1 = pressed)
+constexpr uint8_t JOYPAD_RIGHT = 1 << 0;
+constexpr uint8_t JOYPAD_LEFT = 1 << 1;
+constexpr uint8_t JOYPAD_UP = 1 << 2;
+constexpr uint8_t JOYPAD_DOWN = 1 << 3;
+constexpr uint8_t JOYPAD_A = 1 << 4;
+constexpr uint8_t JOYPAD_B = 1 << 5;
+constexpr uint8_t JOYPAD_SELECT = 1 << 6;
+constexpr uint8_t JOYPAD_START = 1 << 7;
+
 struct MMU
 {
-    std::vector<uint8_t> mem;
+    // flat memory, also backs VRAM bank 0 and WRAM bank 1 in CGB mode. the ROM
+    // range is unused, the ROM pages point into the shared rom_image instead.
+    // WRAM, OAM, I/O and HRAM are its top 16KB, so they share TLB entries
+    std::pmr::vector<uint8_t> mem;
+    uint8_t joypad_buttons; // currently pressed buttons (JOYPAD_* bits)
+
+    RomImage rom_image;        // cartridge ROM, shared between instances
+    CartridgeHeader cartridge{}; // parsed header of rom_image
+
+    // page tables, write_pages entries are null where writes need special handling
+    // (ROM, VRAM, OAM, I/O), those go through write_slow() instead
+    std::array<uint8_t *, MMU_NUM_PAGES> read_pages;
+    std::array<uint8_t *, MMU_NUM_PAGES> write_pages;
+
+    // CGB state, the banks are only allocated for CGB games
+    bool cgb;                                             // running in CGB mode
+    std::pmr::vector<uint8_t> vram_bank1;                 // VRAM bank 1
+    std::pmr::vector<uint8_t> wram_banks;                 // WRAM banks 2-7 (index 0 and 1 unused)
+    std::array<uint8_t, MMU_PALETTE_SIZE> bg_palettes{};  // background palette RAM (BCPD)
+    std::array<uint8_t, MMU_PALETTE_SIZE> obj_palettes{}; // object palette RAM (OCPD)
+    uint16_t hdma_source;                                 // next HDMA source address
+    uint16_t hdma_dest;                                   // next HDMA destination address in VRAM
+    uint8_t hdma_blocks;                                  // 16-byte blocks left in the HBlank DMA
+    bool hdma_active;                                     // HBlank DMA in progress
+
+    // boot ROM overlay: a copy of page 0 with the boot ROM on top, mapped
+    // until the boot ROM writes to 0xFF50
+    std::vector<uint8_t> boot_page;
+
+    // battery-backed cartridge RAM, maps 0xA000 - 0xBFFF when attached
+    std::unique_ptr<SaveFile> save_file;
+
+    Serial serial; // link port state, the registers live in mem
 
-    MMU();
+    TileCache tile_cache; // decoded VRAM tiles for the PPU, VRAM writes invalidate it
 
-    void load_game_rom(const std::string &filename);
+    Watchpoints watchpoints; // watched pages are null in write_pages while any are set
+
+    // the run loop executes instructions while total_cycles is below this.
+    // I/O writes that need Gameboy::service_events() zero it, which ends the
+    // loop after the current instruction without a per-instruction check
+    uint64_t slice_deadline;
+
+#ifdef GB_TRACE_MEM
+    mutable MemTrace trace; // access counters, updated by read8() too
+#endif
+
+    // the memory banks come from memory, an Arena for instances of a batch
+    explicit MMU(std::pmr::memory_resource *memory = std::pmr::get_default_resource());
+
+    // the page tables point into this object
+    MMU(const MMU &) = delete;
+    MMU &operator=(const MMU &) = delete;
+
+    // the loaders return false and leave the MMU unmapped if the image can't
+    // be used, with the reason in error. they don't print, one bad ROM in a
+    // batch would otherwise be reported once per lane
+    bool load_game_rom(const std::string &filename, std::string &error);
+    bool map_game_rom(RomImage image, std::string &error); // images under CARTRIDGE_MAX_ROM_SIZE are padded, not shared
+    bool load_boot_rom(const std::string &filename, std::string &error); // map a DMG (256 byte) or CGB (2304 byte) boot ROM
+    void enable_cgb(); // switch to CGB mode, allocates the banks
+    bool has_battery() const { return rom_image && cartridge.has_battery(); }
+    bool attach_save_file(const std::string &filename); // persist cartridge RAM in a .sav file
+    void map_banks();  // point the page tables at the currently selected banks
+
+    // a hit zeroes slice_deadline, Gameboy::run_frame() then checks the condition
+    void add_watchpoint(uint16_t address, DebugCondition condition = {});
+    void remove_watchpoint(uint16_t address);
+    void clear_watchpoints();
+
+    void set_buttons(uint8_t pressed); // set pressed buttons (JOYPAD_* bits)
+    void update_joypad();              // recompute the joypad register 0xFF00
 
     uint8_t read8(uint16_t address) const;
     uint16_t read16(uint16_t address) const;
+
+    // copy size bytes from address on as the CPU sees them, i.e. from the
+    // selected ROM, VRAM, WRAM and cartridge RAM banks. mem alone only holds
+    // the unbanked backing store
+    void read_block(uint16_t address, uint8_t *out, size_t size) const;
     void write8(uint16_t address, uint8_t value);
     void write16(uint16_t address, uint16_t value);
+
+    void write_slow(uint16_t address, uint8_t value); // writes to pages without a direct pointer
+    void write_io(uint16_t address, uint8_t value);   // writes to 0xFF00 - 0xFFFF
+
+    void write_palette(uint16_t index_register, std::array<uint8_t, MMU_PALETTE_SIZE> &palettes, uint8_t value);
+    void hdma_copy_block(); // copy 16 bytes from hdma_source to VRAM
+    void hdma_hblank();     // called by the PPU on entering HBlank
+
+    void serial_receive(); // complete a waiting transfer with a byte the other end of the link cable sent
 };
@@ -1,161 +1,182 @@
-#include <iostream>
-
 #include "opcodes.h"
 #include "gameboy.h"
 #include "cpu.h"
 
+template <bool ACCURATE>
 uint8_t op_0x21_LD_HL_u16(Gameboy &gb)
 {
     // set HL to the 16-bit value following the opcode
-    gb.cpu.HL = gb.mmu.read16(gb.cpu.PC + 1);
+    gb.cpu.HL = gb.bus_read16<ACCURATE>(gb.cpu.PC + 1);
 
     gb.cpu.PC += 3;
     return 12;
 }
 
+template <bool ACCURATE>
 uint8_t op_0x31_LD_SP_u16(Gameboy &gb)
 {
     // set SP to the 16-bit value following the opcode
-    gb.cpu.SP = gb.mmu.read16(gb.cpu.PC + 1);
+    gb.cpu.SP = gb.bus_read16<ACCURATE>(gb.cpu.PC + 1);
 
     gb.cpu.PC += 3;
     return 12;
 }
 
+template <bool ACCURATE>
 uint8_t op_0x32_LD_HLm_A(Gameboy &gb)
 {
     // store A into memory at address HL, then decrement HL
-    gb.mmu.write8(gb.cpu.HL, gb.cpu.AF_bytes.A);
+    gb.bus_write8<ACCURATE>(gb.cpu.HL, gb.cpu.AF_bytes.A);
     gb.cpu.HL--;
 
     gb.cpu.PC += 1;
     return 8;
 }
 
+template <bool ACCURATE>
 uint8_t op_0xAF_XOR_A_A(Gameboy &gb)
 {
     gb.cpu.AF_bytes.A ^= gb.cpu.AF_bytes.A; // result is always 0
-    gb.cpu.AF_bytes.F = CPU_FLAG_Z;         // Z flag set (bit 7), others cleared
+    gb.cpu.set_flags(CPU_FLAG_Z);           // Z flag set (bit 7), others cleared
 
     gb.cpu.PC += 1;
     return 4;
 }
 
+template <bool ACCURATE>
 uint8_t op_0xCB_prefixed(Gameboy &gb)
 {
     // get next byte to determine specific CB opcode
-    uint8_t cb = gb.mmu.read8(gb.cpu.PC + 1);
+    uint8_t cb = gb.bus_read8<ACCURATE>(gb.cpu.PC + 1);
+
+    if constexpr (ACCURATE)
+    {
+        return gb.accurate_cb_opcodes[cb](gb);
+    }
+
     return gb.cb_opcodes[cb](gb);
 }
 
+template <bool ACCURATE>
 uint8_t op_0xCB_0x7C_BIT_7_H(Gameboy &gb)
 {
     // don't modify C flag, set H flag, clear N flag, set Z flag if bit 7 of H is 0, else clear
-    gb.cpu.AF_bytes.F = (gb.cpu.AF_bytes.F & CPU_FLAG_C) | CPU_FLAG_H |
-                        ((gb.cpu.HL_bytes.H & 0x80) == 0 ? CPU_FLAG_Z : 0);
+    gb.cpu.set_flags((gb.cpu.flag_c() * CPU_FLAG_C) | CPU_FLAG_H |
+                     ((gb.cpu.HL_bytes.H & 0x80) == 0 ? CPU_FLAG_Z : 0));
 
     gb.cpu.PC += 2;
     return 8;
 }
 
+template <bool ACCURATE>
 uint8_t op_0x20_JR_NZ_i8(Gameboy &gb)
 {
-    int8_t offset = static_cast<int8_t>(gb.mmu.read8(gb.cpu.PC + 1)); // read signed 8-bit offset
+    int8_t offset = static_cast<int8_t>(gb.bus_read8<ACCURATE>(gb.cpu.PC + 1)); // read signed 8-bit offset
 
     // move to next instruction first, because offset is relative from there
     gb.cpu.PC += 2;
 
-    if ((gb.cpu.AF_bytes.F & CPU_FLAG_Z) == 0) // Z flag not set
+    if (!gb.cpu.flag_z()) // Z flag not set
     {
         gb.cpu.PC += offset; // now apply relative jump
+        gb.idle_candidate = offset < 0 && offset >= -GB_IDLE_LOOP_MAX_BYTES; // possibly a polling loop
         return 12;
     }
 
     return 8;
 }
 
+template <bool ACCURATE>
 uint8_t op_0x0E_LD_C_u8(Gameboy &gb)
 {
-    gb.cpu.BC_bytes.C = gb.mmu.read8(gb.cpu.PC + 1); // load 8-bit value into C register
+    gb.cpu.BC_bytes.C = gb.bus_read8<ACCURATE>(gb.cpu.PC + 1); // load 8-bit value into C register
 
     gb.cpu.PC += 2;
     return 8;
 }
 
+template <bool ACCURATE>
 uint8_t op_0x3E_LD_A_u8(Gameboy &gb)
 {
-    gb.cpu.AF_bytes.A = gb.mmu.read8(gb.cpu.PC + 1); // load 8-bit value into A register
+    gb.cpu.AF_bytes.A = gb.bus_read8<ACCURATE>(gb.cpu.PC + 1); // load 8-bit value into A register
 
     gb.cpu.PC += 2;
     return 8;
 }
 
+template <bool ACCURATE>
 uint8_t op_0xE2_LD_C_A(Gameboy &gb)
 {
-    gb.mmu.write8(0xFF00 + gb.cpu.BC_bytes.C, gb.cpu.AF_bytes.A); // write A to address (0xFF00 + C)
+    gb.bus_write8<ACCURATE>(0xFF00 + gb.cpu.BC_bytes.C, gb.cpu.AF_bytes.A); // write A to address (0xFF00 + C)
 
     gb.cpu.PC += 1;
     return 8;
 }
 
+template <bool ACCURATE>
 uint8_t op_0x0C_INC_C(Gameboy &gb)
 {
     gb.cpu.BC_bytes.C += 1; // increment C
 
-    gb.cpu.AF_bytes.F &= CPU_FLAG_C;                                       // preserve C flag, clear others
-    gb.cpu.AF_bytes.F |= ((gb.cpu.BC_bytes.C == 0) * CPU_FLAG_Z);          // Z flag if result is 0
-    gb.cpu.AF_bytes.F |= (((gb.cpu.BC_bytes.C & 0x0F) == 0) * CPU_FLAG_H); // H flag if low nibble overflowed
+    gb.cpu.flags_inc(gb.cpu.BC_bytes.C); // Z, H from the result, C unchanged
 
     gb.cpu.PC += 1;
     return 4;
 }
 
+template <bool ACCURATE>
 uint8_t op_0x77_LD_HL_A(Gameboy &gb)
 {
-    gb.mmu.write8(gb.cpu.HL, gb.cpu.AF_bytes.A); // write A to address HL
+    gb.bus_write8<ACCURATE>(gb.cpu.HL, gb.cpu.AF_bytes.A); // write A to address HL
 
     gb.cpu.PC += 1;
     return 8;
 }
 
+template <bool ACCURATE>
 uint8_t op_0xE0_LD_u8_A(Gameboy &gb)
 {
     // write A to address (0xFF00 + u8)
-    gb.mmu.write8(0xFF00 + gb.mmu.read8(gb.cpu.PC + 1), gb.cpu.AF_bytes.A);
+    gb.bus_write8<ACCURATE>(0xFF00 + gb.bus_read8<ACCURATE>(gb.cpu.PC + 1), gb.cpu.AF_bytes.A);
 
     gb.cpu.PC += 2;
     return 12;
 }
 
+template <bool ACCURATE>
 uint8_t op_0x11_LD_DE_u16(Gameboy &gb)
 {
-    gb.cpu.DE = gb.mmu.read16(gb.cpu.PC + 1); // set DE to the 16-bit value following the opcode
+    gb.cpu.DE = gb.bus_read16<ACCURATE>(gb.cpu.PC + 1); // set DE to the 16-bit value following the opcode
 
     gb.cpu.PC += 3;
     return 12;
 }
 
+template <bool ACCURATE>
 uint8_t op_0x1A_LD_A_DE(Gameboy &gb)
 {
-    gb.cpu.AF_bytes.A = gb.mmu.read8(gb.cpu.DE); // load A from memory at address DE
+    gb.cpu.AF_bytes.A = gb.bus_read8<ACCURATE>(gb.cpu.DE); // load A from memory at address DE
 
     gb.cpu.PC += 1;
     return 8;
 }
 
+template <bool ACCURATE>
 uint8_t op_0xCD_CALL_u16(Gameboy &gb)
 {
-    uint16_t addr = gb.mmu.read16(gb.cpu.PC + 1); // get 16-bit address to call
+    uint16_t addr = gb.bus_read16<ACCURATE>(gb.cpu.PC + 1); // get 16-bit address to call
 
     // push address of next instruction (after CALL) onto stack
     // current CALL instruction has length 3 bytes (opcode + 16-bit address)
+    gb.bus_idle<ACCURATE>(); // internal cycle before the push
     gb.cpu.SP -= 2;
-    gb.mmu.write16(gb.cpu.SP, gb.cpu.PC + 3);
+    gb.bus_write16<ACCURATE>(gb.cpu.SP, gb.cpu.PC + 3);
 
     gb.cpu.PC = addr; // jump to called address
     return 24;
 }
 
+template <bool ACCURATE>
 uint8_t op_0x4F_LD_C_A(Gameboy &gb)
 {
     gb.cpu.BC_bytes.C = gb.cpu.AF_bytes.A; // copy A into C
@@ -164,84 +185,88 @@ uint8_t op_0x4F_LD_C_A(Gameboy &gb)
     return 4;
 }
 
+template <bool ACCURATE>
 uint8_t op_0x06_LD_B_u8(Gameboy &gb)
 {
-    gb.cpu.BC_bytes.B = gb.mmu.read8(gb.cpu.PC + 1); // load 8-bit value into B register
+    gb.cpu.BC_bytes.B = gb.bus_read8<ACCURATE>(gb.cpu.PC + 1); // load 8-bit value into B register
 
     gb.cpu.PC += 2;
     return 8;
 }
 
+template <bool ACCURATE>
 uint8_t op_0xC5_PUSH_BC(Gameboy &gb)
 {
-    gb.cpu.SP -= 2;                       // decrement stack pointer by 2
-    gb.mmu.write16(gb.cpu.SP, gb.cpu.BC); // write BC to memory at address SP
+    gb.bus_idle<ACCURATE>();                        // internal cycle before the push
+    gb.cpu.SP -= 2;                                 // decrement stack pointer by 2
+    gb.bus_write16<ACCURATE>(gb.cpu.SP, gb.cpu.BC); // write BC to memory at address SP
 
     gb.cpu.PC += 1;
     return 16;
 }
 
+template <bool ACCURATE>
 uint8_t op_0xCB_0x11_RL_C(Gameboy &gb)
 {
     uint8_t old_c = gb.cpu.BC_bytes.C;
-    uint8_t carry_in = (gb.cpu.AF_bytes.F & CPU_FLAG_C) ? 1 : 0;
+    uint8_t carry_in = gb.cpu.flag_c();
 
     // rotate left through carry
     gb.cpu.BC_bytes.C = (old_c << 1) | carry_in;
 
-    gb.cpu.AF_bytes.F = 0;                                        // clear all flags
-    gb.cpu.AF_bytes.F |= ((gb.cpu.BC_bytes.C == 0) * CPU_FLAG_Z); // Z flag if result is 0
-    gb.cpu.AF_bytes.F |= ((old_c & 0x80) >> 7) * CPU_FLAG_C;      // C flag if old bit 7 was set
+    gb.cpu.set_flags(((gb.cpu.BC_bytes.C == 0) * CPU_FLAG_Z) | // Z flag if result is 0
+                     (((old_c & 0x80) >> 7) * CPU_FLAG_C));    // C flag if old bit 7 was set
 
     gb.cpu.PC += 2;
     return 8;
 }
 
+template <bool ACCURATE>
 uint8_t op_0x17_RLA(Gameboy &gb)
 {
     uint8_t old_a = gb.cpu.AF_bytes.A;
-    uint8_t carry_in = (gb.cpu.AF_bytes.F & CPU_FLAG_C) ? 1 : 0;
+    uint8_t carry_in = gb.cpu.flag_c();
 
     // rotate left through carry
     gb.cpu.AF_bytes.A = (old_a << 1) | carry_in;
 
-    gb.cpu.AF_bytes.F = 0;                                   // clear all flags
-    gb.cpu.AF_bytes.F |= ((old_a & 0x80) >> 7) * CPU_FLAG_C; // C flag if old bit 7 was set
+    gb.cpu.set_flags(((old_a & 0x80) >> 7) * CPU_FLAG_C); // C flag if old bit 7 was set, others cleared
 
     gb.cpu.PC += 1;
     return 4;
 }
 
+template <bool ACCURATE>
 uint8_t op_0xC1_POP_BC(Gameboy &gb)
 {
-    gb.cpu.BC = gb.mmu.read16(gb.cpu.SP); // read 16-bit value from memory at address SP into BC
-    gb.cpu.SP += 2;                       // increment stack pointer by 2
+    gb.cpu.BC = gb.bus_read16<ACCURATE>(gb.cpu.SP); // read 16-bit value from memory at address SP into BC
+    gb.cpu.SP += 2;                                 // increment stack pointer by 2
 
     gb.cpu.PC += 1;
     return 12;
 }
 
+template <bool ACCURATE>
 uint8_t op_0x05_DEC_B(Gameboy &gb)
 {
     gb.cpu.BC_bytes.B -= 1;
 
-    gb.cpu.AF_bytes.F &= CPU_FLAG_C;                                          // preserve C flag, clear others
-    gb.cpu.AF_bytes.F |= CPU_FLAG_N;                                          // set N flag (bit 6)
-    gb.cpu.AF_bytes.F |= ((gb.cpu.BC_bytes.B == 0) * CPU_FLAG_Z);             // Z flag if result is 0
-    gb.cpu.AF_bytes.F |= (((gb.cpu.BC_bytes.B & 0x0F) == 0x0F) * CPU_FLAG_H); // H flag if borrow from bit 4
+    gb.cpu.flags_dec(gb.cpu.BC_bytes.B); // Z, H from the result, N set, C unchanged
 
     gb.cpu.PC += 1;
     return 4;
 }
 
+template <bool ACCURATE>
 uint8_t op_0x22_LD_HLp_A(Gameboy &gb)
 {
-    gb.mmu.write8(gb.cpu.HL++, gb.cpu.AF_bytes.A); // store A into memory at address HL, then increment HL
+    gb.bus_write8<ACCURATE>(gb.cpu.HL++, gb.cpu.AF_bytes.A); // store A into memory at address HL, then increment HL
 
     gb.cpu.PC += 1;
     return 8;
 }
 
+template <bool ACCURATE>
 uint8_t op_0x23_INC_HL(Gameboy &gb)
 {
     gb.cpu.HL += 1; // increment HL
@@ -250,14 +275,16 @@ uint8_t op_0x23_INC_HL(Gameboy &gb)
     return 8;
 }
 
+template <bool ACCURATE>
 uint8_t op_0xC9_RET(Gameboy &gb)
 {
-    gb.cpu.PC = gb.mmu.read16(gb.cpu.SP); // pop return address from stack into PC
-    gb.cpu.SP += 2;                       // increment stack pointer by 2
+    gb.cpu.PC = gb.bus_read16<ACCURATE>(gb.cpu.SP); // pop return address from stack into PC
+    gb.cpu.SP += 2;                                 // increment stack pointer by 2
 
     return 16;
 }
 
+template <bool ACCURATE>
 uint8_t op_0x13_INC_DE(Gameboy &gb)
 {
     gb.cpu.DE += 1; // increment DE
@@ -266,6 +293,7 @@ uint8_t op_0x13_INC_DE(Gameboy &gb)
     return 8;
 }
 
+template <bool ACCURATE>
 uint8_t op_0x7B_LD_A_E(Gameboy &gb)
 {
     gb.cpu.AF_bytes.A = gb.cpu.DE_bytes.E; // copy E into A
@@ -274,88 +302,117 @@ uint8_t op_0x7B_LD_A_E(Gameboy &gb)
     return 4;
 }
 
+template <bool ACCURATE>
 uint8_t op_0xFE_CP_A_u8(Gameboy &gb)
 {
-    uint8_t value = gb.mmu.read8(gb.cpu.PC + 1);
-    uint8_t result = gb.cpu.AF_bytes.A - value;
+    uint8_t value = gb.bus_read8<ACCURATE>(gb.cpu.PC + 1);
+    gb.cpu.flags_sub(gb.cpu.AF_bytes.A, value); // Z, H, C from A - value, N set
+
+    gb.cpu.PC += 2;
+    return 8;
+}
+
+template <bool ACCURATE>
+uint8_t op_0xCE_ADC_A_u8(Gameboy &gb)
+{
+    uint8_t value = gb.bus_read8<ACCURATE>(gb.cpu.PC + 1);
+    uint8_t carry = gb.cpu.flag_c();
+    gb.cpu.flags_adc(gb.cpu.AF_bytes.A, value, carry); // Z, H, C from A + value + carry
+    gb.cpu.AF_bytes.A += value + carry;
+
+    gb.cpu.PC += 2;
+    return 8;
+}
 
-    gb.cpu.AF_bytes.F = CPU_FLAG_N;                                                    // set N flag, clear others
-    gb.cpu.AF_bytes.F |= ((result == 0) * CPU_FLAG_Z);                                 // Z flag if result is 0
-    gb.cpu.AF_bytes.F |= (((gb.cpu.AF_bytes.A & 0x0F) < (value & 0x0F)) * CPU_FLAG_H); // H flag if borrow from bit 4
-    gb.cpu.AF_bytes.F |= ((gb.cpu.AF_bytes.A < value) * CPU_FLAG_C);                   // C flag if borrow (A < value)
+template <bool ACCURATE>
+uint8_t op_0xDE_SBC_A_u8(Gameboy &gb)
+{
+    uint8_t value = gb.bus_read8<ACCURATE>(gb.cpu.PC + 1);
+    uint8_t carry = gb.cpu.flag_c();
+    gb.cpu.flags_sbc(gb.cpu.AF_bytes.A, value, carry); // Z, H, C from A - value - carry, N set
+    gb.cpu.AF_bytes.A -= value + carry;
 
     gb.cpu.PC += 2;
     return 8;
 }
 
+template <bool ACCURATE>
 uint8_t op_0xEA_LD_u16_A(Gameboy &gb)
 {
-    uint16_t addr = gb.mmu.read16(gb.cpu.PC + 1);
-    gb.mmu.write8(addr, gb.cpu.AF_bytes.A); // write A to address
+    uint16_t addr = gb.bus_read16<ACCURATE>(gb.cpu.PC + 1);
+    gb.bus_write8<ACCURATE>(addr, gb.cpu.AF_bytes.A); // write A to address
 
     gb.cpu.PC += 3;
     return 16;
 }
 
+template <bool ACCURATE>
 uint8_t op_0x3D_DEC_A(Gameboy &gb)
 {
     gb.cpu.AF_bytes.A -= 1;
 
-    gb.cpu.AF_bytes.F &= CPU_FLAG_C;                                          // preserve C flag, clear others
-    gb.cpu.AF_bytes.F |= CPU_FLAG_N;                                          // set N flag
-    gb.cpu.AF_bytes.F |= ((gb.cpu.AF_bytes.A == 0) * CPU_FLAG_Z);             // Z flag if result is 0
-    gb.cpu.AF_bytes.F |= (((gb.cpu.AF_bytes.A & 0x0F) == 0x0F) * CPU_FLAG_H); // H flag if borrow from bit 4
+    gb.cpu.flags_dec(gb.cpu.AF_bytes.A); // Z, H from the result, N set, C unchanged
 
     gb.cpu.PC += 1;
     return 4;
 }
 
+template <bool ACCURATE>
 uint8_t op_0x28_JR_Z_i8(Gameboy &gb)
 {
-    int8_t offset = static_cast<int8_t>(gb.mmu.read8(gb.cpu.PC + 1)); // read signed 8-bit offset
+    int8_t offset = static_cast<int8_t>(gb.bus_read8<ACCURATE>(gb.cpu.PC + 1)); // read signed 8-bit offset
 
     gb.cpu.PC += 2; // move to next instruction first, offset is relative from there
 
-    if (gb.cpu.AF_bytes.F & CPU_FLAG_Z) // if Z flag set
+    if (gb.cpu.flag_z()) // if Z flag set
     {
         gb.cpu.PC += offset;
+        gb.idle_candidate = offset < 0 && offset >= -GB_IDLE_LOOP_MAX_BYTES; // possibly a polling loop
         return 12;
     }
 
     return 8;
 }
 
+template <bool ACCURATE>
 uint8_t op_0x0D_DEC_C(Gameboy &gb)
 {
     gb.cpu.BC_bytes.C -= 1;
 
-    gb.cpu.AF_bytes.F &= CPU_FLAG_C;                                          // preserve C flag, clear others
-    gb.cpu.AF_bytes.F |= CPU_FLAG_N;                                          // set N flag
-    gb.cpu.AF_bytes.F |= ((gb.cpu.BC_bytes.C == 0) * CPU_FLAG_Z);             // Z flag if result is 0
-    gb.cpu.AF_bytes.F |= (((gb.cpu.BC_bytes.C & 0x0F) == 0x0F) * CPU_FLAG_H); // H flag if borrow from bit 4
+    gb.cpu.flags_dec(gb.cpu.BC_bytes.C); // Z, H from the result, N set, C unchanged
 
     gb.cpu.PC += 1;
     return 4;
 }
 
+template <bool ACCURATE>
 uint8_t op_0x2E_LD_L_u8(Gameboy &gb)
 {
-    gb.cpu.HL_bytes.L = gb.mmu.read8(gb.cpu.PC + 1); // load 8-bit value into L register
+    gb.cpu.HL_bytes.L = gb.bus_read8<ACCURATE>(gb.cpu.PC + 1); // load 8-bit value into L register
 
     gb.cpu.PC += 2;
     return 8;
 }
 
+template <bool ACCURATE>
 uint8_t op_0x18_JR_i8(Gameboy &gb)
 {
-    int8_t offset = static_cast<int8_t>(gb.mmu.read8(gb.cpu.PC + 1)); // read signed 8-bit offset
+    int8_t offset = static_cast<int8_t>(gb.bus_read8<ACCURATE>(gb.cpu.PC + 1)); // read signed 8-bit offset
 
     gb.cpu.PC += 2; // move to next instruction first, offset is relative from there
     gb.cpu.PC += offset;
+    gb.idle_candidate = offset < 0 && offset >= -GB_IDLE_LOOP_MAX_BYTES; // possibly a polling loop
+
+    // JR to itself spins forever unless an interrupt breaks it out
+    if (offset == -2 && !(gb.cpu.IME && (gb.mmu.mem[0xFFFF] & 0x1F)))
+    {
+        gb.raise_fault(GB_FAULT_LOCKUP);
+    }
 
     return 12;
 }
 
+template <bool ACCURATE>
 uint8_t op_0x67_LD_H_A(Gameboy &gb)
 {
     gb.cpu.HL_bytes.H = gb.cpu.AF_bytes.A; // copy A into H
@@ -364,6 +421,7 @@ uint8_t op_0x67_LD_H_A(Gameboy &gb)
     return 4;
 }
 
+template <bool ACCURATE>
 uint8_t op_0x57_LD_D_A(Gameboy &gb)
 {
     gb.cpu.DE_bytes.D = gb.cpu.AF_bytes.A; // copy A into D
@@ -372,60 +430,59 @@ uint8_t op_0x57_LD_D_A(Gameboy &gb)
     return 4;
 }
 
+template <bool ACCURATE>
 uint8_t op_0x04_INC_B(Gameboy &gb)
 {
     gb.cpu.BC_bytes.B += 1; // increment B
 
-    gb.cpu.AF_bytes.F &= CPU_FLAG_C;                                       // preserve C flag, clear others
-    gb.cpu.AF_bytes.F |= ((gb.cpu.BC_bytes.B == 0) * CPU_FLAG_Z);          // Z flag if result is 0
-    gb.cpu.AF_bytes.F |= (((gb.cpu.BC_bytes.B & 0x0F) == 0) * CPU_FLAG_H); // H flag if low nibble overflowed
+    gb.cpu.flags_inc(gb.cpu.BC_bytes.B); // Z, H from the result, C unchanged
 
     gb.cpu.PC += 1;
     return 4;
 }
 
+template <bool ACCURATE>
 uint8_t op_0x1E_LD_E_u8(Gameboy &gb)
 {
-    gb.cpu.DE_bytes.E = gb.mmu.read8(gb.cpu.PC + 1); // load 8-bit value into E register
+    gb.cpu.DE_bytes.E = gb.bus_read8<ACCURATE>(gb.cpu.PC + 1); // load 8-bit value into E register
 
     gb.cpu.PC += 2;
     return 8;
 }
 
+template <bool ACCURATE>
 uint8_t op_0xF0_LD_A_FF00_u8(Gameboy &gb)
 {
     // load A from address (0xFF00 + u8)
-    gb.cpu.AF_bytes.A = gb.mmu.read8(0xFF00 + gb.mmu.read8(gb.cpu.PC + 1));
+    gb.cpu.AF_bytes.A = gb.bus_read8<ACCURATE>(0xFF00 + gb.bus_read8<ACCURATE>(gb.cpu.PC + 1));
 
     gb.cpu.PC += 2;
     return 12;
 }
 
+template <bool ACCURATE>
 uint8_t op_0x1D_DEC_E(Gameboy &gb)
 {
     gb.cpu.DE_bytes.E -= 1;
 
-    gb.cpu.AF_bytes.F &= CPU_FLAG_C;                                          // preserve C flag, clear others
-    gb.cpu.AF_bytes.F |= CPU_FLAG_N;                                          // set N flag (bit 6)
-    gb.cpu.AF_bytes.F |= ((gb.cpu.DE_bytes.E == 0) * CPU_FLAG_Z);             // Z flag if result is 0
-    gb.cpu.AF_bytes.F |= (((gb.cpu.DE_bytes.E & 0x0F) == 0x0F) * CPU_FLAG_H); // H flag if borrow from bit 4
+    gb.cpu.flags_dec(gb.cpu.DE_bytes.E); // Z, H from the result, N set, C unchanged
 
     gb.cpu.PC += 1;
     return 4;
 }
 
+template <bool ACCURATE>
 uint8_t op_0x24_INC_H(Gameboy &gb)
 {
     gb.cpu.HL_bytes.H += 1; // increment H
 
-    gb.cpu.AF_bytes.F &= CPU_FLAG_C;                                       // preserve C flag, clear others
-    gb.cpu.AF_bytes.F |= ((gb.cpu.HL_bytes.H == 0) * CPU_FLAG_Z);          // Z flag if result is 0
-    gb.cpu.AF_bytes.F |= (((gb.cpu.HL_bytes.H & 0x0F) == 0) * CPU_FLAG_H); // H flag if low nibble overflowed
+    gb.cpu.flags_inc(gb.cpu.HL_bytes.H); // Z, H from the result, C unchanged
 
     gb.cpu.PC += 1;
     return 4;
 }
 
+template <bool ACCURATE>
 uint8_t op_0x7C_LD_A_H(Gameboy &gb)
 {
     gb.cpu.AF_bytes.A = gb.cpu.HL_bytes.H; // copy H into A
@@ -434,55 +491,47 @@ uint8_t op_0x7C_LD_A_H(Gameboy &gb)
     return 4;
 }
 
+template <bool ACCURATE>
 uint8_t op_0x90_SUB_A_B(Gameboy &gb)
 {
     uint8_t value = gb.cpu.BC_bytes.B;
-    uint8_t result = gb.cpu.AF_bytes.A - value;
-
-    gb.cpu.AF_bytes.F = CPU_FLAG_N;                                                    // set N flag, clear others
-    gb.cpu.AF_bytes.F |= ((result == 0) * CPU_FLAG_Z);                                 // Z flag if result is 0
-    gb.cpu.AF_bytes.F |= (((gb.cpu.AF_bytes.A & 0x0F) < (value & 0x0F)) * CPU_FLAG_H); // H flag if borrow from bit 4
-    gb.cpu.AF_bytes.F |= ((gb.cpu.AF_bytes.A < value) * CPU_FLAG_C);                   // C flag if borrow (A < value)
+    gb.cpu.flags_sub(gb.cpu.AF_bytes.A, value); // Z, H, C from A - value, N set
 
     gb.cpu.PC += 1;
     return 4;
 }
 
+template <bool ACCURATE>
 uint8_t op_0x15_DEC_D(Gameboy &gb)
 {
     gb.cpu.DE_bytes.D -= 1;
 
-    gb.cpu.AF_bytes.F &= CPU_FLAG_C;                                          // preserve C flag, clear others
-    gb.cpu.AF_bytes.F |= CPU_FLAG_N;                                          // set N flag (bit 6)
-    gb.cpu.AF_bytes.F |= ((gb.cpu.DE_bytes.D == 0) * CPU_FLAG_Z);             // Z flag if result is 0
-    gb.cpu.AF_bytes.F |= (((gb.cpu.DE_bytes.D & 0x0F) == 0x0F) * CPU_FLAG_H); // H flag if borrow from bit 4
+    gb.cpu.flags_dec(gb.cpu.DE_bytes.D); // Z, H from the result, N set, C unchanged
 
     gb.cpu.PC += 1;
     return 4;
 }
 
+template <bool ACCURATE>
 uint8_t op_0x16_LD_D_u8(Gameboy &gb)
 {
-    gb.cpu.DE_bytes.D = gb.mmu.read8(gb.cpu.PC + 1); // load 8-bit value into D register
+    gb.cpu.DE_bytes.D = gb.bus_read8<ACCURATE>(gb.cpu.PC + 1); // load 8-bit value into D register
 
     gb.cpu.PC += 2;
     return 8;
 }
 
+template <bool ACCURATE>
 uint8_t op_0xBE_CP_A_HL(Gameboy &gb)
 {
-    uint8_t value = gb.mmu.read8(gb.cpu.HL);
-    uint8_t result = gb.cpu.AF_bytes.A - value;
-
-    gb.cpu.AF_bytes.F = CPU_FLAG_N;                                                    // set N flag, clear others
-    gb.cpu.AF_bytes.F |= ((result == 0) * CPU_FLAG_Z);                                 // Z flag if result is 0
-    gb.cpu.AF_bytes.F |= (((gb.cpu.AF_bytes.A & 0x0F) < (value & 0x0F)) * CPU_FLAG_H); // H flag if borrow from bit 4
-    gb.cpu.AF_bytes.F |= ((gb.cpu.AF_bytes.A < value) * CPU_FLAG_C);                   // C flag if borrow (A < value)
+    uint8_t value = gb.bus_read8<ACCURATE>(gb.cpu.HL);
+    gb.cpu.flags_sub(gb.cpu.AF_bytes.A, value); // Z, H, C from A - value, N set
 
     gb.cpu.PC += 1;
     return 8;
 }
 
+template <bool ACCURATE>
 uint8_t op_0x7D_LD_A_L(Gameboy &gb)
 {
     gb.cpu.AF_bytes.A = gb.cpu.HL_bytes.L; // copy L into A
@@ -491,6 +540,7 @@ uint8_t op_0x7D_LD_A_L(Gameboy &gb)
     return 4;
 }
 
+template <bool ACCURATE>
 uint8_t op_0x78_LD_A_B(Gameboy &gb)
 {
     gb.cpu.AF_bytes.A = gb.cpu.BC_bytes.B; // copy B into A
@@ -499,35 +549,33 @@ uint8_t op_0x78_LD_A_B(Gameboy &gb)
     return 4;
 }
 
+template <bool ACCURATE>
 uint8_t op_0x86_ADD_A_HL(Gameboy &gb)
 {
-    uint8_t value = gb.mmu.read8(gb.cpu.HL);
-    uint16_t result = static_cast<uint16_t>(gb.cpu.AF_bytes.A) + static_cast<uint16_t>(value);
-
-    gb.cpu.AF_bytes.F = 0;                                                                    // clear all flags
-    gb.cpu.AF_bytes.F |= ((result & 0xFF) == 0) * CPU_FLAG_Z;                                 // Z flag if result is 0
-    gb.cpu.AF_bytes.F |= (((gb.cpu.AF_bytes.A & 0x0F) + (value & 0x0F)) > 0x0F) * CPU_FLAG_H; // H flag if carry from bit 4
-    gb.cpu.AF_bytes.F |= ((result > 0xFF) * CPU_FLAG_C);                                      // C flag if carry (result > 255)
-
-    gb.cpu.AF_bytes.A = static_cast<uint8_t>(result & 0xFF); // store low 8 bits of result in A
+    uint8_t value = gb.bus_read8<ACCURATE>(gb.cpu.HL);
+    gb.cpu.flags_add(gb.cpu.AF_bytes.A, value); // Z, H, C from A + value
+    gb.cpu.AF_bytes.A += value;
 
     gb.cpu.PC += 1;
     return 8;
 }
 
+template <bool ACCURATE>
 uint8_t op_0x00_NOP(Gameboy &gb)
 {
     gb.cpu.PC += 1; // simply advance PC by 1
     return 4;
 }
 
+template <bool ACCURATE>
 uint8_t op_0xC3_JP_u16(Gameboy &gb)
 {
-    uint16_t addr = gb.mmu.read16(gb.cpu.PC + 1); // get 16-bit address to jump to
-    gb.cpu.PC = addr;                             // jump to address
+    uint16_t addr = gb.bus_read16<ACCURATE>(gb.cpu.PC + 1); // get 16-bit address to jump to
+    gb.cpu.PC = addr;                                       // jump to address
     return 16;
 }
 
+template <bool ACCURATE>
 uint8_t op_0xF3_DI(Gameboy &gb)
 {
     gb.cpu.IME = false; // disable interrupts
@@ -536,33 +584,37 @@ uint8_t op_0xF3_DI(Gameboy &gb)
     return 4;
 }
 
+template <bool ACCURATE>
 uint8_t op_0x36_LD_HL_u8(Gameboy &gb)
 {
     // write 8-bit value into memory at address HL
-    gb.mmu.write8(gb.cpu.HL, gb.mmu.read8(gb.cpu.PC + 1));
+    gb.bus_write8<ACCURATE>(gb.cpu.HL, gb.bus_read8<ACCURATE>(gb.cpu.PC + 1));
 
     gb.cpu.PC += 2;
     return 12;
 }
 
+template <bool ACCURATE>
 uint8_t op_0x2A_LD_A_HLp(Gameboy &gb)
 {
     // load A from memory at address HL, then increment HL
-    gb.cpu.AF_bytes.A = gb.mmu.read8(gb.cpu.HL++);
+    gb.cpu.AF_bytes.A = gb.bus_read8<ACCURATE>(gb.cpu.HL++);
 
     gb.cpu.PC += 1;
     return 8;
 }
 
+template <bool ACCURATE>
 uint8_t op_0x01_LD_BC_u16(Gameboy &gb)
 {
     // set BC to the 16-bit value following the opcode
-    gb.cpu.BC = gb.mmu.read16(gb.cpu.PC + 1);
+    gb.cpu.BC = gb.bus_read16<ACCURATE>(gb.cpu.PC + 1);
 
     gb.cpu.PC += 3;
     return 12;
 }
 
+template <bool ACCURATE>
 uint8_t op_0x0B_DEC_BC(Gameboy &gb)
 {
     gb.cpu.BC -= 1; // decrement BC
@@ -571,16 +623,17 @@ uint8_t op_0x0B_DEC_BC(Gameboy &gb)
     return 8;
 }
 
+template <bool ACCURATE>
 uint8_t op_0xB1_OR_A_C(Gameboy &gb)
 {
     gb.cpu.AF_bytes.A |= gb.cpu.BC_bytes.C;                       // do the OR
-    gb.cpu.AF_bytes.F = 0;                                        // clear all flags
-    gb.cpu.AF_bytes.F |= ((gb.cpu.AF_bytes.A == 0) * CPU_FLAG_Z); // Z flag if result is 0
+    gb.cpu.set_flags((gb.cpu.AF_bytes.A == 0) * CPU_FLAG_Z); // Z flag if result is 0, others cleared
 
     gb.cpu.PC += 1;
     return 4;
 }
 
+template <bool ACCURATE>
 uint8_t op_0xFB_EI(Gameboy &gb)
 {
     gb.cpu.IME_scheduled = true; // enable interrupts after next instruction
@@ -589,39 +642,41 @@ uint8_t op_0xFB_EI(Gameboy &gb)
     return 4;
 }
 
+template <bool ACCURATE>
 uint8_t op_0x2F_CPL(Gameboy &gb)
 {
     gb.cpu.AF_bytes.A = ~gb.cpu.AF_bytes.A;       // bitwise NOT on A
-    gb.cpu.AF_bytes.F |= CPU_FLAG_N | CPU_FLAG_H; // set N and H flags, preserve others
+    gb.cpu.set_flags(gb.cpu.flags() | CPU_FLAG_N | CPU_FLAG_H); // set N and H flags, preserve others
 
     gb.cpu.PC += 1;
     return 4;
 }
 
+template <bool ACCURATE>
 uint8_t op_0xE6_AND_A_u8(Gameboy &gb)
 {
-    uint8_t value = gb.mmu.read8(gb.cpu.PC + 1);
+    uint8_t value = gb.bus_read8<ACCURATE>(gb.cpu.PC + 1);
 
     gb.cpu.AF_bytes.A &= value;                                   // do the AND
-    gb.cpu.AF_bytes.F = CPU_FLAG_H;                               // set H flag, clear others
-    gb.cpu.AF_bytes.F |= ((gb.cpu.AF_bytes.A == 0) * CPU_FLAG_Z); // Z flag if result is 0
+    gb.cpu.set_flags(CPU_FLAG_H | ((gb.cpu.AF_bytes.A == 0) * CPU_FLAG_Z)); // set H flag, Z flag if result is 0
 
     gb.cpu.PC += 2;
     return 8;
 }
 
+template <bool ACCURATE>
 uint8_t op_0xCB_0x37_SWAP_A(Gameboy &gb)
 {
     uint8_t old_a = gb.cpu.AF_bytes.A;
 
     gb.cpu.AF_bytes.A = (old_a << 4) | (old_a >> 4);              // swap upper and lower nibbles
-    gb.cpu.AF_bytes.F = 0;                                        // clear all flags
-    gb.cpu.AF_bytes.F |= ((gb.cpu.AF_bytes.A == 0) * CPU_FLAG_Z); // Z flag if result is 0
+    gb.cpu.set_flags((gb.cpu.AF_bytes.A == 0) * CPU_FLAG_Z); // Z flag if result is 0, others cleared
 
     gb.cpu.PC += 2;
     return 8;
 }
 
+template <bool ACCURATE>
 uint8_t op_0x47_LD_B_A(Gameboy &gb)
 {
     gb.cpu.BC_bytes.B = gb.cpu.AF_bytes.A; // copy A into B
@@ -630,36 +685,37 @@ uint8_t op_0x47_LD_B_A(Gameboy &gb)
     return 4;
 }
 
+template <bool ACCURATE>
 uint8_t op_0xB0_OR_A_B(Gameboy &gb)
 {
     gb.cpu.AF_bytes.A |= gb.cpu.BC_bytes.B;                       // do the OR
-    gb.cpu.AF_bytes.F = 0;                                        // clear all flags
-    gb.cpu.AF_bytes.F |= ((gb.cpu.AF_bytes.A == 0) * CPU_FLAG_Z); // Z flag if result is 0
+    gb.cpu.set_flags((gb.cpu.AF_bytes.A == 0) * CPU_FLAG_Z); // Z flag if result is 0, others cleared
 
     gb.cpu.PC += 1;
     return 4;
 }
 
+template <bool ACCURATE>
 uint8_t op_0xA9_XOR_A_C(Gameboy &gb)
 {
     gb.cpu.AF_bytes.A ^= gb.cpu.BC_bytes.C;                       // do the XOR
-    gb.cpu.AF_bytes.F = 0;                                        // clear all flags
-    gb.cpu.AF_bytes.F |= ((gb.cpu.AF_bytes.A == 0) * CPU_FLAG_Z); // Z flag if result is 0
+    gb.cpu.set_flags((gb.cpu.AF_bytes.A == 0) * CPU_FLAG_Z); // Z flag if result is 0, others cleared
 
     gb.cpu.PC += 1;
     return 4;
 }
 
+template <bool ACCURATE>
 uint8_t op_0xA1_AND_A_C(Gameboy &gb)
 {
     gb.cpu.AF_bytes.A &= gb.cpu.BC_bytes.C;                       // do the AND
-    gb.cpu.AF_bytes.F = CPU_FLAG_H;                               // set H flag, clear others
-    gb.cpu.AF_bytes.F |= ((gb.cpu.AF_bytes.A == 0) * CPU_FLAG_Z); // Z flag if result is 0
+    gb.cpu.set_flags(CPU_FLAG_H | ((gb.cpu.AF_bytes.A == 0) * CPU_FLAG_Z)); // set H flag, Z flag if result is 0
 
     gb.cpu.PC += 1;
     return 4;
 }
 
+template <bool ACCURATE>
 uint8_t op_0x79_LD_A_C(Gameboy &gb)
 {
     gb.cpu.AF_bytes.A = gb.cpu.BC_bytes.C; // copy C into A
@@ -668,41 +724,40 @@ uint8_t op_0x79_LD_A_C(Gameboy &gb)
     return 4;
 }
 
+template <bool ACCURATE>
 uint8_t op_0xEF_RST_28h(Gameboy &gb)
 {
     // push address of next instruction (PC + 1, after RST) onto stack
+    gb.bus_idle<ACCURATE>(); // internal cycle before the push
     gb.cpu.SP -= 2;
-    gb.mmu.write16(gb.cpu.SP, gb.cpu.PC + 1);
+    gb.bus_write16<ACCURATE>(gb.cpu.SP, gb.cpu.PC + 1);
 
     gb.cpu.PC = 0x28; // jump to address 0x28
     return 16;
 }
 
+template <bool ACCURATE>
 uint8_t op_0x87_ADD_A_A(Gameboy &gb)
 {
     uint8_t value = gb.cpu.AF_bytes.A;
-    uint16_t result = static_cast<uint16_t>(gb.cpu.AF_bytes.A) + static_cast<uint16_t>(value);
-
-    gb.cpu.AF_bytes.F = 0;                                                                    // clear all flags
-    gb.cpu.AF_bytes.F |= ((result & 0xFF) == 0) * CPU_FLAG_Z;                                 // Z flag if result is 0
-    gb.cpu.AF_bytes.F |= (((gb.cpu.AF_bytes.A & 0x0F) + (value & 0x0F)) > 0x0F) * CPU_FLAG_H; // H flag if carry from bit 4
-    gb.cpu.AF_bytes.F |= ((result > 0xFF) * CPU_FLAG_C);                                      // C flag if carry (result > 255)
-
-    gb.cpu.AF_bytes.A = static_cast<uint8_t>(result & 0xFF); // store low 8 bits of result in A
+    gb.cpu.flags_add(gb.cpu.AF_bytes.A, value); // Z, H, C from A + value
+    gb.cpu.AF_bytes.A += value;
 
     gb.cpu.PC += 1;
     return 4;
 }
 
+template <bool ACCURATE>
 uint8_t op_0xE1_POP_HL(Gameboy &gb)
 {
-    gb.cpu.HL = gb.mmu.read16(gb.cpu.SP); // read 16-bit value from memory at address SP into HL
-    gb.cpu.SP += 2;                       // increment stack pointer by 2
+    gb.cpu.HL = gb.bus_read16<ACCURATE>(gb.cpu.SP); // read 16-bit value from memory at address SP into HL
+    gb.cpu.SP += 2;                                 // increment stack pointer by 2
 
     gb.cpu.PC += 1;
     return 12;
 }
 
+template <bool ACCURATE>
 uint8_t op_0x5F_LD_E_A(Gameboy &gb)
 {
     gb.cpu.DE_bytes.E = gb.cpu.AF_bytes.A; // copy A into E
@@ -711,13 +766,15 @@ uint8_t op_0x5F_LD_E_A(Gameboy &gb)
     return 4;
 }
 
+template <bool ACCURATE>
 uint8_t op_0x19_ADD_HL_DE(Gameboy &gb)
 {
     uint32_t result = static_cast<uint32_t>(gb.cpu.HL) + static_cast<uint32_t>(gb.cpu.DE);
 
-    gb.cpu.AF_bytes.F &= CPU_FLAG_Z;                                                            // preserve Z flag, clear others
-    gb.cpu.AF_bytes.F |= (((gb.cpu.HL & 0x0FFF) + (gb.cpu.DE & 0x0FFF)) > 0x0FFF) * CPU_FLAG_H; // H flag if carry from bit 12
-    gb.cpu.AF_bytes.F |= ((result > 0xFFFF) * CPU_FLAG_C);                                      // C flag if carry (result > 65535)
+    uint8_t flags = gb.cpu.flag_z() * CPU_FLAG_Z;                                   // preserve Z flag, clear others
+    flags |= (((gb.cpu.HL & 0x0FFF) + (gb.cpu.DE & 0x0FFF)) > 0x0FFF) * CPU_FLAG_H; // H flag if carry from bit 12
+    flags |= ((result > 0xFFFF) * CPU_FLAG_C);                                      // C flag if carry (result > 65535)
+    gb.cpu.set_flags(flags);
 
     gb.cpu.HL = static_cast<uint16_t>(result & 0xFFFF); // store low 16 bits of result in HL
 
@@ -725,37 +782,43 @@ uint8_t op_0x19_ADD_HL_DE(Gameboy &gb)
     return 8;
 }
 
+template <bool ACCURATE>
 uint8_t op_0x5E_LD_E_HL(Gameboy &gb)
 {
-    gb.cpu.DE_bytes.E = gb.mmu.read8(gb.cpu.HL); // load E from memory at address HL
+    gb.cpu.DE_bytes.E = gb.bus_read8<ACCURATE>(gb.cpu.HL); // load E from memory at address HL
 
     gb.cpu.PC += 1;
     return 8;
 }
 
+template <bool ACCURATE>
 uint8_t op_0x56_LD_D_HL(Gameboy &gb)
 {
-    gb.cpu.DE_bytes.D = gb.mmu.read8(gb.cpu.HL); // load D from memory at address HL
+    gb.cpu.DE_bytes.D = gb.bus_read8<ACCURATE>(gb.cpu.HL); // load D from memory at address HL
 
     gb.cpu.PC += 1;
     return 8;
 }
 
+template <bool ACCURATE>
 uint8_t op_0xD5_PUSH_DE(Gameboy &gb)
 {
-    gb.cpu.SP -= 2;                       // decrement stack pointer by 2
-    gb.mmu.write16(gb.cpu.SP, gb.cpu.DE); // write DE to memory at address SP
+    gb.bus_idle<ACCURATE>();                        // internal cycle before the push
+    gb.cpu.SP -= 2;                                 // decrement stack pointer by 2
+    gb.bus_write16<ACCURATE>(gb.cpu.SP, gb.cpu.DE); // write DE to memory at address SP
 
     gb.cpu.PC += 1;
     return 16;
 }
 
+template <bool ACCURATE>
 uint8_t op_0xE9_JP_HL(Gameboy &gb)
 {
     gb.cpu.PC = gb.cpu.HL; // jump to address in HL
     return 4;
 }
 
+template <bool ACCURATE>
 uint8_t op_0xCB_0x87_RES_0_A(Gameboy &gb)
 {
     gb.cpu.AF_bytes.A &= ~(1 << 0); // reset bit 0 of A
@@ -764,76 +827,84 @@ uint8_t op_0xCB_0x87_RES_0_A(Gameboy &gb)
     return 8;
 }
 
+template <bool ACCURATE>
 uint8_t op_0x12_LD_DE_A(Gameboy &gb)
 {
-    gb.mmu.write8(gb.cpu.DE, gb.cpu.AF_bytes.A); // write A to address DE
+    gb.bus_write8<ACCURATE>(gb.cpu.DE, gb.cpu.AF_bytes.A); // write A to address DE
 
     gb.cpu.PC += 1;
     return 8;
 }
 
+template <bool ACCURATE>
 uint8_t op_0xE5_PUSH_HL(Gameboy &gb)
 {
-    gb.cpu.SP -= 2;                       // decrement stack pointer by 2
-    gb.mmu.write16(gb.cpu.SP, gb.cpu.HL); // write HL to memory at address SP
+    gb.bus_idle<ACCURATE>();                        // internal cycle before the push
+    gb.cpu.SP -= 2;                                 // decrement stack pointer by 2
+    gb.bus_write16<ACCURATE>(gb.cpu.SP, gb.cpu.HL); // write HL to memory at address SP
 
     gb.cpu.PC += 1;
     return 16;
 }
 
+template <bool ACCURATE>
 uint8_t op_0xD1_POP_DE(Gameboy &gb)
 {
-    gb.cpu.DE = gb.mmu.read16(gb.cpu.SP); // read 16-bit value from memory at address SP into DE
-    gb.cpu.SP += 2;                       // increment stack pointer by 2
+    gb.cpu.DE = gb.bus_read16<ACCURATE>(gb.cpu.SP); // read 16-bit value from memory at address SP into DE
+    gb.cpu.SP += 2;                                 // increment stack pointer by 2
 
     gb.cpu.PC += 1;
     return 12;
 }
 
+template <bool ACCURATE>
 uint8_t op_0xF5_PUSH_AF(Gameboy &gb)
 {
-    gb.cpu.SP -= 2;                       // decrement stack pointer by 2
-    gb.mmu.write16(gb.cpu.SP, gb.cpu.AF); // write AF to memory at address SP
+    gb.cpu.flags();                                 // materialize F before it's stored
+    gb.bus_idle<ACCURATE>();                        // internal cycle before the push
+    gb.cpu.SP -= 2;                                 // decrement stack pointer by 2
+    gb.bus_write16<ACCURATE>(gb.cpu.SP, gb.cpu.AF); // write AF to memory at address SP
 
     gb.cpu.PC += 1;
     return 16;
 }
 
+template <bool ACCURATE>
 uint8_t op_0xFA_LD_A_u16(Gameboy &gb)
 {
-    gb.cpu.AF_bytes.A = gb.mmu.read8(gb.mmu.read16(gb.cpu.PC + 1)); // load A from address
+    gb.cpu.AF_bytes.A = gb.bus_read8<ACCURATE>(gb.bus_read16<ACCURATE>(gb.cpu.PC + 1)); // load A from address
 
     gb.cpu.PC += 3;
     return 16;
 }
 
+template <bool ACCURATE>
 uint8_t op_0xA7_AND_A_A(Gameboy &gb)
 {
     // this technically would do A &= A, but that's a no-op, so just set flags
-    gb.cpu.AF_bytes.F = CPU_FLAG_H;                               // set H flag, clear others
-    gb.cpu.AF_bytes.F |= ((gb.cpu.AF_bytes.A == 0) * CPU_FLAG_Z); // Z flag if result is 0
+    gb.cpu.set_flags(CPU_FLAG_H | ((gb.cpu.AF_bytes.A == 0) * CPU_FLAG_Z)); // set H flag, Z flag if result is 0
 
     gb.cpu.PC += 1;
     return 4;
 }
 
+template <bool ACCURATE>
 uint8_t op_0x1C_INC_E(Gameboy &gb)
 {
     gb.cpu.DE_bytes.E += 1; // increment E
 
-    gb.cpu.AF_bytes.F &= CPU_FLAG_C;                                       // preserve C flag, clear others
-    gb.cpu.AF_bytes.F |= ((gb.cpu.DE_bytes.E == 0) * CPU_FLAG_Z);          // Z flag if result is 0
-    gb.cpu.AF_bytes.F |= (((gb.cpu.DE_bytes.E & 0x0F) == 0) * CPU_FLAG_H); // H flag if low nibble overflowed
+    gb.cpu.flags_inc(gb.cpu.DE_bytes.E); // Z, H from the result, C unchanged
 
     gb.cpu.PC += 1;
     return 4;
 }
 
+template <bool ACCURATE>
 uint8_t op_0xCA_JP_Z_u16(Gameboy &gb)
 {
-    uint16_t addr = gb.mmu.read16(gb.cpu.PC + 1); // get 16-bit address to jump to
+    uint16_t addr = gb.bus_read16<ACCURATE>(gb.cpu.PC + 1); // get 16-bit address to jump to
 
-    if (gb.cpu.AF_bytes.F & CPU_FLAG_Z) // if Z flag set
+    if (gb.cpu.flag_z()) // if Z flag set
     {
         gb.cpu.PC = addr; // jump to address
         return 16;
@@ -843,12 +914,15 @@ uint8_t op_0xCA_JP_Z_u16(Gameboy &gb)
     return 12;
 }
 
+template <bool ACCURATE>
 uint8_t op_0xC8_RET_Z(Gameboy &gb)
 {
-    if (gb.cpu.AF_bytes.F & CPU_FLAG_Z) // if Z flag set
+    gb.bus_idle<ACCURATE>(); // internal cycle for the condition check
+
+    if (gb.cpu.flag_z()) // if Z flag set
     {
-        gb.cpu.PC = gb.mmu.read16(gb.cpu.SP); // pop return address from stack into PC
-        gb.cpu.SP += 2;                       // increment stack pointer by 2
+        gb.cpu.PC = gb.bus_read16<ACCURATE>(gb.cpu.SP); // pop return address from stack into PC
+        gb.cpu.SP += 2;                                 // increment stack pointer by 2
         return 20;
     }
 
@@ -856,33 +930,166 @@ uint8_t op_0xC8_RET_Z(Gameboy &gb)
     return 8;
 }
 
+template <bool ACCURATE>
 uint8_t op_0x7E_LD_A_HL(Gameboy &gb)
 {
-    gb.cpu.AF_bytes.A = gb.mmu.read8(gb.cpu.HL); // load A from memory at address HL
+    gb.cpu.AF_bytes.A = gb.bus_read8<ACCURATE>(gb.cpu.HL); // load A from memory at address HL
 
     gb.cpu.PC += 1;
     return 8;
 }
 
+template <bool ACCURATE>
 uint8_t op_0xF1_POP_AF(Gameboy &gb)
 {
-    gb.cpu.AF = gb.mmu.read16(gb.cpu.SP); // read 16-bit value from memory at address SP into AF
-    gb.cpu.SP += 2;                       // increment stack pointer by 2
-    gb.cpu.AF_bytes.F &= 0xF0;            // ensure lower nibble of F is always zero
+    gb.cpu.AF = gb.bus_read16<ACCURATE>(gb.cpu.SP); // read 16-bit value from memory at address SP into AF
+    gb.cpu.SP += 2;                                 // increment stack pointer by 2
+    gb.cpu.set_flags(gb.cpu.AF_bytes.F & 0xF0);     // ensure lower nibble of F is always zero
 
     gb.cpu.PC += 1;
     return 12;
 }
 
-uint8_t op_unimplemented(Gameboy &gb)
+template <bool ACCURATE>
+uint8_t op_0x10_STOP(Gameboy &gb)
 {
-    std::cerr << "Unimplemented opcode: 0x" << std::hex
-              << (int)gb.mmu.read8(gb.cpu.PC) << " at PC: " << gb.cpu.PC << std::dec
-              << std::endl;
+    // on CGB, STOP performs a speed switch if one was prepared through KEY1
+    if (gb.mmu.cgb && (gb.mmu.mem[0xFF4D] & 0x01))
+    {
+        gb.cpu.speed_shift ^= 1;
+        gb.mmu.mem[0xFF4D] = (gb.cpu.speed_shift << 7) | 0x7E;
+    }
+    else
+    {
+        gb.raise_fault(GB_FAULT_STOPPED); // low power mode, run_frame() waits for a button
+    }
+
+    gb.cpu.PC += 2;
+    return 4;
+}
 
-    std::cerr << "Next byte in memory: 0x" << std::hex
-              << (int)gb.mmu.read8(gb.cpu.PC + 1) << std::dec << std::endl;
-    exit(1);
+uint8_t op_unimplemented(Gameboy &gb)
+{
+    // PC stays on the opcode. on the fast core no cycles pass, the accurate
+    // core has already ticked the fetch (and the CB prefix), so total_cycles
+    // at the fault differs between the cores
+    gb.raise_fault(GB_FAULT_UNIMPLEMENTED_OPCODE);
+    return 0;
+}
 
+uint8_t op_illegal(Gameboy &gb)
+{
+    gb.raise_fault(GB_FAULT_ILLEGAL_OPCODE); // hardware hangs until power off
     return 0;
 }
+
+template <bool ACCURATE>
+void fill_opcode_tables(OpcodeHandler *opcodes, OpcodeHandler *cb_opcodes)
+{
+    for (size_t i = 0; i < GB_NUM_OPCODES; i++)
+    {
+        opcodes[i] = op_unimplemented;
+        cb_opcodes[i] = op_unimplemented;
+    }
+
+    for (uint8_t opcode : {0xD3, 0xDB, 0xDD, 0xE3, 0xE4, 0xEB, 0xEC, 0xED, 0xF4, 0xFC, 0xFD})
+    {
+        opcodes[opcode] = op_illegal;
+    }
+
+    opcodes[0x00] = op_0x00_NOP<ACCURATE>;
+    opcodes[0x01] = op_0x01_LD_BC_u16<ACCURATE>;
+    opcodes[0x04] = op_0x04_INC_B<ACCURATE>;
+    opcodes[0x05] = op_0x05_DEC_B<ACCURATE>;
+    opcodes[0x06] = op_0x06_LD_B_u8<ACCURATE>;
+    opcodes[0x0B] = op_0x0B_DEC_BC<ACCURATE>;
+    opcodes[0x0C] = op_0x0C_INC_C<ACCURATE>;
+    opcodes[0x0D] = op_0x0D_DEC_C<ACCURATE>;
+    opcodes[0x0E] = op_0x0E_LD_C_u8<ACCURATE>;
+    opcodes[0x10] = op_0x10_STOP<ACCURATE>;
+    opcodes[0x11] = op_0x11_LD_DE_u16<ACCURATE>;
+    opcodes[0x12] = op_0x12_LD_DE_A<ACCURATE>;
+    opcodes[0x13] = op_0x13_INC_DE<ACCURATE>;
+    opcodes[0x15] = op_0x15_DEC_D<ACCURATE>;
+    opcodes[0x16] = op_0x16_LD_D_u8<ACCURATE>;
+    opcodes[0x17] = op_0x17_RLA<ACCURATE>;
+    opcodes[0x18] = op_0x18_JR_i8<ACCURATE>;
+    opcodes[0x19] = op_0x19_ADD_HL_DE<ACCURATE>;
+    opcodes[0x1A] = op_0x1A_LD_A_DE<ACCURATE>;
+    opcodes[0x1C] = op_0x1C_INC_E<ACCURATE>;
+    opcodes[0x1D] = op_0x1D_DEC_E<ACCURATE>;
+    opcodes[0x1E] = op_0x1E_LD_E_u8<ACCURATE>;
+    opcodes[0x20] = op_0x20_JR_NZ_i8<ACCURATE>;
+    opcodes[0x21] = op_0x21_LD_HL_u16<ACCURATE>;
+    opcodes[0x22] = op_0x22_LD_HLp_A<ACCURATE>;
+    opcodes[0x23] = op_0x23_INC_HL<ACCURATE>;
+    opcodes[0x24] = op_0x24_INC_H<ACCURATE>;
+    opcodes[0x28] = op_0x28_JR_Z_i8<ACCURATE>;
+    opcodes[0x2A] = op_0x2A_LD_A_HLp<ACCURATE>;
+    opcodes[0x2E] = op_0x2E_LD_L_u8<ACCURATE>;
+    opcodes[0x2F] = op_0x2F_CPL<ACCURATE>;
+    opcodes[0x31] = op_0x31_LD_SP_u16<ACCURATE>;
+    opcodes[0x32] = op_0x32_LD_HLm_A<ACCURATE>;
+    opcodes[0x36] = op_0x36_LD_HL_u8<ACCURATE>;
+    opcodes[0x3D] = op_0x3D_DEC_A<ACCURATE>;
+    opcodes[0x47] = op_0x47_LD_B_A<ACCURATE>;
+    opcodes[0x4F] = op_0x4F_LD_C_A<ACCURATE>;
+    opcodes[0x56] = op_0x56_LD_D_HL<ACCURATE>;
+    opcodes[0x57] = op_0x57_LD_D_A<ACCURATE>;
+    opcodes[0x5E] = op_0x5E_LD_E_HL<ACCURATE>;
+    opcodes[0x5F] = op_0x5F_LD_E_A<ACCURATE>;
+    opcodes[0x67] = op_0x67_LD_H_A<ACCURATE>;
+    opcodes[0x77] = op_0x77_LD_HL_A<ACCURATE>;
+    opcodes[0x78] = op_0x78_LD_A_B<ACCURATE>;
+    opcodes[0x79] = op_0x79_LD_A_C<ACCURATE>;
+    opcodes[0x7B] = op_0x7B_LD_A_E<ACCURATE>;
+    opcodes[0x7C] = op_0x7C_LD_A_H<ACCURATE>;
+    opcodes[0x7D] = op_0x7D_LD_A_L<ACCURATE>;
+    opcodes[0x7E] = op_0x7E_LD_A_HL<ACCURATE>;
+    opcodes[0x86] = op_0x86_ADD_A_HL<ACCURATE>;
+    opcodes[0x87] = op_0x87_ADD_A_A<ACCURATE>;
+    opcodes[0x90] = op_0x90_SUB_A_B<ACCURATE>;
+    opcodes[0x3E] = op_0x3E_LD_A_u8<ACCURATE>;
+    opcodes[0xA1] = op_0xA1_AND_A_C<ACCURATE>;
+    opcodes[0xA7] = op_0xA7_AND_A_A<ACCURATE>;
+    opcodes[0xA9] = op_0xA9_XOR_A_C<ACCURATE>;
+    opcodes[0xAF] = op_0xAF_XOR_A_A<ACCURATE>;
+    opcodes[0xB0] = op_0xB0_OR_A_B<ACCURATE>;
+    opcodes[0xB1] = op_0xB1_OR_A_C<ACCURATE>;
+    opcodes[0XBE] = op_0xBE_CP_A_HL<ACCURATE>;
+    opcodes[0xC1] = op_0xC1_POP_BC<ACCURATE>;
+    opcodes[0xC3] = op_0xC3_JP_u16<ACCURATE>;
+    opcodes[0xC5] = op_0xC5_PUSH_BC<ACCURATE>;
+    opcodes[0xC8] = op_0xC8_RET_Z<ACCURATE>;
+    opcodes[0xC9] = op_0xC9_RET<ACCURATE>;
+    opcodes[0xCA] = op_0xCA_JP_Z_u16<ACCURATE>;
+    opcodes[0xCB] = op_0xCB_prefixed<ACCURATE>;
+    opcodes[0xCD] = op_0xCD_CALL_u16<ACCURATE>;
+    opcodes[0xCE] = op_0xCE_ADC_A_u8<ACCURATE>;
+    opcodes[0xD1] = op_0xD1_POP_DE<ACCURATE>;
+    opcodes[0xD5] = op_0xD5_PUSH_DE<ACCURATE>;
+    opcodes[0xDE] = op_0xDE_SBC_A_u8<ACCURATE>;
+    opcodes[0xE0] = op_0xE0_LD_u8_A<ACCURATE>;
+    opcodes[0xE1] = op_0xE1_POP_HL<ACCURATE>;
+    opcodes[0xE2] = op_0xE2_LD_C_A<ACCURATE>;
+    opcodes[0xE5] = op_0xE5_PUSH_HL<ACCURATE>;
+    opcodes[0xE6] = op_0xE6_AND_A_u8<ACCURATE>;
+    opcodes[0xE9] = op_0xE9_JP_HL<ACCURATE>;
+    opcodes[0xEA] = op_0xEA_LD_u16_A<ACCURATE>;
+    opcodes[0xEF] = op_0xEF_RST_28h<ACCURATE>;
+    opcodes[0xF0] = op_0xF0_LD_A_FF00_u8<ACCURATE>;
+    opcodes[0xF1] = op_0xF1_POP_AF<ACCURATE>;
+    opcodes[0xF3] = op_0xF3_DI<ACCURATE>;
+    opcodes[0xF5] = op_0xF5_PUSH_AF<ACCURATE>;
+    opcodes[0xFA] = op_0xFA_LD_A_u16<ACCURATE>;
+    opcodes[0xFB] = op_0xFB_EI<ACCURATE>;
+    opcodes[0xFE] = op_0xFE_CP_A_u8<ACCURATE>;
+
+    cb_opcodes[0x11] = op_0xCB_0x11_RL_C<ACCURATE>;
+    cb_opcodes[0x37] = op_0xCB_0x37_SWAP_A<ACCURATE>;
+    cb_opcodes[0x7C] = op_0xCB_0x7C_BIT_7_H<ACCURATE>;
+    cb_opcodes[0x87] = op_0xCB_0x87_RES_0_A<ACCURATE>;
+}
+
+template void fill_opcode_tables<false>(OpcodeHandler *opcodes, OpcodeHandler *cb_opcodes);
+template void fill_opcode_tables<true>(OpcodeHandler *opcodes, OpcodeHandler *cb_opcodes);
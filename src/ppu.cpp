@@ -1,11 +1,16 @@
 #include "ppu.h"
 
+#include <algorithm>
+#include <climits>
+#include <cstring>
+
 void PPU::step(int cycles)
 {
     // LCD is off, reset state
     if (!(mmu.read8(0xFF40) & 0x80))
     {
         scanline_cycles = 0;
+        window_line = 0;
         mmu.write8(0xFF44, 0);                                             // LY = 0
         mmu.write8(0xFF41, (mmu.read8(0xFF41) & ~0x03) | PPU_MODE_HBLANK); // mode = HBlank
         check_lyc();
@@ -32,8 +37,9 @@ void PPU::step(int cycles)
         if (scanline_cycles >= 172)
         {
             scanline_cycles -= 172;
+            render_scanline(); // sprites aren't drawn yet
             mmu.write8(0xFF41, (mmu.read8(0xFF41) & ~0x03) | PPU_MODE_HBLANK); // switch mode
-            // TODO render scanline to buffer here
+            mmu.hdma_hblank();                                                 // CGB HBlank DMA, if any
         }
 
         break;
@@ -73,6 +79,7 @@ void PPU::step(int cycles)
             if (LY > 153)
             {
                 // start new frame
+                window_line = 0;
                 mmu.write8(0xFF44, 0);                                          // reset LY to 0
                 mmu.write8(0xFF41, (mmu.read8(0xFF41) & ~0x03) | PPU_MODE_OAM); // switch mode
                 check_lyc();
@@ -109,4 +116,158 @@ void PPU::check_lyc()
     }
 
     mmu.write8(0xFF41, stat);
-}
\ No newline at end of file
+}
+
+int PPU::cycles_until_event() const
+{
+    // LCD is off, LY and STAT stay as they are
+    if (!(mmu.read8(0xFF40) & 0x80))
+    {
+        return INT_MAX;
+    }
+
+    switch (mmu.read8(0xFF41) & 0x03) // current LCD mode
+    {
+    case PPU_MODE_OAM:
+        return 80 - scanline_cycles;
+    case PPU_MODE_DRAWING:
+        return 172 - scanline_cycles;
+    case PPU_MODE_HBLANK:
+        return 204 - scanline_cycles;
+    default:
+        return 456 - scanline_cycles;
+    }
+}
+
+void PPU::render_scanline()
+{
+    uint8_t LY = mmu.mem[0xFF44];
+    uint8_t lcdc = mmu.mem[0xFF40];
+
+    if (LY >= PPU_SCREEN_HEIGHT)
+    {
+        return;
+    }
+
+    uint8_t *line = line_buffer.data();
+
+    // on DMG, LCDC bit 0 blanks background and window. on CGB it only
+    // takes away their priority over sprites
+    if (!mmu.cgb && !(lcdc & 0x01))
+    {
+        line_buffer.fill(0);
+        commit_line(LY);
+        return;
+    }
+
+    uint8_t palette[4] = {0, 1, 2, 3};
+
+    if (!mmu.cgb)
+    {
+        uint8_t bgp = mmu.mem[0xFF47];
+
+        for (int i = 0; i < 4; i++)
+        {
+            palette[i] = (bgp >> (i * 2)) & 0x03;
+        }
+    }
+
+    // the window covers the line from WX - 7 to the right edge
+    int window_x = PPU_SCREEN_WIDTH;
+
+    if ((lcdc & 0x20) && LY >= mmu.mem[0xFF4A] && mmu.mem[0xFF4B] < PPU_SCREEN_WIDTH + 7)
+    {
+        window_x = std::max(mmu.mem[0xFF4B] - 7, 0);
+    }
+
+    uint16_t bg_map = (lcdc & 0x08) ? 0x9C00 : 0x9800;
+    render_span(line, 0, window_x, bg_map, mmu.mem[0xFF43], mmu.mem[0xFF42] + LY, palette);
+
+    if (window_x < PPU_SCREEN_WIDTH)
+    {
+        uint16_t window_map = (lcdc & 0x40) ? 0x9C00 : 0x9800;
+        render_span(line, window_x, PPU_SCREEN_WIDTH, window_map, 7 - mmu.mem[0xFF4B], window_line, palette);
+        window_line++;
+    }
+
+    commit_line(LY);
+}
+
+std::array<uint64_t, PPU_DIRTY_WORDS> PPU::dirty_lines(uint64_t seen) const
+{
+    std::array<uint64_t, PPU_DIRTY_WORDS> words{};
+
+    for (int y = 0; y < PPU_SCREEN_HEIGHT; y++)
+    {
+        words[y >> 6] |= uint64_t(line_dirty(y, seen)) << (y & 63);
+    }
+
+    return words;
+}
+
+void PPU::commit_line(int y)
+{
+    uint8_t *line = &framebuffer[y * PPU_SCREEN_WIDTH];
+
+    if (std::memcmp(line, line_buffer.data(), PPU_SCREEN_WIDTH) == 0)
+    {
+        return; // static lines cost a compare and nothing else
+    }
+
+    std::memcpy(line, line_buffer.data(), PPU_SCREEN_WIDTH);
+    line_versions[y] = ++line_version;
+
+    uint8_t *packed = &packed_frame[y * PPU_PACKED_LINE_SIZE];
+
+    for (int i = 0; i < PPU_PACKED_LINE_SIZE; i++)
+    {
+        const uint8_t *pixels = &line_buffer[i * 4];
+        packed[i] = pixels[0] | (pixels[1] << 2) | (pixels[2] << 4) | (pixels[3] << 6);
+    }
+}
+
+// draws pixels [start, end) of a line from a 32x32 tile map, screen x maps to
+// tile map x + offset (mod 256) and y is the tile map line
+void PPU::render_span(uint8_t *line, int start, int end, uint16_t map, int offset, uint8_t y, const uint8_t *palette)
+{
+    bool signed_tiles = !(mmu.mem[0xFF40] & 0x10); // tiles 0-127 at 0x9000, 128-255 at 0x8800
+    size_t map_row = (map - 0x8000) + (y >> 3) * 32;
+
+    const uint8_t *tile_map = &mmu.mem[0x8000 + map_row];
+    const uint8_t *attributes = mmu.cgb ? &mmu.vram_bank1[map_row] : nullptr; // CGB map attributes in bank 1
+
+    int x = start;
+
+    while (x < end)
+    {
+        uint8_t map_x = static_cast<uint8_t>(x + offset);
+        uint8_t tile_id = tile_map[map_x >> 3];
+        uint8_t attribute = attributes ? attributes[map_x >> 3] : 0;
+
+        int tile = signed_tiles ? 256 + static_cast<int8_t>(tile_id) : tile_id;
+        int tile_y = (attribute & 0x40) ? 7 - (y & 7) : y & 7; // vertical flip
+        int bank = (attribute >> 3) & 0x01;
+        const uint8_t *vram = bank ? &mmu.vram_bank1[0] : &mmu.mem[0x8000];
+        const uint8_t *row = mmu.tile_cache.row(vram, bank, tile, tile_y);
+
+        int first = map_x & 7;
+        int count = std::min(8 - first, end - x);
+
+        if (attribute & 0x20) // horizontal flip
+        {
+            for (int i = 0; i < count; i++)
+            {
+                line[x + i] = palette[row[7 - first - i]];
+            }
+        }
+        else
+        {
+            for (int i = 0; i < count; i++)
+            {
+                line[x + i] = palette[row[first + i]];
+            }
+        }
+
+        x += count;
+    }
+}
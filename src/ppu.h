@@ -1,5 +1,6 @@
 #pragma once
 
+#include <array>
 #include <cstdint>
 
 #include "mmu.h"
@@ -9,15 +10,52 @@ constexpr int PPU_MODE_VBLANK = 1;
 constexpr int PPU_MODE_OAM = 2;
 constexpr int PPU_MODE_DRAWING = 3;
 
+constexpr int PPU_SCREEN_WIDTH = 160;
+constexpr int PPU_SCREEN_HEIGHT = 144;
+
+// 2bpp packed frame, 4 pixels per byte with the leftmost in the low bits
+constexpr int PPU_PACKED_LINE_SIZE = PPU_SCREEN_WIDTH / 4;
+constexpr int PPU_DIRTY_WORDS = (PPU_SCREEN_HEIGHT + 63) / 64; // 64 lines per bitmap word
+
 // pixel processing unit
 
 struct PPU
 {
     MMU &mmu;            // reference to MMU for memory access
     int scanline_cycles; // cycles spent on current scanline
+    uint8_t window_line; // next line of the window to draw, counts only lines it was visible on
+
+    // shade index (0-3) per pixel, row-major. in CGB mode the color index
+    // within the tile's palette, CGB palettes aren't applied
+    std::array<uint8_t, PPU_SCREEN_WIDTH * PPU_SCREEN_HEIGHT> framebuffer{};
+
+    // for streaming: the framebuffer packed to 2 bits per pixel, and when
+    // each line last changed. only lines whose pixels differ from the previous
+    // frame are repacked. every consumer keeps the line_version it last caught
+    // up to, starting at 0, so any number of them track changed lines
+    // independently without resetting anything in the PPU
+    std::array<uint8_t, PPU_PACKED_LINE_SIZE * PPU_SCREEN_HEIGHT> packed_frame{};
+    std::array<uint64_t, PPU_SCREEN_HEIGHT> line_versions; // line_version right after the line last changed
+    uint64_t line_version;                                  // bumped by every changed line
+    std::array<uint8_t, PPU_SCREEN_WIDTH> line_buffer;      // line being drawn
+
+    // changed after the consumer that saw version seen looked, it then takes line_version as its new seen
+    bool line_dirty(int y, uint64_t seen) const { return line_versions[y] > seen; }
+    std::array<uint64_t, PPU_DIRTY_WORDS> dirty_lines(uint64_t seen) const; // bit y % 64 of word y / 64
+    void commit_line(int y); // move line_buffer into the framebuffer if it changed
 
     void step(int cycles); // advance PPU state by given CPU cycles
     void check_lyc();      // check LYC=LY coincidence and trigger interrupt if needed
 
-    PPU(MMU &mmu_ref) : mmu(mmu_ref), scanline_cycles(0) {} // constructor
+    // draw background and window of the current line into the framebuffer,
+    // whole tile rows at a time from the MMU's tile cache
+    void render_scanline();
+    void render_span(uint8_t *line, int start, int end, uint16_t map, int offset, uint8_t y, const uint8_t *palette);
+
+    int cycles_until_event() const; // cycles until step() next changes LY or STAT
+
+    PPU(MMU &mmu_ref) : mmu(mmu_ref), scanline_cycles(0), window_line(0), line_version(1)
+    {
+        line_versions.fill(1); // a new consumer has nothing yet
+    }
 };
@@ -0,0 +1,195 @@
+#include "profiler.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <vector>
+
+thread_local OpcodeProfile *profile_current = nullptr;
+
+// buffers outlive their threads, so counts of finished workers still show up in reports
+static std::mutex profile_mutex;
+static std::vector<std::unique_ptr<OpcodeProfile>> profile_buffers;
+
+void OpcodeProfile::record(uint16_t pc, uint8_t opcode, uint8_t cb_opcode, uint8_t cycles)
+{
+    if (opcode == 0xCB)
+    {
+        cb_count[cb_opcode]++;
+        cb_cycles[cb_opcode] += cycles;
+        pc_opcode[pc] = PROFILE_CB_BIT | cb_opcode;
+    }
+    else
+    {
+        opcode_count[opcode]++;
+        opcode_cycles[opcode] += cycles;
+        pc_opcode[pc] = opcode;
+    }
+
+    pc_count[pc]++;
+    pc_cycles[pc] += cycles;
+}
+
+void OpcodeProfile::merge(const OpcodeProfile &other)
+{
+    for (size_t i = 0; i < 256; i++)
+    {
+        opcode_count[i] += other.opcode_count[i];
+        opcode_cycles[i] += other.opcode_cycles[i];
+        cb_count[i] += other.cb_count[i];
+        cb_cycles[i] += other.cb_cycles[i];
+    }
+
+    for (size_t pc = 0; pc < 0x10000; pc++)
+    {
+        if (other.pc_count[pc])
+        {
+            pc_count[pc] += other.pc_count[pc];
+            pc_cycles[pc] += other.pc_cycles[pc];
+            pc_opcode[pc] = other.pc_opcode[pc];
+        }
+    }
+}
+
+void OpcodeProfile::clear()
+{
+    opcode_count.fill(0);
+    opcode_cycles.fill(0);
+    cb_count.fill(0);
+    cb_cycles.fill(0);
+    pc_count.fill(0);
+    pc_cycles.fill(0);
+    pc_opcode.fill(0);
+}
+
+OpcodeProfile &profile_register_thread()
+{
+    std::lock_guard<std::mutex> lock(profile_mutex);
+
+    profile_buffers.push_back(std::make_unique<OpcodeProfile>());
+    profile_current = profile_buffers.back().get();
+
+    return *profile_current;
+}
+
+std::unique_ptr<OpcodeProfile> profile_merged()
+{
+    std::lock_guard<std::mutex> lock(profile_mutex);
+
+    auto merged = std::make_unique<OpcodeProfile>(); // too large for the stack
+
+    for (const auto &buffer : profile_buffers)
+    {
+        merged->merge(*buffer);
+    }
+
+    return merged;
+}
+
+void profile_reset()
+{
+    std::lock_guard<std::mutex> lock(profile_mutex);
+
+    for (auto &buffer : profile_buffers)
+    {
+        buffer->clear();
+    }
+}
+
+static std::string opcode_name(uint16_t opcode)
+{
+    char name[16];
+
+    if (opcode & PROFILE_CB_BIT)
+    {
+        std::snprintf(name, sizeof(name), "0xCB_0x%02X", opcode & 0xFF);
+    }
+    else
+    {
+        std::snprintf(name, sizeof(name), "0x%02X", opcode);
+    }
+
+    return name;
+}
+
+std::string profile_collapsed(const OpcodeProfile &profile)
+{
+    // one stack per PC: opcode;address cycles, so the flamegraph groups
+    // hot code addresses under the instruction they execute
+
+    std::string out;
+    char line[64];
+
+    for (size_t pc = 0; pc < 0x10000; pc++)
+    {
+        if (profile.pc_cycles[pc])
+        {
+            std::snprintf(line, sizeof(line), "%s;0x%04zX %llu\n", opcode_name(profile.pc_opcode[pc]).c_str(), pc,
+                          static_cast<unsigned long long>(profile.pc_cycles[pc]));
+            out += line;
+        }
+    }
+
+    return out;
+}
+
+static void append_opcode_table(std::string &out, const char *key, uint16_t prefix,
+                                const std::array<uint64_t, 256> &count, const std::array<uint64_t, 256> &cycles)
+{
+    char entry[96];
+    bool first = true;
+
+    out += "  \"";
+    out += key;
+    out += "\": [";
+
+    for (size_t i = 0; i < 256; i++)
+    {
+        if (count[i])
+        {
+            std::snprintf(entry, sizeof(entry), "%s\n    {\"opcode\": \"%s\", \"count\": %llu, \"cycles\": %llu}",
+                          first ? "" : ",", opcode_name(prefix | i).c_str(),
+                          static_cast<unsigned long long>(count[i]), static_cast<unsigned long long>(cycles[i]));
+            out += entry;
+            first = false;
+        }
+    }
+
+    out += "\n  ]";
+}
+
+std::string profile_json(const OpcodeProfile &profile, size_t top_pcs)
+{
+    std::string out = "{\n";
+
+    append_opcode_table(out, "opcodes", 0, profile.opcode_count, profile.opcode_cycles);
+    out += ",\n";
+    append_opcode_table(out, "cb_opcodes", PROFILE_CB_BIT, profile.cb_count, profile.cb_cycles);
+    out += ",\n  \"hot_pcs\": [";
+
+    // hottest addresses by cycles spent
+
+    std::vector<uint32_t> pcs(0x10000);
+    std::iota(pcs.begin(), pcs.end(), 0);
+    top_pcs = std::min(top_pcs, pcs.size());
+    std::partial_sort(pcs.begin(), pcs.begin() + top_pcs, pcs.end(), [&](uint32_t a, uint32_t b)
+                      { return profile.pc_cycles[a] > profile.pc_cycles[b]; });
+
+    char entry[128];
+
+    for (size_t i = 0; i < top_pcs && profile.pc_cycles[pcs[i]]; i++)
+    {
+        uint32_t pc = pcs[i];
+        std::snprintf(entry, sizeof(entry),
+                      "%s\n    {\"pc\": \"0x%04X\", \"opcode\": \"%s\", \"count\": %llu, \"cycles\": %llu}",
+                      i ? "," : "", pc, opcode_name(profile.pc_opcode[pc]).c_str(),
+                      static_cast<unsigned long long>(profile.pc_count[pc]),
+                      static_cast<unsigned long long>(profile.pc_cycles[pc]));
+        out += entry;
+    }
+
+    out += "\n  ]\n}\n";
+    return out;
+}
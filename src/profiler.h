@@ -0,0 +1,48 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+// per-opcode and per-PC execution counters
+//
+// only collected when compiled with -DGB_PROFILE, otherwise Gameboy::run_opcode()
+// contains no profiling code at all. every thread counts into its own buffer,
+// profile_merged() sums them up on demand
+
+constexpr uint16_t PROFILE_CB_BIT = 0x100; // marks CB-prefixed opcodes in pc_opcode
+
+struct alignas(64) OpcodeProfile
+{
+    std::array<uint64_t, 256> opcode_count{};  // executions per opcode
+    std::array<uint64_t, 256> opcode_cycles{}; // t-cycles per opcode
+    std::array<uint64_t, 256> cb_count{};      // executions per CB-prefixed opcode
+    std::array<uint64_t, 256> cb_cycles{};     // t-cycles per CB-prefixed opcode
+
+    alignas(64) std::array<uint64_t, 0x10000> pc_count{};  // executions per PC
+    alignas(64) std::array<uint64_t, 0x10000> pc_cycles{}; // t-cycles per PC
+    alignas(64) std::array<uint16_t, 0x10000> pc_opcode{}; // last opcode seen at PC (| PROFILE_CB_BIT)
+
+    void record(uint16_t pc, uint8_t opcode, uint8_t cb_opcode, uint8_t cycles);
+    void merge(const OpcodeProfile &other);
+    void clear();
+};
+
+extern thread_local OpcodeProfile *profile_current; // calling thread's buffer, null until first use
+
+OpcodeProfile &profile_register_thread(); // allocate and register the calling thread's buffer
+
+inline OpcodeProfile &profile_local()
+{
+    return profile_current ? *profile_current : profile_register_thread();
+}
+
+// merging reads other threads' buffers without synchronization, so only call
+// these while no instance is running (e.g. between batch frames)
+
+std::unique_ptr<OpcodeProfile> profile_merged(); // sum of all threads' counters
+void profile_reset();                            // zero all threads' counters
+
+std::string profile_collapsed(const OpcodeProfile &profile);              // flamegraph.pl input
+std::string profile_json(const OpcodeProfile &profile, size_t top_pcs = 64); // summary report
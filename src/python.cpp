@@ -0,0 +1,600 @@
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <pybind11/numpy.h>
+#include <pybind11/pybind11.h>
+
+#include "batch.h"
+#include "exectrace.h"
+#include "framepipe.h"
+#include "gameboy.h"
+#include "profiler.h"
+#include "ramspec.h"
+
+namespace py = pybind11;
+
+constexpr size_t PY_FRAME_SIZE = PPU_SCREEN_WIDTH * PPU_SCREEN_HEIGHT;
+
+constexpr const char *BACKING_MEMORY_DOC =
+    "read-only view of MMU::mem, the unbanked backing store only, no copy. 0x0000 - 0x7FFF is all zeros, "
+    "the ROM is mapped from an image shared between instances. 0x8000 - 0x9FFF is always VRAM bank 0 and "
+    "0xD000 - 0xDFFF WRAM bank 1, whatever VBK and SVBK select, and 0xA000 - 0xBFFF is stale while a .sav "
+    "file is attached. read-only because writes would skip write_io(), the tile cache and the .sav dirty "
+    "marking";
+
+// the 64KB address space with the selected banks, copied through the page tables
+static py::array_t<uint8_t> memory_copy(const Gameboy &gb)
+{
+    py::array_t<uint8_t> memory(MMU_ADDRESSABLE_MEM);
+    gb.mmu.read_block(0x0000, memory.mutable_data(), MMU_ADDRESSABLE_MEM);
+    return memory;
+}
+
+// numpy views below don't copy, they keep the owning Python object alive instead
+
+static py::array_t<uint8_t> backing_memory_view(const Gameboy &gb, py::handle owner)
+{
+    py::array_t<uint8_t> view({gb.mmu.mem.size()}, {sizeof(uint8_t)}, gb.mmu.mem.data(), owner);
+    py::detail::array_proxy(view.ptr())->flags &= ~py::detail::npy_api::NPY_ARRAY_WRITEABLE_;
+    return view;
+}
+
+static py::array_t<uint8_t> framebuffer_view(Gameboy &gb, py::handle owner)
+{
+    return py::array_t<uint8_t>({PPU_SCREEN_HEIGHT, PPU_SCREEN_WIDTH},
+                                {PPU_SCREEN_WIDTH, 1},
+                                gb.ppu.framebuffer.data(), owner);
+}
+
+static py::array_t<uint8_t> packed_frame_view(Gameboy &gb, py::handle owner)
+{
+    return py::array_t<uint8_t>({PPU_SCREEN_HEIGHT, PPU_PACKED_LINE_SIZE},
+                                {PPU_PACKED_LINE_SIZE, 1},
+                                gb.ppu.packed_frame.data(), owner);
+}
+
+// one bool per line, set where the framebuffer changed since the last call
+// with the same seen_lines
+static py::array_t<bool> take_dirty_lines(Gameboy &gb, uint64_t &seen_lines)
+{
+    py::array_t<bool> dirty(PPU_SCREEN_HEIGHT);
+    bool *lines = dirty.mutable_data();
+
+    for (int y = 0; y < PPU_SCREEN_HEIGHT; y++)
+    {
+        lines[y] = gb.ppu.line_dirty(y, seen_lines);
+    }
+
+    seen_lines = gb.ppu.line_version;
+    return dirty;
+}
+
+// instances whose ROM couldn't be loaded are reported when they're created,
+// faults while running are returned by step() instead
+static void check_rom_loaded(const Gameboy &gb)
+{
+    if (gb.fault == GB_FAULT_ROM_LOAD)
+    {
+        throw std::runtime_error("failed to load the game ROM: " + gb.load_error);
+    }
+}
+
+static py::bytes state_to_bytes(const std::vector<uint8_t> &state)
+{
+    return py::bytes(reinterpret_cast<const char *>(state.data()), state.size());
+}
+
+static std::vector<uint8_t> state_from_bytes(const py::bytes &bytes)
+{
+    std::string data = bytes;
+    return std::vector<uint8_t>(data.begin(), data.end());
+}
+
+static ArenaPages arena_pages(int pages)
+{
+    if (pages < ARENA_PAGES_NORMAL || pages > ARENA_PAGES_EXPLICIT)
+    {
+        throw std::invalid_argument("pages must be PAGES_NORMAL, PAGES_TRANSPARENT or PAGES_EXPLICIT");
+    }
+
+    return static_cast<ArenaPages>(pages);
+}
+
+// python predicates for the debugger, called with the instance's Env. step()
+// runs without the GIL, so the condition takes it for each call. env isn't
+// referenced, the Env owns the condition and outlives it
+static DebugCondition python_condition(py::handle env, py::object predicate)
+{
+    if (predicate.is_none())
+    {
+        return {};
+    }
+
+    return [env, predicate](const Gameboy &) {
+        py::gil_scoped_acquire acquire;
+        return predicate(env).cast<bool>();
+    };
+}
+
+static py::dict debug_stop_dict(const DebugStop &stop)
+{
+    static const char *reasons[] = {"none", "breakpoint", "watchpoint", "condition"};
+
+    py::dict result;
+    result["reason"] = reasons[stop.reason];
+    result["pc"] = stop.pc;
+    result["address"] = stop.address;
+    result["old_value"] = stop.old_value;
+    result["value"] = stop.value;
+    return result;
+}
+
+// RAM specs come in the text format of ramspec.h
+static void compile_ram_spec(const std::string &spec, RamPlan &plan)
+{
+    std::vector<RamField> fields;
+    std::string error;
+
+    if (!ramspec_parse(spec, fields, error))
+    {
+        throw std::invalid_argument(error);
+    }
+
+    plan.compile(fields);
+}
+
+static py::list ram_field_names(const RamPlan &plan)
+{
+    py::list names;
+
+    for (const RamField &field : plan.fields)
+    {
+        names.append(field.name);
+    }
+
+    return names;
+}
+
+static py::dict exectrace_dict(const ExecTraceState &state)
+{
+    py::dict result;
+    result["cycle"] = state.cycle;
+    result["instruction"] = state.instruction;
+    result["pc"] = state.PC;
+    result["opcode"] = state.opcode;
+    result["cb_opcode"] = state.cb_opcode;
+    result["af"] = state.AF;
+    result["bc"] = state.BC;
+    result["de"] = state.DE;
+    result["hl"] = state.HL;
+    result["sp"] = state.SP;
+    result["ime"] = bool(state.misc & EXECTRACE_MISC_IME);
+    result["double_speed"] = bool(state.misc & EXECTRACE_MISC_DOUBLE_SPEED);
+    return result;
+}
+
+// single instance with a gym-style interface
+
+struct Env
+{
+    std::unique_ptr<Gameboy> gb;
+    std::vector<uint8_t> initial_state; // restored by reset()
+    RamPlan ram_plan;                   // fields read by ram()
+    uint64_t seen_lines = 0;            // PPU::line_version at the previous dirty_lines()
+#ifdef GB_TRACE_EXEC
+    std::unique_ptr<ExecTraceWriter> exec_trace; // set between start_exec_trace() and stop_exec_trace()
+#endif
+
+    Env(const std::string &game_rom_filename)
+        : gb(std::make_unique<Gameboy>(game_rom_filename)), initial_state(gb->save_state())
+    {
+        check_rom_loaded(*gb);
+    }
+
+    GameboyFault step(uint8_t buttons)
+    {
+        gb->mmu.set_buttons(buttons);
+
+        py::gil_scoped_release release;
+        return gb->run_frame();
+    }
+
+    void reset()
+    {
+        gb->load_state(initial_state);
+    }
+
+    void load_state(const py::bytes &bytes)
+    {
+        if (!gb->load_state(state_from_bytes(bytes)))
+        {
+            throw std::invalid_argument("invalid or incompatible save state");
+        }
+    }
+
+    py::array_t<float> ram() const
+    {
+        py::array_t<float> values(ram_plan.num_fields());
+        ram_plan.evaluate(gb->mmu, values.mutable_data(), 1);
+        return values;
+    }
+};
+
+// N instances of the same ROM, stepped in C++ worker threads without the GIL
+
+struct VecEnv
+{
+    GameboyBatch batch;
+    std::vector<uint8_t> initial_state; // shared by all lanes, they run the same ROM
+    std::vector<uint8_t> frames;        // contiguous copy of all framebuffers, (N, 144, 160)
+    std::vector<uint64_t> seen_lines;   // per lane PPU::line_version when frames was last updated
+    RamPlan ram_plan;                   // evaluated by the workers after every frame
+    py::object ram_values = py::none(); // (fields, N) float32 array the plan writes into
+    std::unique_ptr<FramePipeline> recorder; // set while recording, batch.capture points to it
+
+    VecEnv(const std::string &game_rom_filename, size_t num_envs, size_t num_threads, bool pin_threads,
+           int pages)
+        : batch(game_rom_filename, num_envs, num_threads, pin_threads, arena_pages(pages)),
+          initial_state(batch.lanes.at(0)->save_state()),
+          frames(num_envs * PY_FRAME_SIZE, 0), seen_lines(num_envs, 0)
+    {
+        check_rom_loaded(*batch.lanes[0]);
+    }
+
+    void step(py::array_t<uint8_t, py::array::c_style | py::array::forcecast> actions)
+    {
+        if (actions.ndim() != 1 || static_cast<size_t>(actions.shape(0)) != batch.lanes.size())
+        {
+            throw std::invalid_argument("expected one action per environment");
+        }
+
+        const uint8_t *buttons = actions.data();
+
+        for (size_t i = 0; i < batch.lanes.size(); i++)
+        {
+            batch.lanes[i]->mmu.set_buttons(buttons[i]);
+        }
+
+        py::gil_scoped_release release;
+        batch.run_frame();
+
+        // frames keeps the previous contents, only changed lines are copied
+        for (size_t i = 0; i < batch.lanes.size(); i++)
+        {
+            PPU &ppu = batch.lanes[i]->ppu;
+
+            for (int y = 0; y < PPU_SCREEN_HEIGHT; y++)
+            {
+                if (ppu.line_dirty(y, seen_lines[i]))
+                {
+                    std::memcpy(&frames[i * PY_FRAME_SIZE + y * PPU_SCREEN_WIDTH],
+                                &ppu.framebuffer[y * PPU_SCREEN_WIDTH], PPU_SCREEN_WIDTH);
+                }
+            }
+
+            seen_lines[i] = ppu.line_version;
+        }
+    }
+
+    Gameboy &lane(size_t index)
+    {
+        if (index >= batch.lanes.size())
+        {
+            throw std::out_of_range("environment index out of range");
+        }
+
+        return *batch.lanes[index];
+    }
+
+    void reset()
+    {
+        for (size_t i = 0; i < batch.lanes.size(); i++)
+        {
+            reset_env(i);
+        }
+    }
+
+    void reset_env(size_t index)
+    {
+        lane(index).load_state(initial_state);
+        batch.release(index);
+    }
+
+    void load_state(size_t index, const py::bytes &bytes)
+    {
+        if (!lane(index).load_state(state_from_bytes(bytes)))
+        {
+            throw std::invalid_argument("invalid or incompatible save state");
+        }
+
+        batch.release(index);
+    }
+
+    void start_recording(const std::string &directory, size_t num_encoders, size_t pool_size, bool drop)
+    {
+        stop_recording();
+        recorder = std::make_unique<FramePipeline>(pool_size, num_encoders, drop ? FRAME_PIPE_DROP : FRAME_PIPE_BLOCK,
+                                                   frame_pgm_writer(directory));
+        batch.capture = recorder.get();
+    }
+
+    py::dict stop_recording()
+    {
+        py::dict stats;
+
+        if (!recorder)
+        {
+            return stats;
+        }
+
+        batch.capture = nullptr;
+
+        {
+            py::gil_scoped_release release;
+            recorder->close(); // waits for the frames still queued
+        }
+
+        stats["submitted"] = recorder->submitted.load();
+        stats["dropped"] = recorder->dropped.load();
+        stats["encoded"] = recorder->encoded.load();
+        recorder.reset();
+        return stats;
+    }
+
+    py::object set_ram_spec(const std::string &spec, py::object out)
+    {
+        RamPlan plan;
+        compile_ram_spec(spec, plan);
+
+        size_t num_fields = plan.num_fields();
+        size_t num_envs = batch.lanes.size();
+
+        if (out.is_none())
+        {
+            out = py::array_t<float>({num_fields, num_envs});
+        }
+
+        // written in place, so it has to be exactly the layout the workers expect
+        if (!py::isinstance<py::array_t<float, py::array::c_style>>(out))
+        {
+            throw std::invalid_argument("out must be a C-contiguous float32 array");
+        }
+
+        py::array_t<float, py::array::c_style> values = out.cast<py::array_t<float, py::array::c_style>>();
+
+        if (values.ndim() != 2 || size_t(values.shape(0)) != num_fields || size_t(values.shape(1)) != num_envs ||
+            !values.writeable())
+        {
+            throw std::invalid_argument("out must be a writable (fields, num_envs) array");
+        }
+
+        ram_plan = std::move(plan);
+        ram_values = out;
+        batch.set_ram_plan(num_fields ? &ram_plan : nullptr, values.mutable_data());
+        return out;
+    }
+
+    py::array_t<uint8_t> faults() // GameboyFault of every lane
+    {
+        py::array_t<uint8_t> result(batch.lanes.size());
+        uint8_t *out = result.mutable_data();
+
+        for (size_t i = 0; i < batch.lanes.size(); i++)
+        {
+            out[i] = batch.lanes[i]->fault;
+        }
+
+        return result;
+    }
+};
+
+PYBIND11_MODULE(gameboy_emu, m)
+{
+    m.attr("RIGHT") = JOYPAD_RIGHT;
+    m.attr("LEFT") = JOYPAD_LEFT;
+    m.attr("UP") = JOYPAD_UP;
+    m.attr("DOWN") = JOYPAD_DOWN;
+    m.attr("A") = JOYPAD_A;
+    m.attr("B") = JOYPAD_B;
+    m.attr("SELECT") = JOYPAD_SELECT;
+    m.attr("START") = JOYPAD_START;
+
+    // step() results and VecEnv.faults() values, see GameboyFault
+    m.attr("FAULT_NONE") = int(GB_FAULT_NONE);
+    m.attr("FAULT_UNIMPLEMENTED_OPCODE") = int(GB_FAULT_UNIMPLEMENTED_OPCODE);
+    m.attr("FAULT_ILLEGAL_OPCODE") = int(GB_FAULT_ILLEGAL_OPCODE);
+    m.attr("FAULT_LOCKUP") = int(GB_FAULT_LOCKUP);
+    m.attr("FAULT_ROM_LOAD") = int(GB_FAULT_ROM_LOAD);
+    m.attr("FAULT_STOPPED") = int(GB_FAULT_STOPPED);
+    m.attr("FAULT_BREAK") = int(GB_FAULT_BREAK);
+    // VecEnv memory backing
+    m.attr("PAGES_NORMAL") = int(ARENA_PAGES_NORMAL);
+    m.attr("PAGES_TRANSPARENT") = int(ARENA_PAGES_TRANSPARENT);
+    m.attr("PAGES_EXPLICIT") = int(ARENA_PAGES_EXPLICIT);
+
+    m.def("fault_name", [](int fault) { return gb_fault_name(static_cast<GameboyFault>(fault)); });
+
+    // counters are only collected when the module is built with DEFINES=-DGB_PROFILE
+    m.def("profile_json", [](size_t top_pcs) { return profile_json(*profile_merged(), top_pcs); },
+          py::arg("top_pcs") = 64);
+    m.def("profile_collapsed", [] { return profile_collapsed(*profile_merged()); });
+    m.def("profile_reset", &profile_reset);
+
+    py::class_<Env>(m, "Env")
+        .def(py::init<const std::string &>(), py::arg("rom"))
+        .def("step", [](Env &env, uint8_t buttons) { return int(env.step(buttons)); }, py::arg("buttons"),
+             "run one frame with the given JOYPAD bits pressed, returns a FAULT_* code")
+        .def_property_readonly("fault", [](Env &env) { return int(env.gb->fault); })
+        .def_property_readonly("fault_pc", [](Env &env) { return env.gb->fault_pc; })
+        .def("reset", &Env::reset)
+        .def("save_state", [](Env &env) { return state_to_bytes(env.gb->save_state()); })
+        .def("load_state", &Env::load_state, py::arg("state"))
+        .def_property("idle_skip", [](Env &env) { return env.gb->idle_skip; },
+                      [](Env &env, bool enabled) { env.gb->idle_skip = enabled; })
+        .def_property("accurate", [](Env &env) { return env.gb->accurate; },
+                      [](Env &env, bool enabled) { env.gb->accurate = enabled; })
+        .def_property_readonly("idle_skipped_cycles", [](Env &env) { return env.gb->idle_skipped_cycles; })
+        .def("set_ram_spec", [](Env &env, const std::string &spec) { compile_ram_spec(spec, env.ram_plan); },
+             py::arg("spec"), "fields read by ram(), one \"name address [width] [options]\" line each")
+        .def_property_readonly("ram_fields", [](Env &env) { return ram_field_names(env.ram_plan); })
+        .def("ram", &Env::ram, "current value of every RAM spec field")
+#ifdef GB_TRACE_MEM
+        .def("memtrace_json", [](Env &env) { return memtrace_json(env.gb->mmu.trace); })
+        .def("memtrace_chrome", [](Env &env) { return memtrace_chrome(env.gb->mmu.trace); })
+#endif
+#ifdef GB_TRACE_EXEC
+        .def("start_exec_trace",
+             [](Env &env, const std::string &filename, uint32_t keyframe_interval)
+             {
+                 auto writer = std::make_unique<ExecTraceWriter>();
+
+                 if (!writer->open(filename, keyframe_interval))
+                 {
+                     throw std::runtime_error("can't create execution trace " + filename);
+                 }
+
+                 env.exec_trace = std::move(writer); // closes the previous trace
+                 env.gb->exec_trace = env.exec_trace.get();
+             },
+             py::arg("filename"), py::arg("keyframe_interval") = EXECTRACE_DEFAULT_KEYFRAME_INTERVAL,
+             "record every instruction to filename until stop_exec_trace(), read it with ExecTrace")
+        .def("stop_exec_trace",
+             [](Env &env)
+             {
+                 env.gb->exec_trace = nullptr;
+                 bool ok = !env.exec_trace || env.exec_trace->close();
+                 env.exec_trace.reset();
+                 return ok;
+             })
+#endif
+        .def_property_readonly("memory", [](Env &env) { return memory_copy(*env.gb); },
+                               "copy of the 64KB address space as the CPU sees it, with the selected banks")
+        .def_property_readonly("backing_memory", [](py::object self)
+                               { return backing_memory_view(*self.cast<Env &>().gb, self); },
+                               BACKING_MEMORY_DOC)
+        .def_property_readonly("framebuffer", [](py::object self)
+                               { return framebuffer_view(*self.cast<Env &>().gb, self); })
+        .def_property_readonly("packed_frame", [](py::object self)
+                               { return packed_frame_view(*self.cast<Env &>().gb, self); })
+        .def("dirty_lines", [](Env &env) { return take_dirty_lines(*env.gb, env.seen_lines); },
+             "lines that changed since the previous call, as a bool array")
+        // debugger, a stop makes step() return FAULT_BREAK and the next step() finishes the frame
+        .def("add_breakpoint", [](py::object self, uint16_t address, py::object condition)
+             { self.cast<Env &>().gb->debugger.add_breakpoint(address, python_condition(self, condition)); },
+             py::arg("address"), py::arg("condition") = py::none(),
+             "stop before executing address, if condition(env) holds")
+        .def("remove_breakpoint", [](Env &env, uint16_t address) { env.gb->debugger.remove_breakpoint(address); },
+             py::arg("address"))
+        .def("add_watchpoint", [](py::object self, uint16_t address, py::object condition)
+             { self.cast<Env &>().gb->mmu.add_watchpoint(address, python_condition(self, condition)); },
+             py::arg("address"), py::arg("condition") = py::none(),
+             "stop after an instruction writes to address, if condition(env) holds")
+        .def("remove_watchpoint", [](Env &env, uint16_t address) { env.gb->mmu.remove_watchpoint(address); },
+             py::arg("address"))
+        .def("add_condition", [](py::object self, py::object condition)
+             { self.cast<Env &>().gb->debugger.add_condition(python_condition(self, condition)); },
+             py::arg("condition"), "stop as soon as condition(env) holds, checked between instructions")
+        .def("clear_debugger", [](Env &env)
+             {
+                 env.gb->debugger.clear();
+                 env.gb->mmu.clear_watchpoints();
+             })
+        .def_property_readonly("debug_stop", [](Env &env) { return debug_stop_dict(env.gb->debugger.stop); },
+                               "reason, pc and for watchpoints address, old_value and value of the last stop");
+
+    // reads traces of any build, recording needs DEFINES=-DGB_TRACE_EXEC
+    py::class_<ExecTraceReader>(m, "ExecTrace")
+        .def(py::init(
+                 [](const std::string &filename)
+                 {
+                     auto reader = std::make_unique<ExecTraceReader>();
+
+                     if (!reader->open(filename))
+                     {
+                         throw std::invalid_argument("not a readable execution trace: " + filename);
+                     }
+
+                     return reader;
+                 }),
+             py::arg("filename"))
+        .def("__len__", [](ExecTraceReader &trace) { return trace.instructions; })
+        .def_property_readonly("complete", [](ExecTraceReader &trace) { return trace.complete; },
+                               "False if the recording never closed the trace, e.g. after a crash")
+        .def("at_cycle",
+             [](ExecTraceReader &trace, uint64_t cycle) -> py::object
+             {
+                 ExecTraceState state;
+                 return trace.seek_cycle(cycle, state) ? py::object(exectrace_dict(state)) : py::none();
+             },
+             py::arg("cycle"), "CPU state of the instruction running at cycle, None before the trace starts")
+        .def("at_instruction",
+             [](ExecTraceReader &trace, uint64_t instruction) -> py::object
+             {
+                 ExecTraceState state;
+                 return trace.seek_instruction(instruction, state) ? py::object(exectrace_dict(state)) : py::none();
+             },
+             py::arg("instruction"))
+        .def("read",
+             [](ExecTraceReader &trace, uint64_t first, size_t count)
+             {
+                 std::vector<ExecTraceState> states;
+                 trace.read(first, count, states);
+
+                 py::list result;
+
+                 for (const ExecTraceState &state : states)
+                 {
+                     result.append(exectrace_dict(state));
+                 }
+
+                 return result;
+             },
+             py::arg("first"), py::arg("count"), "states of count instructions from first on");
+
+    py::class_<VecEnv>(m, "VecEnv")
+        .def(py::init<const std::string &, size_t, size_t, bool, int>(),
+             py::arg("rom"), py::arg("num_envs"), py::arg("num_threads") = 1, py::arg("pin_threads") = false,
+             py::arg("pages") = int(ARENA_PAGES_TRANSPARENT),
+             "pin_threads pins the workers to CPUs spread over the NUMA nodes, each allocating its own envs. "
+             "pages is one of the PAGES_* constants")
+        .def_property_readonly("page_backing", [](VecEnv &env) { return arena_pages_name(env.batch.page_backing()); },
+                               "pages the envs actually got, after falling back")
+        .def("__len__", [](VecEnv &env) { return env.batch.lanes.size(); })
+        .def("step", &VecEnv::step, py::arg("actions"), "run one frame on every instance")
+        .def("reset", &VecEnv::reset)
+        .def("link_pairs", [](VecEnv &env) { env.batch.link_pairs(); },
+             "connect envs 0-1, 2-3, ... with link cables")
+        .def("reset_env", &VecEnv::reset_env, py::arg("index"))
+        .def("faults", &VecEnv::faults, "fault code of every env, FAULT_NONE if it's running")
+        .def("set_ram_spec", &VecEnv::set_ram_spec, py::arg("spec"), py::arg("out") = py::none(),
+             "gather the spec's fields into out, a (fields, num_envs) float32 array, after every step. "
+             "allocates out if it's None, returns it")
+        .def_property_readonly("ram_fields", [](VecEnv &env) { return ram_field_names(env.ram_plan); })
+        .def_property_readonly("ram", [](VecEnv &env) { return env.ram_values; },
+                               "the array set_ram_spec() writes into, None before it's called")
+        .def_property_readonly("num_quarantined", [](VecEnv &env) { return env.batch.num_quarantined(); })
+        .def("start_recording", &VecEnv::start_recording, py::arg("directory"), py::arg("num_encoders") = 2,
+             py::arg("pool_size") = 64, py::arg("drop") = false,
+             "write every env's frames to directory/<env>_<frame>.pgm on encoder threads. with drop, "
+             "frames are skipped instead of slowing down step() when the encoders fall behind")
+        .def("stop_recording", &VecEnv::stop_recording,
+             "finish writing the queued frames, returns submitted, dropped and encoded counts")
+        .def("save_state", [](VecEnv &env, size_t index) { return state_to_bytes(env.lane(index).save_state()); },
+             py::arg("index"))
+        .def("load_state", &VecEnv::load_state, py::arg("index"), py::arg("state"))
+        .def("memory", [](VecEnv &env, size_t index) { return memory_copy(env.lane(index)); }, py::arg("index"),
+             "copy of an env's 64KB address space as the CPU sees it, with the selected banks")
+        .def("backing_memory", [](py::object self, size_t index)
+             { return backing_memory_view(self.cast<VecEnv &>().lane(index), self); },
+             py::arg("index"), BACKING_MEMORY_DOC)
+        .def_property_readonly("frames", [](py::object self)
+                               {
+                                   VecEnv &env = self.cast<VecEnv &>();
+                                   return py::array_t<uint8_t>(
+                                       {env.batch.lanes.size(), size_t(PPU_SCREEN_HEIGHT), size_t(PPU_SCREEN_WIDTH)},
+                                       {PY_FRAME_SIZE, size_t(PPU_SCREEN_WIDTH), size_t(1)},
+                                       env.frames.data(), self); });
+}
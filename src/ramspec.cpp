@@ -0,0 +1,260 @@
+#include "ramspec.h"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstring>
+#include <sstream>
+
+#include "mmu.h"
+
+// parses an unsigned number in decimal or 0x hex, false on trailing garbage
+static bool parse_number(const std::string &token, unsigned long &value)
+{
+    try
+    {
+        size_t end = 0;
+        value = std::stoul(token, &end, 0);
+        return end == token.size();
+    }
+    catch (const std::exception &)
+    {
+        return false;
+    }
+}
+
+static bool parse_float(const std::string &token, float &value)
+{
+    try
+    {
+        size_t end = 0;
+        value = std::stof(token, &end);
+        return end == token.size();
+    }
+    catch (const std::exception &)
+    {
+        return false;
+    }
+}
+
+// applies one option token of a field, false if it isn't valid
+static bool parse_option(const std::string &token, RamField &field)
+{
+    if (token == "be" || token == "le")
+    {
+        field.big_endian = token == "be";
+        return true;
+    }
+
+    if (token == "bcd" || token == "signed")
+    {
+        field.encoding = token == "bcd" ? RAM_FIELD_BCD : RAM_FIELD_SIGNED;
+        return true;
+    }
+
+    size_t equals = token.find('=');
+
+    if (equals == std::string::npos)
+    {
+        return false;
+    }
+
+    std::string key = token.substr(0, equals);
+    std::string value = token.substr(equals + 1);
+    unsigned long number;
+
+    if (key == "mask" && parse_number(value, number) && number <= 0xFFFFFFFF)
+    {
+        field.mask = number;
+        return true;
+    }
+
+    if (key == "shift" && parse_number(value, number) && number < 32)
+    {
+        field.shift = number;
+        return true;
+    }
+
+    if (key == "scale")
+    {
+        return parse_float(value, field.scale);
+    }
+
+    if (key == "offset")
+    {
+        return parse_float(value, field.offset);
+    }
+
+    return false;
+}
+
+bool ramspec_parse(const std::string &text, std::vector<RamField> &fields, std::string &error)
+{
+    std::istringstream lines(text);
+    std::string line;
+
+    fields.clear();
+
+    for (int line_number = 1; std::getline(lines, line); line_number++)
+    {
+        std::istringstream tokens(line.substr(0, line.find('#')));
+        std::string token;
+        RamField field;
+        unsigned long number;
+
+        if (!(tokens >> field.name))
+        {
+            continue; // blank line or comment
+        }
+
+        std::string where = "line " + std::to_string(line_number) + ": ";
+
+        if (!(tokens >> token) || !parse_number(token, number) || number > 0xFFFF)
+        {
+            error = where + "expected an address from 0x0000 to 0xFFFF after " + field.name;
+            return false;
+        }
+
+        field.address = number;
+
+        while (tokens >> token)
+        {
+            if (parse_number(token, number))
+            {
+                if (number < 1 || number > RAM_SPEC_MAX_WIDTH)
+                {
+                    error = where + "width must be 1 to " + std::to_string(RAM_SPEC_MAX_WIDTH) + " bytes";
+                    return false;
+                }
+
+                field.width = number;
+            }
+            else if (!parse_option(token, field))
+            {
+                error = where + "unknown option " + token;
+                return false;
+            }
+        }
+
+        if (fields.size() == RAM_SPEC_MAX_FIELDS)
+        {
+            error = where + "more than " + std::to_string(RAM_SPEC_MAX_FIELDS) + " fields";
+            return false;
+        }
+
+        fields.push_back(field);
+    }
+
+    return true;
+}
+
+void RamPlan::compile(const std::vector<RamField> &spec)
+{
+    fields.assign(spec.begin(), spec.begin() + std::min(spec.size(), RAM_SPEC_MAX_FIELDS));
+    gathers.clear();
+    decodes.clear();
+
+    // every distinct byte is read once, in address order
+    std::vector<uint16_t> addresses;
+
+    for (const RamField &field : fields)
+    {
+        for (int i = 0; i < field.width; i++)
+        {
+            addresses.push_back(field.address + i);
+        }
+    }
+
+    std::sort(addresses.begin(), addresses.end());
+    addresses.erase(std::unique(addresses.begin(), addresses.end()), addresses.end());
+    scratch_size = addresses.size();
+
+    // neighbouring bytes on the same page are copied as one run
+    for (size_t i = 0; i < addresses.size(); i++)
+    {
+        if (!gathers.empty())
+        {
+            RamGather &last = gathers.back();
+            uint16_t next = last.address + last.length;
+
+            if (addresses[i] == next && (next & (MMU_PAGE_SIZE - 1)))
+            {
+                last.length++;
+                continue;
+            }
+        }
+
+        gathers.push_back({addresses[i], 1, static_cast<uint16_t>(i)});
+    }
+
+    for (const RamField &field : fields)
+    {
+        RamDecode decode{};
+        decode.width = field.width;
+        decode.encoding = field.encoding;
+        decode.mask = field.mask & (0xFFFFFFFF >> (32 - 8 * field.width));
+        decode.shift = field.shift;
+        decode.scale = field.scale;
+        decode.offset = field.offset;
+
+        int bits = std::bit_width(decode.mask >> decode.shift);
+        decode.sign_bit = bits > 0 ? bits - 1 : 0;
+
+        for (int i = 0; i < field.width; i++)
+        {
+            // most significant byte first
+            uint16_t address = field.address + (field.big_endian ? i : field.width - 1 - i);
+            decode.scratch[i] = std::lower_bound(addresses.begin(), addresses.end(), address) - addresses.begin();
+        }
+
+        decodes.push_back(decode);
+    }
+}
+
+void RamPlan::evaluate(const MMU &mmu, float *out, size_t stride) const
+{
+    std::array<uint8_t, RAM_SPEC_MAX_FIELDS * RAM_SPEC_MAX_WIDTH> bytes;
+
+    // through the page tables, so banked WRAM and cartridge RAM read the selected bank
+    for (const RamGather &gather : gathers)
+    {
+        const uint8_t *page = mmu.read_pages[gather.address >> 12];
+        std::memcpy(&bytes[gather.scratch], page + (gather.address & (MMU_PAGE_SIZE - 1)), gather.length);
+    }
+
+    for (size_t i = 0; i < decodes.size(); i++)
+    {
+        const RamDecode &decode = decodes[i];
+        uint32_t raw = 0;
+
+        for (int b = 0; b < decode.width; b++)
+        {
+            raw = (raw << 8) | bytes[decode.scratch[b]];
+        }
+
+        raw = (raw & decode.mask) >> decode.shift;
+        double value;
+
+        switch (decode.encoding)
+        {
+        case RAM_FIELD_SIGNED:
+            value = (raw >> decode.sign_bit) & 1 ? double(raw) - double(uint64_t(1) << (decode.sign_bit + 1))
+                                                 : double(raw);
+            break;
+        case RAM_FIELD_BCD:
+            value = 0;
+
+            for (double place = 1; raw; raw >>= 4, place *= 10)
+            {
+                value += std::min(raw & 0x0F, 9u) * place;
+            }
+
+            break;
+        default:
+            value = raw;
+            break;
+        }
+
+        out[i * stride] = static_cast<float>(value * double(decode.scale) + double(decode.offset));
+    }
+}
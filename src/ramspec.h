@@ -0,0 +1,85 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct MMU;
+
+// values read from game RAM after every frame, for rewards and observations
+//
+// a spec lists fields, one per line:
+//
+//     # name  address  [width]  [options]
+//     score   0xC0A0   3        bcd be
+//     lives   0xDA22   1        mask=0x0F
+//     hp      0xD16C   2        be scale=0.01
+//
+// width is 1-4 bytes, little endian unless "be" is given. the raw value is
+// masked and shifted right, then decoded as "bcd" or "signed" (two's
+// complement over the bits left by the mask), then value * scale + offset.
+// compile() turns the fields into a plan that gathers each distinct byte
+// once and decodes from that copy, so evaluating costs only the bytes used
+
+constexpr size_t RAM_SPEC_MAX_FIELDS = 64;
+constexpr int RAM_SPEC_MAX_WIDTH = 4;
+
+enum RamFieldEncoding : uint8_t
+{
+    RAM_FIELD_UNSIGNED,
+    RAM_FIELD_SIGNED,
+    RAM_FIELD_BCD, // one decimal digit per nibble, a nibble above 9 counts as 9
+};
+
+struct RamField
+{
+    std::string name;
+    uint16_t address = 0;
+    uint8_t width = 1;                           // bytes
+    bool big_endian = false;                     // first byte is the most significant
+    RamFieldEncoding encoding = RAM_FIELD_UNSIGNED;
+    uint32_t mask = 0xFFFFFFFF;                  // applied to the raw value, before shift
+    uint8_t shift = 0;
+    float scale = 1.0f;
+    float offset = 0.0f;
+};
+
+// false with a message naming the line if the spec doesn't parse
+bool ramspec_parse(const std::string &text, std::vector<RamField> &fields, std::string &error);
+
+// a contiguous range of RAM copied in one go, never crosses a page
+struct RamGather
+{
+    uint16_t address;
+    uint16_t length;
+    uint16_t scratch; // where the bytes go in the gathered copy
+};
+
+// how to build a field from the gathered copy
+struct RamDecode
+{
+    uint16_t scratch[RAM_SPEC_MAX_WIDTH]; // position of each byte, most significant first
+    uint8_t width;
+    RamFieldEncoding encoding;
+    uint32_t mask;
+    uint8_t shift;
+    uint8_t sign_bit; // bit index of the sign after mask and shift, signed only
+    float scale;
+    float offset;
+};
+
+struct RamPlan
+{
+    std::vector<RamField> fields;
+    std::vector<RamGather> gathers;
+    std::vector<RamDecode> decodes; // one per field, same order
+    size_t scratch_size = 0;        // distinct bytes read
+
+    void compile(const std::vector<RamField> &spec);
+    size_t num_fields() const { return fields.size(); }
+
+    // writes field i to out[i * stride], so a batch fills a (fields, lanes)
+    // struct of arrays by passing lanes as stride and out + lane
+    void evaluate(const MMU &mmu, float *out, size_t stride) const;
+};
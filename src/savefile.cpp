@@ -0,0 +1,158 @@
+#include "savefile.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// flusher thread state, shared by all save files in the process
+static std::mutex flusher_mutex;
+static std::condition_variable flusher_cv;
+static std::vector<SaveFile *> flusher_files;
+static std::thread flusher_thread;
+static std::chrono::milliseconds flusher_interval = SAVEFILE_DEFAULT_INTERVAL;
+static bool flusher_stopping = false;
+
+// a still joinable std::thread would terminate the process on exit
+static struct FlusherGuard
+{
+    ~FlusherGuard() { savefile_flusher_stop(); }
+} flusher_guard;
+
+static void flusher_loop()
+{
+    std::unique_lock<std::mutex> lock(flusher_mutex);
+
+    while (!flusher_stopping)
+    {
+        flusher_cv.wait_for(lock, flusher_interval, [] { return flusher_stopping; });
+
+        for (SaveFile *file : flusher_files)
+        {
+            file->flush();
+        }
+    }
+}
+
+void savefile_flusher_start(std::chrono::milliseconds interval)
+{
+    std::lock_guard<std::mutex> lock(flusher_mutex);
+    flusher_interval = interval;
+
+    if (!flusher_thread.joinable())
+    {
+        flusher_stopping = false;
+        flusher_thread = std::thread(flusher_loop);
+    }
+}
+
+void savefile_flusher_stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(flusher_mutex);
+        flusher_stopping = true;
+    }
+
+    flusher_cv.notify_all();
+
+    if (flusher_thread.joinable())
+    {
+        flusher_thread.join();
+    }
+}
+
+SaveFile::SaveFile() : data(nullptr), dirty_pages(0) {}
+
+#ifndef _WIN32
+
+SaveFile::~SaveFile()
+{
+    if (!data)
+    {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(flusher_mutex);
+        flusher_files.erase(std::remove(flusher_files.begin(), flusher_files.end(), this), flusher_files.end());
+    }
+
+    flush();
+    munmap(data, SAVEFILE_SIZE);
+}
+
+bool SaveFile::open(const std::string &filename)
+{
+    int fd = ::open(filename.c_str(), O_RDWR | O_CREAT, 0644);
+
+    if (fd < 0)
+    {
+        std::cerr << "Failed to open save file " << filename << ": " << std::strerror(errno) << std::endl;
+        return false;
+    }
+
+    // new files are zero-filled, existing ones keep their contents
+    struct stat info;
+
+    if (fstat(fd, &info) != 0 || (info.st_size < static_cast<off_t>(SAVEFILE_SIZE) && ftruncate(fd, SAVEFILE_SIZE) != 0))
+    {
+        std::cerr << "Failed to size save file " << filename << ": " << std::strerror(errno) << std::endl;
+        close(fd);
+        return false;
+    }
+
+    void *mapping = mmap(nullptr, SAVEFILE_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (mapping == MAP_FAILED)
+    {
+        std::cerr << "Failed to map save file " << filename << ": " << std::strerror(errno) << std::endl;
+        return false;
+    }
+
+    data = static_cast<uint8_t *>(mapping);
+
+    std::lock_guard<std::mutex> lock(flusher_mutex);
+    flusher_files.push_back(this);
+
+    return true;
+}
+
+void SaveFile::flush()
+{
+    uint32_t dirty = dirty_pages.exchange(0, std::memory_order_relaxed);
+
+    for (size_t page = 0; dirty; page++, dirty >>= 1)
+    {
+        if (dirty & 1)
+        {
+            msync(data + page * SAVEFILE_PAGE_SIZE, SAVEFILE_PAGE_SIZE, MS_SYNC);
+        }
+    }
+}
+
+#else
+
+// save files need mmap() and msync(), other platforms run without battery RAM persistence
+
+SaveFile::~SaveFile() {}
+
+bool SaveFile::open(const std::string &filename)
+{
+    std::cerr << "Save files aren't supported on this platform: " << filename << std::endl;
+    return false;
+}
+
+void SaveFile::flush() {}
+
+#endif
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// battery-backed cartridge RAM, memory mapped from a .sav file
+//
+// the emulation thread writes straight into the mapping and only sets a
+// dirty bit per page, a shared background thread msync()s dirty pages
+
+constexpr size_t SAVEFILE_SIZE = 0x2000;     // 0xA000 - 0xBFFF, banking isn't emulated yet
+constexpr size_t SAVEFILE_PAGE_SIZE = 0x1000; // dirty tracking granularity, matches MMU_PAGE_SIZE
+
+constexpr std::chrono::milliseconds SAVEFILE_DEFAULT_INTERVAL(1000);
+
+struct SaveFile
+{
+    uint8_t *data;                      // mapped file contents
+    std::atomic<uint32_t> dirty_pages; // bit n set: page n changed since the last flush
+
+    SaveFile();
+    ~SaveFile(); // flushes and unmaps
+
+    SaveFile(const SaveFile &) = delete;
+    SaveFile &operator=(const SaveFile &) = delete;
+
+    bool open(const std::string &filename); // create or map the file, registers with the flusher
+    void flush();                           // msync() dirty pages, called by the flusher thread
+
+    void mark_dirty(uint16_t offset)
+    {
+        uint32_t bit = 1u << (offset / SAVEFILE_PAGE_SIZE);
+
+        // plain load first, so repeated writes to a dirty page skip the locked RMW
+        if (!(dirty_pages.load(std::memory_order_relaxed) & bit))
+        {
+            dirty_pages.fetch_or(bit, std::memory_order_relaxed);
+        }
+    }
+};
+
+// starts the process-wide flusher thread if it isn't running, later calls
+// only change the interval. save files flush on destruction either way
+void savefile_flusher_start(std::chrono::milliseconds interval = SAVEFILE_DEFAULT_INTERVAL);
+void savefile_flusher_stop();
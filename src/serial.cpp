@@ -0,0 +1,82 @@
+#include "serial.h"
+
+#include <cstdio>
+
+Serial::Serial() : link(nullptr), side(0), start_pending(false), transfer_end(SERIAL_IDLE), incoming(0xFF), echo(false)
+{
+}
+
+void Serial::record(uint8_t value)
+{
+    if (output.size() >= SERIAL_OUTPUT_MAX)
+    {
+        output.erase(0, SERIAL_OUTPUT_MAX / 2);
+    }
+
+    output.push_back(static_cast<char>(value));
+
+    if (echo)
+    {
+        std::putchar(value);
+        std::fflush(stdout);
+    }
+}
+
+SerialTestResult Serial::test_result() const
+{
+    if (output.find("Passed") != std::string::npos)
+    {
+        return SERIAL_TEST_PASSED;
+    }
+
+    if (output.find("Failed") != std::string::npos)
+    {
+        return SERIAL_TEST_FAILED;
+    }
+
+    return SERIAL_TEST_RUNNING;
+}
+
+LinkCable::LinkCable() : data{0xFF, 0xFF}, pending{false, false}, inbox{0xFF, 0xFF} {}
+
+void LinkCable::connect(Serial &a, Serial &b)
+{
+    a.link = this;
+    a.side = 0;
+    b.link = this;
+    b.side = 1;
+}
+
+void LinkCable::publish(int side, uint8_t value)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    data[side] = value;
+}
+
+uint8_t LinkCable::exchange(int side, uint8_t value)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    int other = side ^ 1;
+
+    uint8_t received = data[other];
+    data[other] = value; // the other side's SB now holds what was shifted in
+    inbox[other] = value;
+    pending[other] = true;
+
+    return received;
+}
+
+bool LinkCable::receive(int side, uint8_t &value)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    if (!pending[side])
+    {
+        return false;
+    }
+
+    pending[side] = false;
+    value = inbox[side];
+
+    return true;
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+// serial port (SB 0xFF01, SC 0xFF02) and an in-process link cable
+//
+// instances on a cable only synchronize when a byte is transferred: the side
+// driving the clock swaps bytes through the cable when it starts a transfer
+// and finishes it on its own clock, the other side picks up its byte at the
+// first frame boundary where its SC waits for the external clock. that's
+// enough for games exchanging a byte per frame, and both instances keep
+// running at full speed on their own threads
+
+constexpr uint64_t SERIAL_IDLE = UINT64_MAX;        // no transfer in progress
+constexpr uint32_t SERIAL_BYTE_CYCLES = 4096;       // 8 bits at 8192 Hz
+constexpr uint32_t SERIAL_FAST_BYTE_CYCLES = 128;   // CGB high speed clock, 262144 Hz
+constexpr size_t SERIAL_OUTPUT_MAX = 4096;          // sent bytes kept in Serial::output
+
+enum SerialTestResult
+{
+    SERIAL_TEST_RUNNING,
+    SERIAL_TEST_PASSED,
+    SERIAL_TEST_FAILED,
+};
+
+struct LinkCable;
+
+struct Serial
+{
+    LinkCable *link;       // null if nothing is connected, transfers then shift in 0xFF
+    int side;              // this end of the cable, 0 or 1
+    bool start_pending;    // an internal clock transfer was started, Gameboy::service_events() picks it up
+    uint64_t transfer_end; // total_cycles when the running transfer completes, or SERIAL_IDLE
+    uint8_t incoming;      // byte shifted in by the running transfer
+
+    bool echo;          // copy sent bytes to stdout
+    std::string output; // the last SERIAL_OUTPUT_MAX bytes sent
+
+    Serial();
+
+    void record(uint8_t value);           // keep a sent byte for output and echo
+    SerialTestResult test_result() const; // Blargg test ROMs print "Passed" or "Failed"
+};
+
+struct LinkCable
+{
+    std::mutex mutex;
+    uint8_t data[2];  // SB of each side, shifted out when the other side transfers
+    bool pending[2];  // inbox[side] holds a byte for that side
+    uint8_t inbox[2];
+
+    LinkCable();
+
+    void connect(Serial &a, Serial &b);
+
+    void publish(int side, uint8_t value);     // SB of side changed
+    uint8_t exchange(int side, uint8_t value); // side drives a transfer, returns the other side's SB
+    bool receive(int side, uint8_t &value);    // byte sent to side since the last call, if any
+};
@@ -0,0 +1,147 @@
+#include "gameboy.h"
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// runs a test ROM headless and reports what it printed over the serial port.
+// Blargg's test ROMs end their output with "Passed" or "Failed"
+//
+//   gameboy_serial_test <rom_file> [max_frames]
+//   gameboy_serial_test --link
+//
+// exits 0 if the ROM passed, 1 if it failed or faulted and 2 if it didn't
+// finish in time. a ROM that ends in a lockup without a verdict also fails.
+//
+// --link checks two instances on a LinkCable instead: one sends a byte on
+// its internal clock while the other hasn't started its transfer yet. the
+// byte has to wait on the cable, leaving the receiver's SB alone, and
+// complete the transfer once the receiver starts it. exits 0 if both ends
+// got the other's byte
+
+constexpr uint64_t SERIAL_TEST_DEFAULT_FRAMES = 60 * 120; // two minutes of emulated time
+
+constexpr uint16_t LINK_TEST_CODE = 0x150;     // after the header, 0x100 jumps here
+constexpr uint16_t LINK_TEST_RESULT = 0xC000;  // SB after the transfer
+constexpr uint16_t LINK_TEST_GO = 0xC100;      // the receiver starts its transfer once this is set
+constexpr uint8_t LINK_TEST_SENDER_BYTE = 0x42;
+constexpr uint8_t LINK_TEST_RECEIVER_BYTE = 0x17;
+
+// SB = sb, wait for LINK_TEST_GO if asked to, start a transfer with SC = sc,
+// wait for it and store SB at LINK_TEST_RESULT
+static RomImage link_test_rom(uint8_t sb, uint8_t sc, bool wait_for_go)
+{
+    std::vector<uint8_t> rom(CARTRIDGE_MAX_ROM_SIZE, 0);
+    std::vector<uint8_t> code = {0x3E, sb, 0xE0, 0x01}; // LD A,sb; LDH (SB),A
+
+    if (wait_for_go)
+    {
+        // LD A,(LINK_TEST_GO); AND A; JR Z,-6
+        code.insert(code.end(), {0xFA, LINK_TEST_GO & 0xFF, LINK_TEST_GO >> 8, 0xA7, 0x28, 0xFA});
+    }
+
+    code.insert(code.end(), {0x3E, sc, 0xE0, 0x02}); // LD A,sc; LDH (SC),A
+    code.insert(code.end(), {0xF0, 0x02, 0xE6, 0x80, 0x20, 0xFA}); // LDH A,(SC); AND 0x80; JR NZ,-6
+    code.insert(code.end(), {0xF0, 0x01, 0xEA, LINK_TEST_RESULT & 0xFF, LINK_TEST_RESULT >> 8}); // LDH A,(SB); LD (result),A
+    code.insert(code.end(), {0x18, 0xFE}); // JR -2, ends the instance with GB_FAULT_LOCKUP
+
+    std::copy(code.begin(), code.end(), rom.begin() + LINK_TEST_CODE);
+    rom[0x101] = 0xC3; // JP LINK_TEST_CODE
+    rom[0x102] = LINK_TEST_CODE & 0xFF;
+    rom[0x103] = LINK_TEST_CODE >> 8;
+
+    return cartridge_make_image(std::move(rom));
+}
+
+static bool link_test_expect(const char *what, uint8_t value, uint8_t expected)
+{
+    if (value == expected)
+    {
+        return true;
+    }
+
+    std::cerr << what << " is " << std::hex << int(value) << ", expected " << int(expected) << std::dec << std::endl;
+    return false;
+}
+
+static int link_test()
+{
+    Gameboy sender(link_test_rom(LINK_TEST_SENDER_BYTE, 0x81, false)); // internal clock
+    Gameboy receiver(link_test_rom(LINK_TEST_RECEIVER_BYTE, 0x80, true)); // external clock
+    LinkCable cable;
+    cable.connect(sender.mmu.serial, receiver.mmu.serial);
+
+    receiver.run_frame(); // publishes its SB and waits for LINK_TEST_GO
+    sender.run_frame();   // transfers, and finishes within the next frame
+    sender.run_frame();
+    receiver.run_frame(); // no transfer running, the byte stays on the cable
+
+    bool ok = link_test_expect("sender result", sender.mmu.read8(LINK_TEST_RESULT), LINK_TEST_RECEIVER_BYTE);
+    ok &= link_test_expect("receiver SB before its transfer", receiver.mmu.read8(0xFF01), LINK_TEST_RECEIVER_BYTE);
+
+    receiver.mmu.write8(LINK_TEST_GO, 1);
+    receiver.run_frame(); // starts the transfer
+    receiver.run_frame(); // picks up the byte at the frame boundary
+
+    ok &= link_test_expect("receiver result", receiver.mmu.read8(LINK_TEST_RESULT), LINK_TEST_SENDER_BYTE);
+    ok &= link_test_expect("receiver SC", receiver.mmu.read8(0xFF02) & 0x80, 0);
+
+    std::cout << "link cable exchange " << (ok ? "ok" : "FAILED") << std::endl;
+    return ok ? 0 : 1;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc == 2 && std::string(argv[1]) == "--link")
+    {
+        return link_test();
+    }
+
+    if (argc != 2 && argc != 3)
+    {
+        std::cerr << "Usage: " << argv[0] << " <rom_file> [max_frames] | --link" << std::endl;
+        return 2;
+    }
+
+    uint64_t max_frames = argc == 3 ? std::strtoull(argv[2], nullptr, 10) : SERIAL_TEST_DEFAULT_FRAMES;
+
+    Gameboy gb(argv[1]);
+
+    if (gb.fault == GB_FAULT_ROM_LOAD)
+    {
+        std::cerr << gb.load_error << std::endl;
+        return 2;
+    }
+
+    gb.mmu.serial.echo = true;
+
+    SerialTestResult result = SERIAL_TEST_RUNNING;
+    GameboyFault fault = gb.fault;
+
+    for (uint64_t frame = 0; frame < max_frames && result == SERIAL_TEST_RUNNING && !gb_fault_fatal(fault); frame++)
+    {
+        fault = gb.run_frame();
+        result = gb.mmu.serial.test_result();
+    }
+
+    std::cout << std::endl;
+
+    if (result == SERIAL_TEST_RUNNING && gb_fault_fatal(fault))
+    {
+        std::cerr << "Stopped at PC " << std::hex << gb.fault_pc << std::dec << ": " << gb_fault_name(fault)
+                  << std::endl;
+        return 1;
+    }
+
+    switch (result)
+    {
+    case SERIAL_TEST_PASSED:
+        return 0;
+    case SERIAL_TEST_FAILED:
+        return 1;
+    default:
+        std::cerr << "Timed out after " << max_frames << " frames" << std::endl;
+        return 2;
+    }
+}
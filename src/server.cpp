@@ -0,0 +1,261 @@
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cerrno>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "gameboy.h"
+#include "shm_protocol.h"
+
+// hosts a pool of emulator instances that clients drive through shared memory,
+// see shm_protocol.h for the layout and handshake
+//
+// usage: gameboy_server <rom> <num_slots> [num_threads] [shm_name]
+
+constexpr size_t SERVER_MAX_SLOTS = 4096; // every slot is a warm instance, this keeps typos from exhausting memory
+
+static std::atomic<bool> running = true; // cleared on SIGINT/SIGTERM
+
+// a decimal count from 1 to max. strtoul() alone would take "-1" and wrap it
+static bool parse_count(const char *text, size_t max, size_t &value)
+{
+    if (!std::isdigit(static_cast<unsigned char>(text[0])))
+    {
+        return false;
+    }
+
+    char *end;
+    errno = 0;
+    unsigned long parsed = std::strtoul(text, &end, 10);
+
+    if (*end != '\0' || errno == ERANGE || parsed == 0 || parsed > max)
+    {
+        return false;
+    }
+
+    value = parsed;
+    return true;
+}
+
+static_assert(SHM_FRAME_SIZE == PPU_SCREEN_WIDTH * PPU_SCREEN_HEIGHT);
+static_assert(SHM_PACKED_LINE_SIZE == PPU_PACKED_LINE_SIZE && SHM_DIRTY_WORDS == PPU_DIRTY_WORDS);
+
+// seen_lines is the slot's PPU::line_version as of its previous publish()
+static void publish(Gameboy &gb, ShmSlot &slot, uint64_t &seen_lines)
+{
+    slot.total_cycles = gb.total_cycles;
+    slot.fault = gb.fault;
+    slot.fault_pc = gb.fault_pc;
+
+    // the slot keeps the previous frame, only changed lines are copied
+    for (int y = 0; y < PPU_SCREEN_HEIGHT; y++)
+    {
+        if (gb.ppu.line_dirty(y, seen_lines))
+        {
+            std::memcpy(&slot.frame[y * PPU_SCREEN_WIDTH], &gb.ppu.framebuffer[y * PPU_SCREEN_WIDTH], PPU_SCREEN_WIDTH);
+            std::memcpy(&slot.packed_frame[y * PPU_PACKED_LINE_SIZE], &gb.ppu.packed_frame[y * PPU_PACKED_LINE_SIZE],
+                        PPU_PACKED_LINE_SIZE);
+        }
+    }
+
+    std::memcpy(slot.dirty_lines, gb.ppu.dirty_lines(seen_lines).data(), sizeof(slot.dirty_lines));
+    seen_lines = gb.ppu.line_version;
+
+    // through the page tables, so the CGB WRAM bank selected by SVBK is what the client sees
+    gb.mmu.read_block(0xC000, slot.wram, SHM_WRAM_SIZE);
+    gb.mmu.read_block(0xFF00, slot.high, SHM_HIGH_SIZE);
+}
+
+static void serve(ShmHeader *header, std::vector<std::unique_ptr<Gameboy>> &instances,
+                  std::vector<uint64_t> &seen_lines, const std::vector<uint8_t> &initial_state, size_t worker,
+                  size_t num_workers)
+{
+    ShmSlot *slots = shm_slots(header);
+    std::atomic<uint32_t> &doorbell = header->doorbells[worker].value; // rung for the slots this worker serves
+
+    while (running)
+    {
+        // read the doorbell before scanning, so a request arriving mid-scan
+        // makes the futex wait below return immediately
+        uint32_t rung = doorbell.load(std::memory_order_acquire);
+        bool did_work = false;
+
+        for (size_t i = worker; i < instances.size(); i += num_workers)
+        {
+            ShmSlot &slot = slots[i];
+            uint32_t request = slot.request_seq.load(std::memory_order_acquire);
+
+            if (request == slot.response_seq.load(std::memory_order_relaxed))
+            {
+                continue;
+            }
+
+            Gameboy &gb = *instances[i];
+
+            if (slot.command == SHM_CMD_RESET)
+            {
+                gb.load_state(initial_state);
+            }
+            else if (!gb_fault_fatal(gb.fault))
+            {
+                gb.mmu.set_buttons(slot.buttons);
+                gb.run_frame();
+            }
+
+            publish(gb, slot, seen_lines[i]);
+            slot.response_seq.store(request, std::memory_order_release);
+            shm_futex_wake_all(slot.response_seq);
+            did_work = true;
+        }
+
+        if (!did_work)
+        {
+            shm_futex_wait(doorbell, rung);
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    size_t num_slots = 0;
+    size_t num_threads = std::max(std::thread::hardware_concurrency(), 1u);
+
+    if (argc < 3 || argc > 5 || !parse_count(argv[2], SERVER_MAX_SLOTS, num_slots) ||
+        (argc > 3 && !parse_count(argv[3], SHM_MAX_WORKERS, num_threads)))
+    {
+        std::cerr << "usage: " << argv[0] << " <rom> <num_slots> [num_threads] [shm_name]" << std::endl;
+        std::cerr << "num_slots from 1 to " << SERVER_MAX_SLOTS << ", num_threads from 1 to " << SHM_MAX_WORKERS
+                  << std::endl;
+        return 1;
+    }
+
+    std::string rom = argv[1];
+    std::string shm_name = argc > 4 ? argv[4] : SHM_DEFAULT_NAME;
+    num_threads = std::min<size_t>({num_threads, num_slots, SHM_MAX_WORKERS});
+
+    // warm pool, all instances are created once, share one ROM image and
+    // reset from a shared snapshot
+
+    RomImage image = cartridge_load_image(rom);
+
+    if (!image)
+    {
+        std::cerr << "Failed to open game ROM file: " << rom << std::endl;
+        return 1;
+    }
+
+    std::vector<std::unique_ptr<Gameboy>> instances;
+    instances.reserve(num_slots);
+
+    for (uint32_t i = 0; i < num_slots; i++)
+    {
+        instances.push_back(std::make_unique<Gameboy>(image));
+    }
+
+    if (instances[0]->fault == GB_FAULT_ROM_LOAD)
+    {
+        std::cerr << instances[0]->load_error << std::endl; // the same for every instance
+        return 1;
+    }
+
+    std::vector<uint8_t> initial_state = instances[0]->save_state();
+
+    // create and map the shared memory segment
+
+    size_t size = shm_segment_size(num_slots);
+    int fd = shm_open(shm_name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+
+    if (fd < 0)
+    {
+        std::cerr << "Failed to create shared memory " << shm_name << ": " << std::strerror(errno) << std::endl;
+        return 1;
+    }
+
+    if (ftruncate(fd, size) != 0)
+    {
+        std::cerr << "Failed to size shared memory " << shm_name << ": " << std::strerror(errno) << std::endl;
+        close(fd);
+        shm_unlink(shm_name.c_str()); // we created it, don't leave it behind for the next O_EXCL
+        return 1;
+    }
+
+    void *mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (mapping == MAP_FAILED)
+    {
+        std::cerr << "Failed to map shared memory: " << std::strerror(errno) << std::endl;
+        shm_unlink(shm_name.c_str());
+        return 1;
+    }
+
+    ShmHeader *header = new (mapping) ShmHeader{};
+    std::vector<uint64_t> seen_lines(num_slots, 0);
+    ShmSlot *slots = shm_slots(header);
+
+    for (uint32_t i = 0; i < num_slots; i++)
+    {
+        new (&slots[i]) ShmSlot{};
+        publish(*instances[i], slots[i], seen_lines[i]);
+    }
+
+    header->num_slots = num_slots;
+    header->slot_size = sizeof(ShmSlot);
+    header->num_workers = num_threads;
+    header->version = SHM_VERSION;
+    std::atomic_thread_fence(std::memory_order_release);
+    header->magic = SHM_MAGIC; // written last, clients poll it before attaching
+
+    // block termination signals in all threads, the main thread picks them up with sigwait()
+
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+    std::vector<std::thread> workers;
+
+    for (size_t worker = 0; worker < num_threads; worker++)
+    {
+        workers.emplace_back(serve, header, std::ref(instances), std::ref(seen_lines), std::cref(initial_state), worker,
+                             num_threads);
+    }
+
+    std::cout << "serving " << num_slots << " instances of " << rom << " on " << shm_name
+              << " with " << num_threads << " threads" << std::endl;
+
+    int signal = 0;
+    sigwait(&signals, &signal);
+
+    running = false;
+
+    for (size_t worker = 0; worker < num_threads; worker++)
+    {
+        header->doorbells[worker].value.fetch_add(1, std::memory_order_release);
+        shm_futex_wake_one(header->doorbells[worker].value);
+    }
+
+    for (auto &worker : workers)
+    {
+        worker.join();
+    }
+
+    munmap(mapping, size);
+    shm_unlink(shm_name.c_str());
+
+    return 0;
+}
@@ -0,0 +1,138 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// shared memory layout between gameboy_server and its clients (Linux only)
+//
+// the segment starts with a ShmHeader followed by num_slots ShmSlots. every
+// slot belongs to one emulator instance and is driven by one client at a time:
+//
+//   client: write command/buttons, request_seq++, doorbell++, futex wake the slot's worker
+//   server: run the command, write observation, response_seq = request_seq, futex wake client
+//
+// slot i is served by worker i % num_workers, which sleeps on its own
+// doorbell, so a request wakes exactly the thread that handles it. no locks
+// are taken, both sides only wait on futexes when there's nothing to do
+
+constexpr uint32_t SHM_MAGIC = 0x48534247; // "GBSH"
+constexpr uint32_t SHM_VERSION = 4;
+constexpr const char *SHM_DEFAULT_NAME = "/gameboy_emu";
+
+constexpr size_t SHM_FRAME_SIZE = 160 * 144; // shade index per pixel, row-major
+constexpr size_t SHM_PACKED_LINE_SIZE = 160 / 4;               // 2 bits per pixel, leftmost in the low bits
+constexpr size_t SHM_PACKED_FRAME_SIZE = SHM_PACKED_LINE_SIZE * 144;
+constexpr size_t SHM_DIRTY_WORDS = 3;                           // bit y % 64 of word y / 64 per line
+constexpr size_t SHM_WRAM_SIZE = 0x2000;     // 0xC000 - 0xDFFF
+constexpr size_t SHM_HIGH_SIZE = 0x100;      // 0xFF00 - 0xFFFF, I/O registers and HRAM
+
+constexpr uint8_t SHM_CMD_STEP = 0;  // run one frame with the given buttons
+constexpr uint8_t SHM_CMD_RESET = 1; // restore the instance to its power-on state
+
+constexpr uint32_t SHM_MAX_WORKERS = 64; // server threads, one doorbell each
+
+// a cache line of its own, so workers don't share lines they sleep on
+struct alignas(64) ShmDoorbell
+{
+    std::atomic<uint32_t> value; // bumped by clients on every request to the worker's slots
+};
+
+struct ShmHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t num_slots;
+    uint32_t slot_size;   // sizeof(ShmSlot), lets clients detect mismatched builds
+    uint32_t num_workers; // at most SHM_MAX_WORKERS
+    ShmDoorbell doorbells[SHM_MAX_WORKERS];
+};
+
+struct ShmSlot
+{
+    alignas(64) std::atomic<uint32_t> request_seq;  // written by the client
+    alignas(64) std::atomic<uint32_t> response_seq; // written by the server
+    uint8_t command;                                // SHM_CMD_*
+    uint8_t buttons;                                // JOYPAD_* bits for SHM_CMD_STEP
+
+    // observation, valid after response_seq caught up with request_seq
+    alignas(64) uint64_t total_cycles;
+    uint8_t fault;     // GameboyFault, the slot only runs again after SHM_CMD_RESET if it's fatal
+    uint16_t fault_pc; // PC of the faulting instruction
+    uint64_t dirty_lines[SHM_DIRTY_WORDS]; // lines of frame that changed since the previous response
+    uint8_t frame[SHM_FRAME_SIZE];
+    uint8_t packed_frame[SHM_PACKED_FRAME_SIZE]; // frame at 2 bits per pixel
+    uint8_t wram[SHM_WRAM_SIZE];
+    uint8_t high[SHM_HIGH_SIZE];
+};
+
+static_assert(std::atomic<uint32_t>::is_always_lock_free);
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t));
+
+inline size_t shm_segment_size(uint32_t num_slots)
+{
+    return sizeof(ShmHeader) + num_slots * sizeof(ShmSlot);
+}
+
+inline ShmSlot *shm_slots(ShmHeader *header)
+{
+    return reinterpret_cast<ShmSlot *>(header + 1);
+}
+
+// the doorbell of the worker serving a slot
+inline std::atomic<uint32_t> &shm_doorbell(ShmHeader *header, uint32_t slot_index)
+{
+    return header->doorbells[slot_index % header->num_workers].value;
+}
+
+// futexes work across processes as long as FUTEX_PRIVATE_FLAG isn't used
+
+inline void shm_futex_wait(std::atomic<uint32_t> &word, uint32_t expected)
+{
+    syscall(SYS_futex, reinterpret_cast<uint32_t *>(&word), FUTEX_WAIT, expected, nullptr, nullptr, 0);
+}
+
+inline void shm_futex_wake_all(std::atomic<uint32_t> &word)
+{
+    syscall(SYS_futex, reinterpret_cast<uint32_t *>(&word), FUTEX_WAKE, INT32_MAX, nullptr, nullptr, 0);
+}
+
+inline void shm_futex_wake_one(std::atomic<uint32_t> &word)
+{
+    syscall(SYS_futex, reinterpret_cast<uint32_t *>(&word), FUTEX_WAKE, 1, nullptr, nullptr, 0);
+}
+
+// client side helpers
+
+inline void shm_submit(ShmHeader *header, uint32_t slot_index, uint8_t command, uint8_t buttons)
+{
+    ShmSlot &slot = shm_slots(header)[slot_index];
+    std::atomic<uint32_t> &doorbell = shm_doorbell(header, slot_index);
+
+    slot.command = command;
+    slot.buttons = buttons;
+    slot.request_seq.fetch_add(1, std::memory_order_release);
+    doorbell.fetch_add(1, std::memory_order_release);
+    shm_futex_wake_one(doorbell); // only the slot's worker waits on it
+}
+
+inline void shm_wait(ShmSlot &slot)
+{
+    uint32_t request = slot.request_seq.load(std::memory_order_relaxed);
+
+    while (true)
+    {
+        uint32_t response = slot.response_seq.load(std::memory_order_acquire);
+
+        if (response == request)
+        {
+            return;
+        }
+
+        shm_futex_wait(slot.response_seq, response);
+    }
+}
@@ -0,0 +1,21 @@
+#include "tilecache.h"
+
+void TileCache::decode(const uint8_t *vram, int index, int tile)
+{
+    const uint8_t *data = vram + tile * 16;
+    uint8_t *out = &pixels[index * 64];
+
+    for (int y = 0; y < 8; y++)
+    {
+        uint8_t low = data[y * 2];      // bit 0 of each pixel
+        uint8_t high = data[y * 2 + 1]; // bit 1 of each pixel
+
+        for (int x = 0; x < 8; x++)
+        {
+            int bit = 7 - x; // leftmost pixel in the most significant bit
+            *out++ = ((low >> bit) & 1) | (((high >> bit) & 1) << 1);
+        }
+    }
+
+    valid[index] = true;
+}
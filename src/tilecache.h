@@ -0,0 +1,45 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+// tile data occupies 0x8000 - 0x97FF of each VRAM bank, 16 bytes per tile
+constexpr int TILE_CACHE_TILES = 384;
+constexpr int TILE_CACHE_BANKS = 2;
+constexpr uint16_t TILE_CACHE_END = 0x9800;
+
+// VRAM tiles decoded from 2bpp planes into one color index (0-3) per pixel.
+// entries are decoded on first use and invalidated by MMU::write_slow() when
+// the tile's bytes are written, so static backgrounds render from lookups.
+// code writing VRAM around write8() has to call invalidate_all()
+
+struct TileCache
+{
+    std::array<uint8_t, TILE_CACHE_BANKS * TILE_CACHE_TILES * 64> pixels{}; // 8x8 color indices per tile
+    std::array<bool, TILE_CACHE_BANKS * TILE_CACHE_TILES> valid{};
+
+    void invalidate(int bank, uint16_t address)
+    {
+        if (address < TILE_CACHE_END)
+        {
+            valid[bank * TILE_CACHE_TILES + ((address - 0x8000) >> 4)] = false;
+        }
+    }
+
+    void invalidate_all() { valid.fill(false); }
+
+    // 8 color indices of row y of a tile, vram points at 0x8000 of the bank
+    const uint8_t *row(const uint8_t *vram, int bank, int tile, int y)
+    {
+        int index = bank * TILE_CACHE_TILES + tile;
+
+        if (!valid[index])
+        {
+            decode(vram, index, tile);
+        }
+
+        return &pixels[index * 64 + y * 8];
+    }
+
+    void decode(const uint8_t *vram, int index, int tile);
+};
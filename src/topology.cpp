@@ -0,0 +1,203 @@
+#include "topology.h"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#ifndef _WIN32
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#ifndef _WIN32
+
+// parses a sysfs CPU list like "0-15,64-79"
+static std::vector<int> parse_cpu_list(const std::string &list)
+{
+    std::vector<int> cpus;
+    std::istringstream ranges(list);
+    std::string range;
+
+    while (std::getline(ranges, range, ','))
+    {
+        int first, last;
+        char dash;
+        std::istringstream parts(range);
+
+        if (!(parts >> first))
+        {
+            continue;
+        }
+
+        if (!(parts >> dash >> last))
+        {
+            last = first;
+        }
+
+        for (int cpu = first; cpu <= last; cpu++)
+        {
+            cpus.push_back(cpu);
+        }
+    }
+
+    return cpus;
+}
+
+static std::string read_line(const std::string &filename)
+{
+    std::ifstream file(filename);
+    std::string line;
+    std::getline(file, line);
+    return line;
+}
+
+// 0 for the first thread of a physical core, 1 for its SMT sibling, ...
+static int smt_index(int cpu)
+{
+    std::vector<int> siblings = parse_cpu_list(
+        read_line("/sys/devices/system/cpu/cpu" + std::to_string(cpu) + "/topology/thread_siblings_list"));
+    auto it = std::find(siblings.begin(), siblings.end(), cpu);
+    return it == siblings.end() ? 0 : static_cast<int>(it - siblings.begin());
+}
+
+CpuTopology CpuTopology::detect()
+{
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+    {
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+        {
+            CPU_SET(cpu, &allowed);
+        }
+    }
+
+    CpuTopology topology;
+    std::vector<int> online = parse_cpu_list(read_line("/sys/devices/system/node/online"));
+
+    for (int node : online)
+    {
+        std::vector<int> cpus =
+            parse_cpu_list(read_line("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist"));
+        std::vector<std::pair<int, int>> usable; // (SMT index, CPU)
+
+        for (int cpu : cpus)
+        {
+            if (cpu < CPU_SETSIZE && CPU_ISSET(cpu, &allowed))
+            {
+                usable.emplace_back(smt_index(cpu), cpu);
+            }
+        }
+
+        if (usable.empty())
+        {
+            continue; // memory-only node, or none of its CPUs are ours
+        }
+
+        std::sort(usable.begin(), usable.end());
+        topology.nodes.emplace_back();
+
+        for (auto &[smt, cpu] : usable)
+        {
+            topology.nodes.back().push_back(cpu);
+        }
+    }
+
+    if (topology.nodes.empty())
+    {
+        topology.nodes.emplace_back();
+
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+        {
+            if (CPU_ISSET(cpu, &allowed))
+            {
+                topology.nodes[0].push_back(cpu);
+            }
+        }
+    }
+
+    return topology;
+}
+
+bool pin_current_thread(int cpu)
+{
+    if (cpu < 0 || cpu >= CPU_SETSIZE)
+    {
+        return false;
+    }
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+}
+
+#else
+
+// no sysfs, everything is one node and threads stay where the scheduler puts them
+
+CpuTopology CpuTopology::detect()
+{
+    CpuTopology topology;
+    topology.nodes.emplace_back();
+
+    for (unsigned cpu = 0; cpu < std::max(std::thread::hardware_concurrency(), 1u); cpu++)
+    {
+        topology.nodes[0].push_back(static_cast<int>(cpu));
+    }
+
+    return topology;
+}
+
+bool pin_current_thread(int)
+{
+    return false;
+}
+
+#endif
+
+size_t CpuTopology::num_cpus() const
+{
+    size_t total = 0;
+
+    for (const auto &cpus : nodes)
+    {
+        total += cpus.size();
+    }
+
+    return total;
+}
+
+std::vector<std::pair<int, int>> CpuTopology::place(size_t num_workers) const
+{
+    std::vector<std::pair<int, int>> placement;
+    size_t total = num_cpus();
+
+    if (total == 0)
+    {
+        return std::vector<std::pair<int, int>>(num_workers, {0, -1});
+    }
+
+    // node n gets the workers whose evenly spaced position over all CPUs falls into it
+    size_t node_start = 0;
+
+    for (size_t node = 0; node < nodes.size(); node++)
+    {
+        size_t node_end = node_start + nodes[node].size();
+        size_t first = (node_start * num_workers + total - 1) / total;
+        size_t last = (node_end * num_workers + total - 1) / total;
+
+        for (size_t worker = first; worker < last; worker++)
+        {
+            // more workers than CPUs share them round robin
+            placement.emplace_back(static_cast<int>(node), nodes[node][(worker - first) % nodes[node].size()]);
+        }
+
+        node_start = node_end;
+    }
+
+    return placement;
+}
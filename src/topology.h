@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+// NUMA nodes and the CPUs this process may run on, read from sysfs
+//
+// only CPUs in the process's affinity mask are listed, so cpusets and
+// taskset are respected. without NUMA information (non-NUMA kernels, no
+// sysfs, Windows) everything is one node. pinning is a no-op on Windows
+
+struct CpuTopology
+{
+    // CPUs of each node with a CPU we may use. physical cores come first,
+    // their SMT siblings after them, so the first few workers of a node
+    // don't share a core
+    std::vector<std::vector<int>> nodes;
+
+    static CpuTopology detect();
+
+    size_t num_cpus() const;
+
+    // spread num_workers over the nodes in proportion to their CPUs,
+    // consecutive workers share a node. returns the node and CPU of each
+    std::vector<std::pair<int, int>> place(size_t num_workers) const;
+};
+
+bool pin_current_thread(int cpu); // false if the CPU isn't available